@@ -0,0 +1,63 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "backlinklist.h"
+
+#include "topicmanager.h"
+#include "linkindex.h"
+
+BacklinkList::BacklinkList( TopicManager *topicManager, QWidget *parent )
+  : QListWidget( parent ), mTopicManager( topicManager )
+{
+  connect( mTopicManager->linkIndex(),
+    SIGNAL( linksChanged( const QString & ) ),
+    SLOT( slotLinksChanged( const QString & ) ) );
+  connect( this, SIGNAL( itemActivated( QListWidgetItem * ) ),
+    SLOT( slotItemActivated( QListWidgetItem * ) ) );
+}
+
+void BacklinkList::setTopic( const QString &topic )
+{
+  mTopic = topic;
+  refresh();
+}
+
+void BacklinkList::refresh()
+{
+  clear();
+
+  if ( mTopic.isEmpty() ) return;
+
+  addItems( mTopicManager->linkIndex()->backlinks( mTopic ) );
+}
+
+void BacklinkList::slotLinksChanged( const QString &topic )
+{
+  // Only a change of the links of a topic can change the backlinks of the
+  // shown topic
+  LinkIndex *index = mTopicManager->linkIndex();
+  bool listed = !findItems( topic, Qt::MatchExactly ).isEmpty();
+  if ( listed != index->linksTo( topic, mTopic ) ) refresh();
+}
+
+void BacklinkList::slotItemActivated( QListWidgetItem *item )
+{
+  emit topicSelected( item->text() );
+}
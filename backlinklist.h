@@ -0,0 +1,59 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef BACKLINKLIST_H
+#define BACKLINKLIST_H
+
+#include <QListWidget>
+
+class TopicManager;
+
+/**
+  This class is a panel showing the topics linking to a topic. The list is
+  taken from the link index of the topic manager, so no topic data has to be
+  read.
+*/
+class BacklinkList : public QListWidget
+{
+    Q_OBJECT
+  public:
+    BacklinkList( TopicManager *, QWidget *parent );
+
+    /**
+      Set topic whose backlinks are shown.
+    */
+    void setTopic( const QString &topic );
+
+  signals:
+    /**
+      Emitted when the user activates one of the linking topics.
+    */
+    void topicSelected( const QString &topic );
+
+  protected slots:
+    void refresh();
+    void slotLinksChanged( const QString &topic );
+    void slotItemActivated( QListWidgetItem * );
+
+  private:
+    TopicManager *mTopicManager;
+    QString mTopic;
+};
+
+#endif
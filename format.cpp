@@ -22,6 +22,8 @@
 
 #include "dbg.h"
 #include "textformats.h"
+#include "segmentindex.h"
+#include "savequeue.h"
 
 #include <QFile>
 #include <QTextDocument>
@@ -31,13 +33,46 @@
 #include <QTextList>
 #include <QTextCodec>
 #include <QVariant>
+#include <QXmlStreamReader>
+#include <QSet>
 
  // REMEMBER TO BUMP VERSION WHEN CHANGING FORMAT
 const int currentFormatVersion = 1;
 
+Format::Parser Format::mDefaultParser = Format::StreamParser;
+
+/**
+  State of incremental loading.
+*/
+struct Format::LoadState
+{
+  QFile file;
+  QXmlStreamReader xml;
+  QTextCursor cursor;
+  QTextBlock extraBlock;
+  bool first;
+  bool failed;
+};
+
 Format::Format( QTextDocument *document )
-  : mDocument( document )
+  : mDocument( document ), mParser( mDefaultParser ),
+    mKeepWhitespace( false ), mLoadState( 0 )
+{
+}
+
+Format::~Format()
+{
+  delete mLoadState;
+}
+
+void Format::setDefaultParser( Parser parser )
+{
+  mDefaultParser = parser;
+}
+
+Format::Parser Format::defaultParser()
 {
+  return mDefaultParser;
 }
 
 bool Format::load( const QString &f )
@@ -47,41 +82,218 @@ bool Format::load( const QString &f )
   QFile file( f );
   if ( !file.open( QIODevice::ReadOnly ) ) return false;
 
+  if ( mParser == StreamParser ) {
+    QXmlStreamReader xml( &file );
+    return readDocument( xml );
+  }
+
   QByteArray data = file.readAll();
   QString str = QString::fromUtf8( data );
 
   return fromString( str );
 }
 
+bool Format::beginLoad( const QString &f )
+{
+  if ( mParser != StreamParser ) return false;
+
+  delete mLoadState;
+  mLoadState = new LoadState;
+  mLoadState->first = true;
+  mLoadState->failed = false;
+
+  mLoadState->file.setFileName( f );
+  if ( !mLoadState->file.open( QIODevice::ReadOnly ) ) return false;
+
+  mLoadState->xml.setDevice( &mLoadState->file );
+  if ( !readDocumentStart( mLoadState->xml ) ) return false;
+
+  mLoadState->cursor = QTextCursor( mDocument );
+  mLoadState->cursor.movePosition( QTextCursor::Start );
+
+  return true;
+}
+
+bool Format::loadNext( int count )
+{
+  if ( !mLoadState || mLoadState->failed ) return false;
+
+  for( int i = 0; i < count; ++i ) {
+    if ( !readFrameItem( mLoadState->cursor, mLoadState->xml,
+                         mLoadState->first, mLoadState->extraBlock ) ) {
+      if ( mLoadState->xml.hasError() ) {
+        qWarning( "Error loading format: %s (line %d)",
+          qPrintable( mLoadState->xml.errorString() ),
+          int( mLoadState->xml.lineNumber() ) );
+        mLoadState->failed = true;
+      }
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int Format::loadProgress() const
+{
+  if ( !mLoadState || mLoadState->file.size() == 0 ) return 100;
+
+  return int( qMin( mLoadState->xml.characterOffset() * 100 /
+    mLoadState->file.size(), qint64( 100 ) ) );
+}
+
+bool Format::loadFailed() const
+{
+  return !mLoadState || mLoadState->failed;
+}
+
 bool Format::save( const QString &f )
 {
-  QFile file( f );
+  QFile file( SaveQueue::temporaryFilename( f ) );
   if ( !file.open( QIODevice::WriteOnly ) ) return false;
-  QTextStream ts( &file );
+  if ( !save( &file ) ) {
+    file.close();
+    file.remove();
+    return false;
+  }
+  return SaveQueue::replaceFile( file, f );
+}
+
+bool Format::save( QIODevice *device )
+{
+  QTextStream ts( device );
   ts.setCodec( QTextCodec::codecForName( "utf8" ) );
-  ts << toString();
-  return true;
+  writeDocument( ts );
+  ts.flush();
+  return ts.status() == QTextStream::Ok;
 }
 
 QString Format::toString()
 {
-  QTextFrame *rootFrame = mDocument->rootFrame();
-
   QString str;
-  
-  str += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-  str += "<!DOCTYPE todoodle SYSTEM \"todoodle.dtd\">\n";
-  str += "<todoodle version=\"" + QString::number( currentFormatVersion ) + "\">\n";
-  
-  str += frameToString( rootFrame );
 
-  str += "</todoodle>\n";
+  QTextStream ts( &str, QIODevice::WriteOnly );
+  writeDocument( ts );
+  ts.flush();
 
   return str;
 }
 
+static QByteArray documentStart()
+{
+  return QByteArray( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<!DOCTYPE todoodle SYSTEM \"todoodle.dtd\">\n"
+    "<todoodle version=\"" ) + QByteArray::number( currentFormatVersion ) +
+    "\">\n";
+}
+
+static QByteArray documentEnd()
+{
+  return QByteArray( "</todoodle>\n" );
+}
+
+void Format::writeDocument( QTextStream &ts )
+{
+  ts << documentStart();
+
+  writeFrame( ts, mDocument->rootFrame() );
+
+  ts << documentEnd();
+}
+
+QList<QByteArray> Format::toSegments()
+{
+  QList<QByteArray> segments;
+
+  segments.append( documentStart() );
+  writeSegments( segments, mDocument->rootFrame() );
+  segments.append( documentEnd() );
+
+  return segments;
+}
+
+QStringList Format::topicLinks() const
+{
+  QSet<QString> links;
+
+  QTextBlock block;
+  for( block = mDocument->begin(); block.isValid(); block = block.next() ) {
+    QTextBlock::iterator it;
+    for( it = block.begin(); !it.atEnd(); ++it ) {
+      QString href = it.fragment().charFormat().anchorHref();
+      if ( href.startsWith( "todoodle:" ) ) links.insert( href.mid( 9 ) );
+    }
+  }
+
+  QStringList result = links.toList();
+  qSort( result );
+  return result;
+}
+
+QList<Format::Todo> Format::todos() const
+{
+  QList<Todo> result;
+
+  QTextBlock block;
+  for( block = mDocument->begin(); block.isValid(); block = block.next() ) {
+    QTextBlock::iterator it;
+    for( it = block.begin(); !it.atEnd(); ++it ) {
+      QTextImageFormat imageFormat =
+        it.fragment().charFormat().toImageFormat();
+      if ( !imageFormat.isValid() ) continue;
+      if ( !imageFormat.name().contains( "todo" ) ) continue;
+
+      Todo todo;
+      todo.text = block.text().remove( QChar::ObjectReplacementCharacter )
+        .simplified();
+      todo.done = imageFormat.name().contains( "done" );
+      todo.position = block.position();
+      result.append( todo );
+      break;
+    }
+  }
+
+  return result;
+}
+
+void Format::writeSegments( QList<QByteArray> &segments, QTextFrame *frame )
+{
+  QTextFrame::iterator it;
+  for( it = frame->begin(); it != frame->end(); ++it ) {
+    QTextBlock block = it.currentBlock();
+    if ( block.isValid() ) {
+      BlockSegment *segment = static_cast<BlockSegment *>( block.userData() );
+      if ( !segment ) {
+        segment = new BlockSegment;
+        QTextStream ts( &segment->data, QIODevice::WriteOnly );
+        ts.setCodec( QTextCodec::codecForName( "utf8" ) );
+        writeBlock( ts, block );
+        ts.flush();
+        block.setUserData( segment );
+      }
+      segments.append( segment->data );
+    }
+    QTextFrame *f = it.currentFrame();
+    if ( f ) {
+      QByteArray start;
+      QTextStream ts( &start, QIODevice::WriteOnly );
+      writeFrameStart( ts, f );
+      ts.flush();
+
+      segments.append( start );
+      writeSegments( segments, f );
+      segments.append( QByteArray( "</frame>\n" ) );
+    }
+  }
+}
+
 bool Format::fromString( const QString &str )
 {
+  if ( mParser == StreamParser ) {
+    QXmlStreamReader xml( str );
+    return readDocument( xml );
+  }
+
   QDomDocument doc;
   if ( !doc.setContent( str ) ) {
     dbg() << "Error loading " << str << endl;
@@ -113,69 +325,224 @@ bool Format::fromString( const QString &str )
   return true;
 }
 
+/**
+  Convert attributes of DOM element, so that the DOM and the stream parser can
+  share the code interpreting them.
+*/
+static QXmlStreamAttributes toAttributes( const QDomElement &element )
+{
+  QXmlStreamAttributes attributes;
+
+  QDomNamedNodeMap map = element.attributes();
+  for( int i = 0; i < map.count(); ++i ) {
+    QDomAttr attribute = map.item( i ).toAttr();
+    attributes.append( attribute.name(), attribute.value() );
+  }
+
+  return attributes;
+}
+
+static void skipElement( QXmlStreamReader &xml )
+{
+  int depth = 1;
+  while( depth > 0 && !xml.atEnd() ) {
+    xml.readNext();
+    if ( xml.isStartElement() ) ++depth;
+    else if ( xml.isEndElement() ) --depth;
+  }
+}
+
+bool Format::readTodos( const QString &filename, QList<Todo> &todos )
+{
+  QFile file( filename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return false;
+
+  QXmlStreamReader xml( &file );
+
+  while( !xml.atEnd() && !xml.isStartElement() ) {
+    xml.readNext();
+  }
+  if ( !xml.isStartElement() ) return false;
+
+  QStringRef versionAttribute = xml.attributes().value( "version" );
+  if ( !versionAttribute.isEmpty() &&
+       versionAttribute.toString().toInt() != currentFormatVersion ) {
+    return false;
+  }
+
+  int position = 0;
+
+  while( !xml.atEnd() ) {
+    xml.readNext();
+
+    // Frames are enclosed by a frame start and end character
+    if ( xml.name() == QLatin1String( "frame" ) ) {
+      if ( xml.isStartElement() || xml.isEndElement() ) ++position;
+      continue;
+    }
+    if ( !xml.isStartElement() ) continue;
+    if ( xml.name() != QLatin1String( "block" ) ) {
+      skipElement( xml );
+      continue;
+    }
+
+    // Collect text like readFragment() does, but only keep it as long as
+    // the block holds a todo item
+    QString blockText;
+    QString text;
+    QString status;
+    int length = 0;
+    while( !xml.atEnd() ) {
+      xml.readNext();
+      if ( xml.isCharacters() ) {
+        text += xml.text().toString();
+        continue;
+      }
+      if ( !xml.isStartElement() && !xml.isEndElement() ) continue;
+
+      if ( !text.trimmed().isEmpty() ) {
+        blockText += text;
+        length += text.length();
+      }
+      text.clear();
+
+      if ( xml.isEndElement() ) {
+        if ( xml.name() == QLatin1String( "block" ) ) break;
+      } else if ( xml.name() == QLatin1String( "todo" ) ) {
+        if ( status.isEmpty() ) {
+          status = xml.attributes().value( "status" ).toString();
+        }
+        ++length;
+        skipElement( xml );
+      }
+    }
+
+    if ( !status.isEmpty() ) {
+      Todo todo;
+      todo.text = blockText.simplified();
+      todo.done = status != "todo";
+      todo.position = position;
+      todos.append( todo );
+    }
+
+    position += length + 1;
+  }
+
+  if ( xml.hasError() ) {
+    qWarning( "Error reading todos of '%s': %s (line %d)",
+      qPrintable( filename ), qPrintable( xml.errorString() ),
+      int( xml.lineNumber() ) );
+    return false;
+  }
+
+  return true;
+}
+
+Format::Summary Format::summary() const
+{
+  Summary summary;
+
+  summary.title = mDocument->begin().text()
+    .remove( QChar::ObjectReplacementCharacter ).simplified();
+  summary.links = topicLinks();
+  summary.todoCount = 0;
+  summary.doneCount = 0;
+  foreach( Todo todo, todos() ) {
+    if ( todo.done ) ++summary.doneCount;
+    else ++summary.todoCount;
+  }
+
+  return summary;
+}
+
+bool Format::readSummary( QIODevice *device, Summary &summary )
+{
+  summary.title.clear();
+  summary.links.clear();
+  summary.todoCount = 0;
+  summary.doneCount = 0;
+
+  QXmlStreamReader xml( device );
+
+  while( !xml.atEnd() && !xml.isStartElement() ) {
+    xml.readNext();
+  }
+  if ( !xml.isStartElement() ) return false;
+
+  QStringRef versionAttribute = xml.attributes().value( "version" );
+  if ( !versionAttribute.isEmpty() &&
+       versionAttribute.toString().toInt() != currentFormatVersion ) {
+    return false;
+  }
+
+  QSet<QString> links;
+  int blocks = 0;
+  QString text;
+  // Like todos(), count only the first todo item of each block
+  bool blockHasTodo = false;
+
+  while( !xml.atEnd() ) {
+    xml.readNext();
+
+    // The title is the text of the first block
+    if ( blocks == 1 && xml.isCharacters() ) {
+      text += xml.text().toString();
+      continue;
+    }
+    if ( xml.isStartElement() || xml.isEndElement() ) {
+      if ( !text.trimmed().isEmpty() ) summary.title += text;
+      text.clear();
+    }
+    if ( !xml.isStartElement() ) continue;
+
+    if ( xml.name() == QLatin1String( "block" ) ) {
+      ++blocks;
+      blockHasTodo = false;
+    } else if ( xml.name() == QLatin1String( "fragment" ) ) {
+      QString link = xml.attributes().value( "link" ).toString();
+      if ( link.startsWith( "todoodle:" ) ) links.insert( link.mid( 9 ) );
+    } else if ( xml.name() == QLatin1String( "todo" ) && !blockHasTodo ) {
+      blockHasTodo = true;
+      if ( xml.attributes().value( "status" ) == QLatin1String( "todo" ) ) {
+        ++summary.todoCount;
+      } else {
+        ++summary.doneCount;
+      }
+    }
+  }
+
+  if ( xml.hasError() ) {
+    qWarning( "Error reading summary: %s (line %d)",
+      qPrintable( xml.errorString() ), int( xml.lineNumber() ) );
+    return false;
+  }
+
+  summary.title = summary.title.simplified();
+  summary.links = links.toList();
+  qSort( summary.links );
+
+  return true;
+}
+
 void Format::parseFrame( QTextCursor &cursor, const QDomElement &element )
 {
   QTextBlock extraBlock;
-  bool hasExtraBlock = false;
 
   QDomNode n;
   for( n = element.firstChild(); !n.isNull(); n = n.nextSibling() ) {
     QDomElement e = n.toElement();
     if ( e.tagName() == "block" ) {
-      if ( e.hasAttribute( "liststyle" ) ) {
-        cursor.setCharFormat( TextFormats::normalCharFormat() );
-        QTextListFormat f;
-        f.setIndent( e.attribute( "listindent" ).toInt() );
-        if ( e.attribute( "liststyle" ) == "decimal" ) {
-          f.setStyle( QTextListFormat::ListDecimal );
-        } else {
-          f.setStyle( QTextListFormat::ListDisc );
-        }
-        cursor.mergeBlockFormat( TextFormats::normalBlockFormat() );
-        cursor.insertList( f );
-      } else if ( n != element.firstChild() ) {
-        QTextBlockFormat f;
-        if ( e.hasAttribute( "blockindent" ) ) {
-          f.setIndent( e.attribute( "blockindent" ).toInt() );
-        } else {
-          f.setIndent( 0 );
-        }
-        if ( hasExtraBlock ) {
-          QTextCursor c( extraBlock );
-          c.setBlockFormat( f );
-          hasExtraBlock = false;
-        } else {
-          cursor.insertBlock( f );
-        }
-      }
-      if ( e.hasAttribute( "lastmodified" ) ) {
-        QString str = e.attribute( "lastmodified" );
-        QDateTime dt = QDateTime::fromString( str, Qt::ISODate );
-        TextFormats::setLastModified( cursor, dt );
-      }
+      BlockAttributes attributes = blockAttributes( toAttributes( e ) );
+      beginBlock( cursor, attributes, n == element.firstChild(), extraBlock );
       parseBlock( cursor, e );
-
-      if ( e.hasAttribute( "titlestyle" ) ) {
-        if ( e.attribute( "titlestyle" ) == "title" ) {
-          cursor.mergeBlockFormat( TextFormats::titleBlockFormat() );
-        } else if ( e.attribute( "titlestyle" ) == "subtitle" ) {
-          cursor.mergeBlockFormat( TextFormats::subTitleBlockFormat() );
-        }
-      } else {
-        cursor.mergeBlockFormat( TextFormats::normalBlockFormat() );
-      }
+      endBlock( cursor, attributes );
     } else if ( e.tagName() == "frame" ) {
       QTextFrame *parentFrame = cursor.currentFrame();
 
       QTextFrame *frame = cursor.insertFrame( TextFormats::codeFrameFormat() );
       parseFrame( cursor, e );
-      if ( e.attribute( "type" ) == "code" ) {
-        TextFormats::setCodeFrameFormats( frame );
-      }
-
-      cursor = parentFrame->lastCursorPosition();
-      extraBlock = cursor.block();
-      hasExtraBlock = true;
+      endFrame( cursor, e.attribute( "type" ) == "code", parentFrame, frame,
+        extraBlock );
     }
   }
 }
@@ -188,31 +555,8 @@ void Format::parseBlock( QTextCursor &cursor, const QDomElement &element )
   for( n = element.firstChild(); !n.isNull(); n = n.nextSibling() ) {
     QDomElement e = n.toElement();
     if ( e.tagName() == "fragment" ) {
-      QTextCharFormat format;
-      if ( e.hasAttribute( "link" ) ) {
-        format.setAnchor( true );
-        QString href = e.attribute( "link" );
-        format.setAnchorHref( href );
-        format.setFontUnderline( true );
-        if ( href.startsWith( "todoodle:" ) ) {
-          format = TextFormats::topicLinkCharFormat( href );
-        } else {
-          format = TextFormats::hyperLinkCharFormat( href );
-        }
-      }
-      if ( e.attribute( "bold" ) == "true" ) {
-        format.setFontWeight( QFont::Bold );
-      }
-      if ( e.attribute( "italic" ) == "true" ) {
-        format.setFontItalic( true );
-      }
-      int fontSize = 0;
-      if ( e.hasAttribute( "fontsize" ) ) {
-        fontSize = e.attribute( "fontsize" ).toInt();
-      } else {
-        fontSize = 10;
-      }
-      if ( fontSize > 0 ) format.setFontPointSize( fontSize );
+      QTextCharFormat format =
+        fragmentFormat( fragmentAttributes( toAttributes( e ) ) );
       
       QDomNode n2;
       for( n2 = e.firstChild(); !n2.isNull(); n2 = n2.nextSibling() ) {
@@ -226,13 +570,7 @@ void Format::parseBlock( QTextCursor &cursor, const QDomElement &element )
           QDomElement e2 = n2.toElement();
           if ( !e2.isNull() ) {
             if ( e2.tagName() == "todo" ) {
-              QTextImageFormat f;
-              if ( e2.attribute( "status" ) == "todo" ) {
-                f.setName( ":/images/todo.png" );
-              } else {
-                f.setName( ":/images/tododone.png" );
-              }
-              cursor.insertImage( f );
+              insertTodo( cursor, e2.attribute( "status" ) );
             }
           }
         }
@@ -241,138 +579,584 @@ void Format::parseBlock( QTextCursor &cursor, const QDomElement &element )
   }
 }
 
-QString Format::frameToString( QTextFrame *frame )
+bool Format::readDocument( QXmlStreamReader &xml )
 {
-  QString out;
+  if ( !readDocumentStart( xml ) ) return false;
 
-  QTextFrame::iterator it;
-  for( it = frame->begin(); it != frame->end(); ++it ) {
-    QTextBlock block = it.currentBlock();
-    if ( block.isValid() ) {
-      out += "<block";
+  QTextCursor cursor( mDocument );
+  cursor.movePosition( QTextCursor::Start );
 
-      QTextCursor c( block );
+  readFrame( cursor, xml );
 
-      QDateTime dt = TextFormats::lastModified( c );
-      if ( dt.isValid() ) {
-        out += " lastmodified=\"" + dt.toString( Qt::ISODate ) + "\"";
-      }
+  if ( xml.hasError() ) {
+    qWarning( "Error loading format: %s (line %d)",
+      qPrintable( xml.errorString() ), int( xml.lineNumber() ) );
+    return false;
+  }
+
+  return true;
+}
+
+bool Format::readDocumentStart( QXmlStreamReader &xml )
+{
+  while( !xml.atEnd() && !xml.isStartElement() ) {
+    xml.readNext();
+  }
+  if ( !xml.isStartElement() ) {
+    qWarning( "Error loading format: %s", qPrintable( xml.errorString() ) );
+    return false;
+  }
+
+  QStringRef versionAttribute = xml.attributes().value( "version" );
+  int version = 1;
+  if ( !versionAttribute.isEmpty() ) {
+    version = versionAttribute.toString().toInt();
+  }
+  if ( version != currentFormatVersion ) {
+      qWarning( "Error loading format: found version %d, expected %d.", version, currentFormatVersion );
+      return false;
+  }
+
+  mDocument->setPlainText( "" );
+
+  return true;
+}
+
+void Format::readFrame( QTextCursor &cursor, QXmlStreamReader &xml )
+{
+  QTextBlock extraBlock;
+  bool first = true;
+
+  while( readFrameItem( cursor, xml, first, extraBlock ) ) ;
+}
+
+bool Format::readFrameItem( QTextCursor &cursor, QXmlStreamReader &xml,
+  bool &first, QTextBlock &extraBlock )
+{
+  while( !xml.atEnd() ) {
+    xml.readNext();
+    if ( xml.isEndElement() ) return false;
+    if ( !xml.isStartElement() ) continue;
+
+    if ( xml.name() == QLatin1String( "block" ) ) {
+      BlockAttributes attributes = blockAttributes( xml.attributes() );
+      beginBlock( cursor, attributes, first, extraBlock );
+      readBlock( cursor, xml );
+      endBlock( cursor, attributes );
+    } else if ( xml.name() == QLatin1String( "frame" ) ) {
+      bool codeFrame =
+        xml.attributes().value( "type" ) == QLatin1String( "code" );
+      QTextFrame *parentFrame = cursor.currentFrame();
+
+      QTextFrame *frame = cursor.insertFrame( TextFormats::codeFrameFormat() );
+      readFrame( cursor, xml );
+      endFrame( cursor, codeFrame, parentFrame, frame, extraBlock );
+    } else {
+      skipElement( xml );
+    }
+
+    first = false;
+
+    return true;
+  }
+
+  return false;
+}
+
+void Format::readBlock( QTextCursor &cursor, QXmlStreamReader &xml )
+{
+  while( !xml.atEnd() ) {
+    xml.readNext();
+    if ( xml.isEndElement() ) break;
+    if ( !xml.isStartElement() ) continue;
+
+    if ( xml.name() == QLatin1String( "fragment" ) ) {
+      readFragment( cursor, xml,
+        fragmentFormat( fragmentAttributes( xml.attributes() ) ) );
+    } else {
+      skipElement( xml );
+    }
+  }
+}
+
+void Format::readFragment( QTextCursor &cursor, QXmlStreamReader &xml,
+  const QTextCharFormat &format )
+{
+  QString text;
+
+  while( !xml.atEnd() ) {
+    xml.readNext();
+    if ( xml.isCharacters() ) {
+      text += xml.text().toString();
+      continue;
+    }
 
-      if ( TextFormats::isTitle( c ) ) {
-        out += " titlestyle=\"title\"";
-      } else if ( TextFormats::isSubTitle( c ) ) {
-        out += " titlestyle=\"subtitle\"";
+    if ( xml.isStartElement() || xml.isEndElement() ) {
+      // QDomDocument drops text nodes only consisting of whitespace, do the
+      // same to get identical documents from both parsers.
+      if ( mKeepWhitespace ? !text.isEmpty() : !text.trimmed().isEmpty() ) {
+        cursor.insertText( text, format );
       }
+      text.clear();
+    }
 
-      QTextBlockFormat blockFormat = block.blockFormat();
-      if ( blockFormat.isValid() ) {
-        QTextList *list = block.textList();
-        if ( list ) {
-          QTextListFormat f = list->format();
-          out += " liststyle=\"";
-          switch( f.style() ) {
-            default:
-            case QTextListFormat::ListDisc:
-              out += "disc";
-              break;
-            case QTextListFormat::ListDecimal:
-              out += "decimal";
-              break;
-          }
-          out += "\"";
+    if ( xml.isEndElement() ) break;
 
-          out += " listindent=\"" + QString::number( f.indent() ) + "\"";
-        } else {
-          if ( blockFormat.indent() != 0 ) {
-            out += " blockindent=\"" + QString::number( blockFormat.indent() ) +
-              "\"";
-          }
-        }
+    if ( xml.isStartElement() ) {
+      if ( xml.name() == QLatin1String( "todo" ) ) {
+        insertTodo( cursor, xml.attributes().value( "status" ).toString() );
       }
+      skipElement( xml );
+    }
+  }
+}
 
-      out += ">\n";
-      
-      QTextBlock::iterator it2;
-      for( it2 = block.begin(); it2 != block.end(); ++it2 ) {
-        QTextFragment fragment = it2.fragment();
-        if ( !fragment.isValid() ) continue;
-
-        QString text = fragment.text();
-
-        QString outText;
-        for( int i = 0; i < text.size(); ++i ) {
-          if ( text.at( i ) == 0xfffc ) {
-            outText += "<todo status=\"";
-
-            QTextImageFormat imageFormat = fragment.charFormat().toImageFormat();
-            if ( imageFormat.isValid() ) {
-              if ( imageFormat.name().contains( "done" ) ) outText += "done";
-              else outText += "todo";
-            } else {
-              dbg() << "NO IMAGE FORMAT" << endl;
-            }
-            
-            outText += "\"/>";
-          } else {
-            outText += escape( QString( text.at( i ) ) );
-          }
-        }
+Format::BlockAttributes::BlockAttributes()
+  : titleStyle( NoTitle ), list( false ),
+    listStyle( QTextListFormat::ListDisc ), indent( 0 )
+{
+}
 
-        out += "  <fragment";
+Format::FragmentAttributes::FragmentAttributes()
+  : bold( false ), italic( false ), fontSize( 10 ), todoDone( false )
+{
+}
 
-        QTextCharFormat format = fragment.charFormat();
-        if ( !format.anchorHref().isEmpty() ) {
-          out += " link=\"" + escape( format.anchorHref() ) + "\"";
-        }
-        if ( format.fontWeight() == QFont::Bold ) {
-          out += " bold=\"true\"";
-        }
-        if ( format.fontItalic() ) {
-          out += " italic=\"true\"";
-        }
-        if ( format.hasProperty( QTextFormat::FontPointSize ) &&
-             format.fontPointSize() != 10 ) {
-          out += " fontsize=\"" + QString::number( format.fontPointSize() ) +
-            "\"";
-        }
+Format::BlockAttributes Format::blockAttributes(
+  const QXmlStreamAttributes &attributes )
+{
+  BlockAttributes a;
+
+  if ( attributes.hasAttribute( "lastmodified" ) ) {
+    QString str = attributes.value( "lastmodified" ).toString();
+    a.lastModified = QDateTime::fromString( str, Qt::ISODate );
+  }
+
+  QStringRef titleStyle = attributes.value( "titlestyle" );
+  if ( titleStyle == QLatin1String( "title" ) ) {
+    a.titleStyle = BlockAttributes::Title;
+  } else if ( titleStyle == QLatin1String( "subtitle" ) ) {
+    a.titleStyle = BlockAttributes::SubTitle;
+  }
+
+  if ( attributes.hasAttribute( "liststyle" ) ) {
+    a.list = true;
+    a.indent = attributes.value( "listindent" ).toString().toInt();
+    if ( attributes.value( "liststyle" ) == QLatin1String( "decimal" ) ) {
+      a.listStyle = QTextListFormat::ListDecimal;
+    }
+  } else {
+    a.indent = attributes.value( "blockindent" ).toString().toInt();
+  }
+
+  return a;
+}
+
+Format::BlockAttributes Format::blockAttributes( const QTextBlock &block )
+{
+  BlockAttributes a;
+
+  QTextCursor c( block );
 
-        if ( outText.trimmed().isEmpty() ) outText.replace( " ", "[FIXME:space]" );
+  a.lastModified = TextFormats::lastModified( c );
 
-        out += ">" + outText + "</fragment>\n";
+  if ( TextFormats::isTitle( c ) ) {
+    a.titleStyle = BlockAttributes::Title;
+  } else if ( TextFormats::isSubTitle( c ) ) {
+    a.titleStyle = BlockAttributes::SubTitle;
+  }
+
+  QTextBlockFormat blockFormat = block.blockFormat();
+  if ( blockFormat.isValid() ) {
+    QTextList *list = block.textList();
+    if ( list ) {
+      QTextListFormat f = list->format();
+      a.list = true;
+      if ( f.style() == QTextListFormat::ListDecimal ) {
+        a.listStyle = QTextListFormat::ListDecimal;
       }
-      
-      out += "</block>";
+      a.indent = f.indent();
+    } else {
+      a.indent = blockFormat.indent();
+    }
+  }
+
+  return a;
+}
+
+Format::FragmentAttributes Format::fragmentAttributes(
+  const QXmlStreamAttributes &attributes )
+{
+  FragmentAttributes a;
+
+  a.link = attributes.value( "link" ).toString();
+  a.bold = attributes.value( "bold" ) == QLatin1String( "true" );
+  a.italic = attributes.value( "italic" ) == QLatin1String( "true" );
+  if ( attributes.hasAttribute( "fontsize" ) ) {
+    a.fontSize = attributes.value( "fontsize" ).toString().toInt();
+  }
+
+  return a;
+}
+
+Format::FragmentAttributes Format::fragmentAttributes(
+  const QTextCharFormat &format )
+{
+  FragmentAttributes a;
+
+  a.link = format.anchorHref();
+  a.bold = format.fontWeight() == QFont::Bold;
+  a.italic = format.fontItalic();
+  if ( format.hasProperty( QTextFormat::FontPointSize ) ) {
+    a.fontSize = int( format.fontPointSize() );
+  }
+
+  QTextImageFormat imageFormat = format.toImageFormat();
+  if ( imageFormat.isValid() ) {
+    a.todoDone = imageFormat.name().contains( "done" );
+  }
+
+  return a;
+}
+
+void Format::beginBlock( QTextCursor &cursor,
+  const BlockAttributes &attributes, bool first, QTextBlock &extraBlock )
+{
+  if ( attributes.list ) {
+    cursor.setCharFormat( TextFormats::normalCharFormat() );
+    QTextListFormat f;
+    f.setIndent( attributes.indent );
+    f.setStyle( attributes.listStyle );
+    cursor.mergeBlockFormat( TextFormats::normalBlockFormat() );
+    cursor.insertList( f );
+  } else if ( !first ) {
+    QTextBlockFormat f;
+    f.setIndent( attributes.indent );
+    if ( extraBlock.isValid() ) {
+      QTextCursor c( extraBlock );
+      c.setBlockFormat( f );
+      extraBlock = QTextBlock();
+    } else {
+      cursor.insertBlock( f );
+    }
+  }
+  if ( attributes.lastModified.isValid() ) {
+    TextFormats::setLastModified( cursor, attributes.lastModified );
+  }
+}
+
+void Format::endBlock( QTextCursor &cursor,
+  const BlockAttributes &attributes )
+{
+  if ( attributes.titleStyle == BlockAttributes::Title ) {
+    cursor.mergeBlockFormat( TextFormats::titleBlockFormat() );
+  } else if ( attributes.titleStyle == BlockAttributes::SubTitle ) {
+    cursor.mergeBlockFormat( TextFormats::subTitleBlockFormat() );
+  } else {
+    cursor.mergeBlockFormat( TextFormats::normalBlockFormat() );
+  }
+}
+
+void Format::applyBlockFormat( QTextCursor &cursor,
+  const BlockAttributes &attributes )
+{
+  QTextList *list = cursor.currentList();
+  if ( attributes.list ) {
+    if ( !list || list->format().indent() != attributes.indent ||
+         list->format().style() != attributes.listStyle ) {
+      QTextListFormat f;
+      f.setIndent( attributes.indent );
+      f.setStyle( attributes.listStyle );
+      cursor.createList( f );
+    }
+  } else {
+    if ( list ) list->remove( cursor.block() );
+    QTextBlockFormat f;
+    f.setIndent( attributes.indent );
+    cursor.mergeBlockFormat( f );
+  }
+  if ( attributes.lastModified.isValid() ) {
+    TextFormats::setLastModified( cursor, attributes.lastModified );
+  }
+}
+
+void Format::endFrame( QTextCursor &cursor, bool codeFrame,
+  QTextFrame *parentFrame, QTextFrame *frame, QTextBlock &extraBlock )
+{
+  if ( codeFrame ) {
+    TextFormats::setCodeFrameFormats( frame );
+  }
+
+  cursor = parentFrame->lastCursorPosition();
+  extraBlock = cursor.block();
+}
+
+QTextCharFormat Format::fragmentFormat( const FragmentAttributes &attributes )
+{
+  QTextCharFormat format;
+  if ( !attributes.link.isEmpty() ) {
+    format.setAnchor( true );
+    format.setAnchorHref( attributes.link );
+    format.setFontUnderline( true );
+    if ( attributes.link.startsWith( "todoodle:" ) ) {
+      format = TextFormats::topicLinkCharFormat( attributes.link );
+    } else {
+      format = TextFormats::hyperLinkCharFormat( attributes.link );
+    }
+  }
+  if ( attributes.bold ) {
+    format.setFontWeight( QFont::Bold );
+  }
+  if ( attributes.italic ) {
+    format.setFontItalic( true );
+  }
+  if ( attributes.fontSize > 0 ) format.setFontPointSize( attributes.fontSize );
+
+  return format;
+}
+
+void Format::insertTodo( QTextCursor &cursor, const QString &status )
+{
+  QTextImageFormat f;
+  if ( status == "todo" ) {
+    f.setName( ":/images/todo.png" );
+  } else {
+    f.setName( ":/images/tododone.png" );
+  }
+  cursor.insertImage( f );
+}
+
+QString Format::rangeToString( int from, int to )
+{
+  mKeepWhitespace = true;
+
+  QString str;
+  QTextStream ts( &str, QIODevice::WriteOnly );
+
+  QTextBlock block = mDocument->findBlock( from );
+  while( block.isValid() && block.position() <= to ) {
+    writeBlock( ts, block, from, to );
+    block = block.next();
+  }
+  ts.flush();
+
+  mKeepWhitespace = false;
+
+  return str;
+}
+
+bool Format::replaceRange( int position, int charsRemoved,
+  const QString &blocks )
+{
+  QTextCursor cursor( mDocument );
+  cursor.movePosition( QTextCursor::End );
+  if ( position < 0 || charsRemoved < 0 ||
+       position + charsRemoved > cursor.position() ) {
+    return false;
+  }
+
+  cursor.setPosition( position );
+  cursor.setPosition( position + charsRemoved, QTextCursor::KeepAnchor );
+  cursor.removeSelectedText();
+
+  mKeepWhitespace = true;
+
+  QXmlStreamReader xml( "<range>" + blocks + "</range>" );
+  xml.readNext();
+  while( !xml.atEnd() && !xml.isStartElement() ) xml.readNext();
+
+  bool first = true;
+  while( !xml.atEnd() ) {
+    xml.readNext();
+    if ( xml.isEndElement() ) break;
+    if ( !xml.isStartElement() ) continue;
+
+    if ( xml.name() == QLatin1String( "block" ) ) {
+      BlockAttributes attributes = blockAttributes( xml.attributes() );
+      if ( !first ) cursor.insertBlock();
+      applyBlockFormat( cursor, attributes );
+      readBlock( cursor, xml );
+      endBlock( cursor, attributes );
+      first = false;
+    } else {
+      skipElement( xml );
+    }
+  }
+
+  mKeepWhitespace = false;
+
+  if ( xml.hasError() ) {
+    qWarning( "Error replacing range: %s", qPrintable( xml.errorString() ) );
+    return false;
+  }
+
+  return true;
+}
 
-      out += "\n";
+void Format::writeFrame( QTextStream &ts, QTextFrame *frame )
+{
+  QTextFrame::iterator it;
+  for( it = frame->begin(); it != frame->end(); ++it ) {
+    QTextBlock block = it.currentBlock();
+    if ( block.isValid() ) {
+      writeBlock( ts, block );
     }
     QTextFrame *f = it.currentFrame();
     if ( f ) {
-      QTextFrameFormat format = f->frameFormat();
-      out += "<frame";
-      if ( format.hasProperty( TextFormats::FrameType ) ) {
-        out += " type=";
-        if ( format.property( TextFormats::FrameType ) == TextFormats::CodeFrame ) {
-          out += "\"code\"";
-        } else {
-          out += "\"undefined\"";
-        }
+      writeFrameStart( ts, f );
+      writeFrame( ts, f );
+      ts << "</frame>\n";
+    }
+  }
+}
+
+void Format::writeFrameStart( QTextStream &ts, QTextFrame *frame )
+{
+  QTextFrameFormat format = frame->frameFormat();
+  ts << "<frame";
+  if ( format.hasProperty( TextFormats::FrameType ) ) {
+    ts << " type=";
+    if ( format.property( TextFormats::FrameType ) == TextFormats::CodeFrame ) {
+      ts << "\"code\"";
+    } else {
+      ts << "\"undefined\"";
+    }
+  }
+  ts << ">\n";
+}
+
+void Format::writeBlock( QTextStream &ts, const QTextBlock &block, int from,
+  int to )
+{
+  ts << "<block";
+
+  BlockAttributes attributes = blockAttributes( block );
+
+  if ( attributes.lastModified.isValid() ) {
+    ts << " lastmodified=\"" << attributes.lastModified.toString( Qt::ISODate )
+      << "\"";
+  }
+
+  if ( attributes.titleStyle == BlockAttributes::Title ) {
+    ts << " titlestyle=\"title\"";
+  } else if ( attributes.titleStyle == BlockAttributes::SubTitle ) {
+    ts << " titlestyle=\"subtitle\"";
+  }
+
+  if ( attributes.list ) {
+    ts << " liststyle=\"";
+    if ( attributes.listStyle == QTextListFormat::ListDecimal ) {
+      ts << "decimal";
+    } else {
+      ts << "disc";
+    }
+    ts << "\"";
+
+    ts << " listindent=\"" << QString::number( attributes.indent ) << "\"";
+  } else if ( attributes.indent != 0 ) {
+    ts << " blockindent=\"" << QString::number( attributes.indent ) << "\"";
+  }
+
+  ts << ">\n";
+
+  QTextBlock::iterator it;
+  for( it = block.begin(); it != block.end(); ++it ) {
+    QTextFragment fragment = it.fragment();
+    if ( !fragment.isValid() ) continue;
+    if ( fragment.position() + fragment.length() <= from ||
+         fragment.position() >= to ) continue;
+
+    writeFragment( ts, fragment, from, to );
+  }
+
+  ts << "</block>";
+
+  ts << "\n";
+}
+
+void Format::writeFragment( QTextStream &ts, const QTextFragment &fragment,
+  int from, int to )
+{
+  ts << "  <fragment";
+
+  QTextCharFormat format = fragment.charFormat();
+  FragmentAttributes attributes = fragmentAttributes( format );
+  if ( !attributes.link.isEmpty() ) {
+    ts << " link=\"" << escape( attributes.link ) << "\"";
+  }
+  if ( attributes.bold ) {
+    ts << " bold=\"true\"";
+  }
+  if ( attributes.italic ) {
+    ts << " italic=\"true\"";
+  }
+  if ( format.hasProperty( QTextFormat::FontPointSize ) &&
+       format.fontPointSize() != 10 ) {
+    ts << " fontsize=\"" << QString::number( format.fontPointSize() ) <<
+      "\"";
+  }
+
+  ts << ">";
+
+  QString text = fragment.text();
+  if ( from > fragment.position() ||
+       to < fragment.position() + fragment.length() ) {
+    int start = qMax( from - fragment.position(), 0 );
+    int end = qMin( to - fragment.position(), text.size() );
+    text = text.mid( start, end - start );
+  }
+
+  if ( !mKeepWhitespace && text.trimmed().isEmpty() ) {
+    ts << QString( text ).replace( " ", "[FIXME:space]" );
+  } else {
+    // Write text in runs between the object replacement characters
+    // representing the todo items.
+    int start = 0;
+    int pos;
+    while( ( pos = text.indexOf( QChar( 0xfffc ), start ) ) >= 0 ) {
+      if ( pos > start ) ts << escape( text.mid( start, pos - start ) );
+
+      ts << "<todo status=\"";
+      QTextImageFormat imageFormat = format.toImageFormat();
+      if ( imageFormat.isValid() ) {
+        if ( imageFormat.name().contains( "done" ) ) ts << "done";
+        else ts << "todo";
+      } else {
+        dbg() << "NO IMAGE FORMAT" << endl;
       }
-      out += ">\n";
-      out += frameToString( f );
-      out += "</frame>\n";
+      ts << "\"/>";
+
+      start = pos + 1;
     }
+    if ( start == 0 ) ts << escape( text );
+    else if ( start < text.size() ) ts << escape( text.mid( start ) );
   }
 
-  return out;
+  ts << "</fragment>\n";
 }
 
 QString Format::escape( const QString &str )
 {
-  QString ret = str;
-  
-  ret.replace( "&", "&amp;" );
-  ret.replace( "<", "&lt;" );
-  ret.replace( ">", "&gt;" );
+  const int size = str.size();
+  const QChar *data = str.unicode();
+
+  int i = 0;
+  while( i < size && data[ i ] != '&' && data[ i ] != '<' &&
+         data[ i ] != '>' ) {
+    ++i;
+  }
+  if ( i == size ) return str;
+
+  QString ret = str.left( i );
+  ret.reserve( size + 16 );
+
+  for( ; i < size; ++i ) {
+    const QChar c = data[ i ];
+    if ( c == '&' ) ret += "&amp;";
+    else if ( c == '<' ) ret += "&lt;";
+    else if ( c == '>' ) ret += "&gt;";
+    else ret += c;
+  }
 
   return ret;
 }
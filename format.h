@@ -21,11 +21,24 @@
 #define FORMAT_H
 
 #include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
 #include <QtXml/QDomElement>
 #include <QTextCursor>
+#include <QTextBlock>
+#include <QTextListFormat>
+#include <QDateTime>
+
+#include <limits.h>
 
 class QTextDocument;
 class QTextFrame;
+class QIODevice;
+class QTextStream;
+class QTextFragment;
+class QXmlStreamReader;
+class QXmlStreamAttributes;
 
 /**
   This class provides a storage format for topic data. The format is an XML
@@ -34,12 +47,71 @@ class QTextFrame;
 class Format
 {
   public:
+    /**
+      This enum represents the parsers which can be used to read topic data.
+
+      \param DomParser Build a DOM tree of the complete data before putting it
+        into the QTextDocument.
+      \param StreamParser Put the data into the QTextDocument while reading it.
+        This doesn't need to hold the complete data in memory.
+    */
+    enum Parser { DomParser, StreamParser };
+
+    /**
+      This struct represents a todo item of a topic.
+    */
+    struct Todo
+    {
+      /** Text of the block holding the todo marker */
+      QString text;
+      bool done;
+      /** Position of the block holding the todo marker */
+      int position;
+    };
+
+    /**
+      This struct holds the data shown about a topic in lists.
+    */
+    struct Summary
+    {
+      /** Text of the first block */
+      QString title;
+      /** Sorted names of linked topics */
+      QStringList links;
+      int todoCount;
+      int doneCount;
+    };
+
     /**
       Create a Format object opration on the given QTextDocument.
       
       \param d QTextDocument to load or save.
     */
     Format( QTextDocument *d );
+    virtual ~Format();
+
+    /**
+      Return QTextDocument this Format object operates on.
+    */
+    QTextDocument *document() const { return mDocument; }
+
+    /**
+      Set parser used by newly created Format objects.
+    */
+    static void setDefaultParser( Parser );
+    /**
+      Return parser used by newly created Format objects.
+    */
+    static Parser defaultParser();
+
+    /**
+      Set parser used by this Format object.
+    */
+    void setParser( Parser parser ) { mParser = parser; }
+    /**
+      Return parser used by this Format object.
+    */
+    Parser parser() const { return mParser; }
 
     /**
       Load data from given file and put it into the QTextDocument this Format
@@ -49,14 +121,61 @@ class Format
       \return \c true on success, \c false on failure
     */
     bool load( const QString &filename );
+
+    /**
+      Begin loading data from given file into the QTextDocument this Format
+      object operates on. The data is put into the document item by item by
+      calling loadNext(). Only the stream parser supports incremental loading.
+      
+      \param filename name of file
+      \return \c true, if loading was started, \c false on error
+    */
+    virtual bool beginLoad( const QString &filename );
+    /**
+      Load the next items of the top level frame. Items are blocks or complete
+      frames. They are inserted at the end of the data loaded so far, so the
+      document can be edited while loading.
+      
+      \param count maximum number of items to load
+      \return \c true, if there is more data to load, \c false, if loading
+        is finished
+    */
+    virtual bool loadNext( int count );
+    /**
+      Return progress of incremental loading in percent.
+    */
+    virtual int loadProgress() const;
+    /**
+      Return, if incremental loading stopped because of an error.
+    */
+    virtual bool loadFailed() const;
     /**
       Save data to given file from the QTextDocument this Format
-      object operates on.
+      object operates on. The data is written to a temporary file which
+      replaces the given file after it was completely written.
       
       \param filename name of file
       \return \c true on success, \c false on failure
     */
     bool save( const QString &filename );
+    /**
+      Save data to given device from the QTextDocument this Format object
+      operates on. The data is written while the document is traversed, so
+      the complete representation is never held in memory.
+
+      \param device device opened for writing
+      \return \c true on success, \c false on failure
+    */
+    bool save( QIODevice *device );
+    /**
+      Return representation of the data of the QTextDocument this Format
+      object operates on split into segments. Each block is one segment.
+      Serialized blocks are cached in the document and reused until the block
+      changes.
+
+      \return XML representation as list of UTF-8 encoded segments
+    */
+    QList<QByteArray> toSegments();
 
     /**
       Return string representation of the data of the QTextDocument this Format
@@ -74,16 +193,148 @@ class Format
     */
     bool fromString( const QString &xml );
 
+    /**
+      Return representation of the blocks covering the given range of the
+      QTextDocument this Format object operates on. Fragments are cut to the
+      range and whitespace is preserved. Frames are not included.
+      
+      \param from first position of range
+      \param to position after the last character of range
+      \return XML representation of blocks as string
+    */
+    QString rangeToString( int from, int to );
+    /**
+      Replace given range of the QTextDocument this Format object operates on
+      by the blocks given as string as returned by rangeToString().
+      
+      \param position first position of range to be replaced
+      \param charsRemoved length of range to be replaced
+      \param blocks XML representation of blocks
+      \return \c true on success, \c false on failure
+    */
+    bool replaceRange( int position, int charsRemoved, const QString &blocks );
+
+    /**
+      Return names of all topics linked from the data of the QTextDocument
+      this Format object operates on.
+      
+      \return sorted list of topic names
+    */
+    QStringList topicLinks() const;
+    /**
+      Return all todo items of the data of the QTextDocument this Format
+      object operates on.
+      
+      \return todo items in order of their position
+    */
+    QList<Todo> todos() const;
+    /**
+      Read todo items from given file without building a QTextDocument. The
+      file is scanned with a stream parser, only the text of blocks holding
+      todo items is kept. Positions are computed from the length of the text
+      and may be off by a few characters for topics containing frames.
+      
+      \param filename name of file
+      \param todos list the todo items are appended to
+      \return \c true on success, \c false on failure
+    */
+    static bool readTodos( const QString &filename, QList<Todo> &todos );
+
+    /**
+      Return summary of the data of the QTextDocument this Format object
+      operates on.
+    */
+    Summary summary() const;
+    /**
+      Read summary of topic data from given device without building a
+      QTextDocument.
+      
+      \param device device the data is read from
+      \param summary summary filled with the data
+      \return \c true on success, \c false on failure
+    */
+    static bool readSummary( QIODevice *device, Summary &summary );
+
   protected:
-    QString frameToString( QTextFrame * );
+    /**
+      Attributes of a block as represented in the storage formats.
+    */
+    struct BlockAttributes
+    {
+      BlockAttributes();
+
+      enum TitleStyle { NoTitle, Title, SubTitle };
+
+      QDateTime lastModified;
+      TitleStyle titleStyle;
+      bool list;
+      QTextListFormat::Style listStyle;
+      /** Indentation of list, if the block is a list item, of block otherwise */
+      int indent;
+    };
+
+    /**
+      Attributes of a fragment as represented in the storage formats.
+    */
+    struct FragmentAttributes
+    {
+      FragmentAttributes();
+
+      QString link;
+      bool bold;
+      bool italic;
+      int fontSize;
+      /** Status of todo items contained in the fragment */
+      bool todoDone;
+    };
+
+    static BlockAttributes blockAttributes( const QXmlStreamAttributes & );
+    static BlockAttributes blockAttributes( const QTextBlock & );
+    static FragmentAttributes fragmentAttributes(
+      const QXmlStreamAttributes & );
+    static FragmentAttributes fragmentAttributes( const QTextCharFormat & );
+
+    void writeDocument( QTextStream & );
+    void writeFrame( QTextStream &, QTextFrame * );
+    void writeFrameStart( QTextStream &, QTextFrame * );
+    void writeSegments( QList<QByteArray> &, QTextFrame * );
+    void writeBlock( QTextStream &, const QTextBlock &, int from = 0,
+      int to = INT_MAX );
+    void writeFragment( QTextStream &, const QTextFragment &, int from = 0,
+      int to = INT_MAX );
 
     void parseFrame( QTextCursor &cursor, const QDomElement &element );
     void parseBlock( QTextCursor &, const QDomElement & );
 
+    bool readDocument( QXmlStreamReader & );
+    bool readDocumentStart( QXmlStreamReader & );
+    void readFrame( QTextCursor &, QXmlStreamReader & );
+    bool readFrameItem( QTextCursor &, QXmlStreamReader &, bool &first,
+      QTextBlock &extraBlock );
+    void readBlock( QTextCursor &, QXmlStreamReader & );
+    void readFragment( QTextCursor &, QXmlStreamReader &,
+      const QTextCharFormat & );
+
+    void beginBlock( QTextCursor &, const BlockAttributes &, bool first,
+      QTextBlock &extraBlock );
+    void endBlock( QTextCursor &, const BlockAttributes & );
+    void applyBlockFormat( QTextCursor &, const BlockAttributes & );
+    void endFrame( QTextCursor &, bool codeFrame, QTextFrame *parentFrame,
+      QTextFrame *frame, QTextBlock &extraBlock );
+    QTextCharFormat fragmentFormat( const FragmentAttributes & );
+    void insertTodo( QTextCursor &, const QString &status );
+
     QString escape( const QString & );
 
   private:
     QTextDocument *mDocument;
+    Parser mParser;
+    bool mKeepWhitespace;
+
+    struct LoadState;
+    LoadState *mLoadState;
+
+    static Parser mDefaultParser;
 };
 
 #endif
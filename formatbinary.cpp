@@ -0,0 +1,487 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "formatbinary.h"
+
+#include "dbg.h"
+#include "textformats.h"
+#include "savequeue.h"
+
+#include <QFile>
+#include <QTextDocument>
+#include <QTextFrame>
+#include <QTextCursor>
+
+static const char binaryMagic[] = "TDDL";
+static const int binaryFormatVersion = 3;
+
+enum BlockFlags {
+  BlockTitle = 0x01,
+  BlockSubTitle = 0x02,
+  BlockList = 0x04,
+  BlockListDecimal = 0x08,
+  BlockLastModified = 0x10
+};
+
+enum FragmentFlags {
+  FragmentLink = 0x01,
+  FragmentBold = 0x02,
+  FragmentItalic = 0x04,
+  FragmentFontSize = 0x08,
+  FragmentTodoDone = 0x10
+};
+
+static void writeVarint( QByteArray &data, quint64 value )
+{
+  while( value >= 0x80 ) {
+    data.append( char( ( value & 0x7f ) | 0x80 ) );
+    value >>= 7;
+  }
+  data.append( char( value ) );
+}
+
+static void writeString( QByteArray &data, const QByteArray &str )
+{
+  writeVarint( data, str.size() );
+  data.append( str );
+}
+
+/**
+  Sequential reader for binary data. Reading beyond the end of the data sets
+  the error flag and returns null values.
+*/
+class BinaryReader
+{
+  public:
+    BinaryReader( const QByteArray &data )
+      : mData( data.constData() ), mSize( data.size() ), mPos( 0 ),
+        mError( false ) {}
+
+    bool atEnd() const { return mPos >= mSize; }
+    bool error() const { return mError; }
+    int pos() const { return mPos; }
+
+    quint8 byte()
+    {
+      if ( atEnd() ) {
+        mError = true;
+        return 0;
+      }
+      return quint8( mData[ mPos++ ] );
+    }
+
+    quint64 varint()
+    {
+      quint64 value = 0;
+      for( int shift = 0; shift < 64; shift += 7 ) {
+        quint8 b = byte();
+        value |= quint64( b & 0x7f ) << shift;
+        if ( !( b & 0x80 ) ) return value;
+      }
+      mError = true;
+      return 0;
+    }
+
+    void setError() { mError = true; }
+
+    QByteArray bytes( quint64 size )
+    {
+      if ( size > quint64( mSize - mPos ) ) {
+        mError = true;
+        mPos = mSize;
+        return QByteArray();
+      }
+      QByteArray result( mData + mPos, int( size ) );
+      mPos += int( size );
+      return result;
+    }
+
+  private:
+    const char *mData;
+    int mSize;
+    int mPos;
+    bool mError;
+};
+
+/**
+  State of incremental loading.
+*/
+struct FormatBinary::LoadState
+{
+  LoadState( const QByteArray &data ) : body( data ), reader( body ) {}
+
+  QByteArray body;
+  BinaryReader reader;
+  QTextCursor cursor;
+  QTextBlock extraBlock;
+  bool first;
+};
+
+FormatBinary::FormatBinary( QTextDocument *document )
+  : Format( document ), mLoadState( 0 )
+{
+}
+
+FormatBinary::~FormatBinary()
+{
+  delete mLoadState;
+}
+
+bool FormatBinary::isBinary( const QString &filename )
+{
+  QFile file( filename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return false;
+
+  return file.read( 4 ) == QByteArray( binaryMagic );
+}
+
+bool FormatBinary::load( const QString &filename )
+{
+  QFile file( filename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return false;
+
+  return fromData( file.readAll() );
+}
+
+bool FormatBinary::save( const QString &filename )
+{
+  QFile file( SaveQueue::temporaryFilename( filename ) );
+  if ( !file.open( QIODevice::WriteOnly ) ) return false;
+
+  QByteArray data = toData();
+  if ( file.write( data ) != data.size() ) {
+    file.close();
+    file.remove();
+    return false;
+  }
+
+  return SaveQueue::replaceFile( file, filename );
+}
+
+bool FormatBinary::beginLoad( const QString &filename )
+{
+  QFile file( filename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return false;
+
+  QByteArray body;
+  if ( !readHeader( file.readAll(), body ) ) return false;
+
+  delete mLoadState;
+  mLoadState = new LoadState( body );
+  mLoadState->first = true;
+
+  document()->setPlainText( "" );
+
+  mLoadState->cursor = QTextCursor( document() );
+  mLoadState->cursor.movePosition( QTextCursor::Start );
+
+  return true;
+}
+
+bool FormatBinary::loadNext( int count )
+{
+  if ( !mLoadState || mLoadState->reader.error() ) return false;
+
+  for( int i = 0; i < count; ++i ) {
+    if ( !readFrameItem( mLoadState->cursor, mLoadState->reader,
+                         mLoadState->first, mLoadState->extraBlock ) ) {
+      if ( mLoadState->reader.error() ) {
+        qWarning( "Error loading binary format: invalid data at offset %d.",
+          mLoadState->reader.pos() );
+      }
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int FormatBinary::loadProgress() const
+{
+  if ( !mLoadState || mLoadState->body.isEmpty() ) return 100;
+
+  return int( qint64( mLoadState->reader.pos() ) * 100 /
+    mLoadState->body.size() );
+}
+
+bool FormatBinary::loadFailed() const
+{
+  return !mLoadState || mLoadState->reader.error();
+}
+
+QList<QByteArray> FormatBinary::toSegments()
+{
+  QList<QByteArray> segments;
+  segments.append( toData() );
+  return segments;
+}
+
+QByteArray FormatBinary::toData()
+{
+  mStrings.clear();
+  mStringIndex.clear();
+
+  QByteArray body;
+  writeFrame( body, document()->rootFrame() );
+
+  QByteArray data( binaryMagic );
+  writeVarint( data, binaryFormatVersion );
+
+  writeVarint( data, mStrings.count() );
+  foreach( QString str, mStrings ) writeString( data, str.toUtf8() );
+
+  writeString( data, body );
+
+  return data;
+}
+
+void FormatBinary::writeFrame( QByteArray &body, QTextFrame *frame )
+{
+  QTextFrame::iterator it;
+  for( it = frame->begin(); it != frame->end(); ++it ) {
+    QTextBlock block = it.currentBlock();
+    if ( block.isValid() ) {
+      writeBlock( body, block );
+    }
+    QTextFrame *f = it.currentFrame();
+    if ( f ) {
+      body.append( char( FrameBeginTag ) );
+      QTextFrameFormat format = f->frameFormat();
+      bool codeFrame = format.hasProperty( TextFormats::FrameType ) &&
+        format.property( TextFormats::FrameType ) == TextFormats::CodeFrame;
+      writeVarint( body, codeFrame ? 1 : 0 );
+
+      writeFrame( body, f );
+
+      body.append( char( FrameEndTag ) );
+    }
+  }
+}
+
+void FormatBinary::writeBlock( QByteArray &body, const QTextBlock &block )
+{
+  body.append( char( BlockTag ) );
+
+  BlockAttributes attributes = blockAttributes( block );
+
+  int flags = 0;
+  if ( attributes.titleStyle == BlockAttributes::Title ) flags |= BlockTitle;
+  else if ( attributes.titleStyle == BlockAttributes::SubTitle ) {
+    flags |= BlockSubTitle;
+  }
+  if ( attributes.list ) {
+    flags |= BlockList;
+    if ( attributes.listStyle == QTextListFormat::ListDecimal ) {
+      flags |= BlockListDecimal;
+    }
+  }
+  if ( attributes.lastModified.isValid() ) flags |= BlockLastModified;
+
+  writeVarint( body, flags );
+  if ( flags & BlockLastModified ) {
+    writeVarint( body, attributes.lastModified.toTime_t() );
+  }
+  writeVarint( body, qMax( attributes.indent, 0 ) );
+
+  QList<QTextFragment> fragments;
+  QTextBlock::iterator it;
+  for( it = block.begin(); it != block.end(); ++it ) {
+    QTextFragment fragment = it.fragment();
+    if ( fragment.isValid() ) fragments.append( fragment );
+  }
+
+  writeVarint( body, fragments.count() );
+  foreach( QTextFragment fragment, fragments ) {
+    FragmentAttributes a = fragmentAttributes( fragment.charFormat() );
+
+    int flags = 0;
+    if ( !a.link.isEmpty() ) flags |= FragmentLink;
+    if ( a.bold ) flags |= FragmentBold;
+    if ( a.italic ) flags |= FragmentItalic;
+    if ( a.fontSize != 10 && a.fontSize > 0 ) flags |= FragmentFontSize;
+    if ( a.todoDone ) flags |= FragmentTodoDone;
+
+    writeVarint( body, flags );
+    if ( flags & FragmentLink ) writeVarint( body, stringIndex( a.link ) );
+    if ( flags & FragmentFontSize ) writeVarint( body, a.fontSize );
+    writeString( body, fragment.text().toUtf8() );
+  }
+}
+
+int FormatBinary::stringIndex( const QString &str )
+{
+  QHash<QString, int>::ConstIterator it = mStringIndex.find( str );
+  if ( it != mStringIndex.end() ) return it.value();
+
+  int index = mStrings.count();
+  mStrings.append( str );
+  mStringIndex.insert( str, index );
+  return index;
+}
+
+bool FormatBinary::fromData( const QByteArray &data )
+{
+  QByteArray body;
+  if ( !readHeader( data, body ) ) return false;
+
+  document()->setPlainText( "" );
+
+  QTextCursor cursor( document() );
+  cursor.movePosition( QTextCursor::Start );
+
+  BinaryReader bodyReader( body );
+  if ( !readFrame( cursor, bodyReader ) ) {
+    qWarning( "Error loading binary format: invalid data at offset %d.",
+      bodyReader.pos() );
+    return false;
+  }
+
+  return true;
+}
+
+bool FormatBinary::readHeader( const QByteArray &data, QByteArray &body )
+{
+  BinaryReader reader( data );
+
+  if ( reader.bytes( 4 ) != QByteArray( binaryMagic ) ) {
+    qWarning( "Error loading binary format: invalid header." );
+    return false;
+  }
+  int version = int( reader.varint() );
+  if ( version != binaryFormatVersion ) {
+    qWarning( "Error loading binary format: found version %d, expected %d.",
+      version, binaryFormatVersion );
+    return false;
+  }
+
+  mStrings.clear();
+  quint64 stringCount = reader.varint();
+  for( quint64 i = 0; i < stringCount && !reader.error(); ++i ) {
+    mStrings.append( QString::fromUtf8( reader.bytes( reader.varint() ) ) );
+  }
+
+  body = reader.bytes( reader.varint() );
+  if ( reader.error() ) {
+    qWarning( "Error loading binary format: truncated header." );
+    return false;
+  }
+
+  return true;
+}
+
+bool FormatBinary::readFrame( QTextCursor &cursor, BinaryReader &reader )
+{
+  QTextBlock extraBlock;
+  bool first = true;
+
+  while( readFrameItem( cursor, reader, first, extraBlock ) ) ;
+
+  return !reader.error();
+}
+
+bool FormatBinary::readFrameItem( QTextCursor &cursor, BinaryReader &reader,
+  bool &first, QTextBlock &extraBlock )
+{
+  if ( reader.atEnd() || reader.error() ) return false;
+
+  quint8 tag = reader.byte();
+  if ( tag == FrameEndTag ) {
+    return false;
+  } else if ( tag == BlockTag ) {
+    if ( !readBlock( cursor, reader, first, extraBlock ) ) {
+      reader.setError();
+      return false;
+    }
+  } else if ( tag == FrameBeginTag ) {
+    bool codeFrame = reader.varint() & 1;
+    QTextFrame *parentFrame = cursor.currentFrame();
+
+    QTextFrame *frame = cursor.insertFrame( TextFormats::codeFrameFormat() );
+    if ( !readFrame( cursor, reader ) ) return false;
+    endFrame( cursor, codeFrame, parentFrame, frame, extraBlock );
+  } else {
+    reader.setError();
+    return false;
+  }
+
+  first = false;
+
+  return true;
+}
+
+bool FormatBinary::readBlock( QTextCursor &cursor, BinaryReader &reader,
+  bool first, QTextBlock &extraBlock )
+{
+  BlockAttributes attributes;
+
+  int flags = int( reader.varint() );
+  if ( flags & BlockTitle ) attributes.titleStyle = BlockAttributes::Title;
+  else if ( flags & BlockSubTitle ) {
+    attributes.titleStyle = BlockAttributes::SubTitle;
+  }
+  if ( flags & BlockList ) {
+    attributes.list = true;
+    if ( flags & BlockListDecimal ) {
+      attributes.listStyle = QTextListFormat::ListDecimal;
+    }
+  }
+  if ( flags & BlockLastModified ) {
+    attributes.lastModified.setTime_t( uint( reader.varint() ) );
+  }
+  attributes.indent = int( reader.varint() );
+
+  beginBlock( cursor, attributes, first, extraBlock );
+
+  quint64 fragmentCount = reader.varint();
+  for( quint64 i = 0; i < fragmentCount && !reader.error(); ++i ) {
+    FragmentAttributes a;
+
+    int flags = int( reader.varint() );
+    if ( flags & FragmentLink ) {
+      int index = int( reader.varint() );
+      if ( index < 0 || index >= mStrings.count() ) return false;
+      a.link = mStrings.at( index );
+    }
+    a.bold = flags & FragmentBold;
+    a.italic = flags & FragmentItalic;
+    if ( flags & FragmentFontSize ) a.fontSize = int( reader.varint() );
+
+    QString text = QString::fromUtf8( reader.bytes( reader.varint() ) );
+
+    QTextCharFormat format = fragmentFormat( a );
+
+    // Todo items are stored as object replacement characters
+    int start = 0;
+    int pos;
+    while( ( pos = text.indexOf( QChar( 0xfffc ), start ) ) >= 0 ) {
+      if ( pos > start ) cursor.insertText( text.mid( start, pos - start ),
+        format );
+      insertTodo( cursor, ( flags & FragmentTodoDone ) ? "done" : "todo" );
+      start = pos + 1;
+    }
+    if ( start == 0 ) cursor.insertText( text, format );
+    else if ( start < text.size() ) cursor.insertText( text.mid( start ),
+      format );
+  }
+
+  endBlock( cursor, attributes );
+
+  return !reader.error();
+}
@@ -0,0 +1,127 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef FORMATBINARY_H
+#define FORMATBINARY_H
+
+#include "format.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+
+class BinaryReader;
+
+/**
+  This class provides a compact binary storage format for topic data (format
+  version 3). It represents the same model of frames, blocks, fragments and
+  todo items as the XML format provided by Format.
+
+  A file starts with the magic bytes "TDDL" and the format version. It is
+  followed by a table of all link targets, which are referenced by index from
+  the fragments, and by the blocks and frames in document order. Numbers are
+  stored as variable length integers.
+*/
+class FormatBinary : public Format
+{
+  public:
+    /**
+      Create a FormatBinary object operating on the given QTextDocument.
+      
+      \param d QTextDocument to load or save.
+    */
+    FormatBinary( QTextDocument *d );
+    ~FormatBinary();
+
+    /**
+      Return, if the given file is stored in the binary format.
+      
+      \param filename name of file
+      \return \c true, if the file starts with the binary header
+    */
+    static bool isBinary( const QString &filename );
+
+    /**
+      Load data from given file and put it into the QTextDocument this
+      FormatBinary object operates on.
+      
+      \param filename name of file
+      \return \c true on success, \c false on failure
+    */
+    bool load( const QString &filename );
+    /**
+      Save data to given file from the QTextDocument this FormatBinary object
+      operates on. The file is replaced atomically.
+      
+      \param filename name of file
+      \return \c true on success, \c false on failure
+    */
+    bool save( const QString &filename );
+
+    bool beginLoad( const QString &filename );
+    bool loadNext( int count );
+    int loadProgress() const;
+    bool loadFailed() const;
+
+    /**
+      Return binary representation of the data of the QTextDocument this
+      FormatBinary object operates on as single segment, so it can be handed
+      over to the SaveQueue.
+    */
+    QList<QByteArray> toSegments();
+
+    /**
+      Return binary representation of the data of the QTextDocument this
+      FormatBinary object operates on.
+    */
+    QByteArray toData();
+    /**
+      Load binary data into the QTextDocument this FormatBinary object
+      operates on.
+      
+      \param data binary representation
+      \return \c true on success, \c false on failure
+    */
+    bool fromData( const QByteArray &data );
+
+  protected:
+    enum Tag { BlockTag = 1, FrameBeginTag = 2, FrameEndTag = 3 };
+
+    void writeFrame( QByteArray &body, QTextFrame * );
+    void writeBlock( QByteArray &body, const QTextBlock & );
+    int stringIndex( const QString & );
+
+    bool readHeader( const QByteArray &data, QByteArray &body );
+    bool readFrame( QTextCursor &, BinaryReader & );
+    bool readFrameItem( QTextCursor &, BinaryReader &, bool &first,
+      QTextBlock &extraBlock );
+    bool readBlock( QTextCursor &, BinaryReader &, bool first,
+      QTextBlock &extraBlock );
+
+  private:
+    QStringList mStrings;
+    QHash<QString, int> mStringIndex;
+
+    struct LoadState;
+    LoadState *mLoadState;
+};
+
+#endif
@@ -0,0 +1,265 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "handlerscheduler.h"
+
+#include "wordhandler.h"
+
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QTimer>
+#include <QTime>
+
+// Time in milliseconds without typing after which the handlers are run
+static const int idleDelay = 500;
+// Maximum time in milliseconds spent running handlers before returning to the
+// event loop
+static const int sliceDuration = 10;
+
+HandlerScheduler::HandlerScheduler( QTextEdit *editor )
+  : QObject( editor ), mEditor( editor ), mIdle( false )
+{
+  mTimer = new QTimer( this );
+  mTimer->setSingleShot( true );
+  connect( mTimer, SIGNAL( timeout() ), SLOT( processSlice() ) );
+
+  connect( mEditor->document(), SIGNAL( contentsChange( int, int, int ) ),
+    SLOT( slotContentsChange( int, int, int ) ) );
+}
+
+HandlerScheduler::~HandlerScheduler()
+{
+  for( int i = 0; i < mWordHandlers.count(); ++i ) {
+    delete mWordHandlers.at( i ).handler;
+  }
+  for( int i = 0; i < mSequenceHandlers.count(); ++i ) {
+    delete mSequenceHandlers.at( i ).handler;
+  }
+}
+
+void HandlerScheduler::addHandler( WordHandler *handler, int priority )
+{
+  Entry<WordHandler> entry;
+  entry.handler = handler;
+  entry.priority = priority;
+
+  int i = 0;
+  while( i < mWordHandlers.count() &&
+         mWordHandlers.at( i ).priority >= priority ) ++i;
+  mWordHandlers.insert( i, entry );
+}
+
+void HandlerScheduler::addHandler( SequenceHandler *handler, int priority )
+{
+  Entry<SequenceHandler> entry;
+  entry.handler = handler;
+  entry.priority = priority;
+
+  int i = 0;
+  while( i < mSequenceHandlers.count() &&
+         mSequenceHandlers.at( i ).priority >= priority ) ++i;
+  mSequenceHandlers.insert( i, entry );
+}
+
+void HandlerScheduler::schedule( int from, int to, bool boundary )
+{
+  Range range;
+  range.from = from;
+  range.to = to;
+
+  // Keep ranges sorted and disjoint
+  int i = 0;
+  while( i < mRanges.count() && mRanges.at( i ).to < range.from ) ++i;
+  while( i < mRanges.count() && mRanges.at( i ).from <= range.to ) {
+    range.from = qMin( range.from, mRanges.at( i ).from );
+    range.to = qMax( range.to, mRanges.at( i ).to );
+    mRanges.removeAt( i );
+  }
+  mRanges.insert( i, range );
+
+  if ( boundary ) {
+    mIdle = false;
+    mTimer->start( 0 );
+  } else {
+    mIdle = true;
+    mTimer->start( idleDelay );
+  }
+}
+
+void HandlerScheduler::cancel()
+{
+  mTimer->stop();
+  mRanges.clear();
+}
+
+void HandlerScheduler::flush()
+{
+  mTimer->stop();
+  mIdle = true;
+  while( !mRanges.isEmpty() ) processSlice();
+}
+
+void HandlerScheduler::slotContentsChange( int position, int charsRemoved,
+  int charsAdded )
+{
+  int delta = charsAdded - charsRemoved;
+
+  QList<Range>::iterator it;
+  for( it = mRanges.begin(); it != mRanges.end(); ++it ) {
+    if ( it->to < position ) continue;
+    if ( it->from >= position + charsRemoved ) {
+      it->from += delta;
+      it->to += delta;
+    } else {
+      it->from = qMin( it->from, position );
+      it->to = qMax( position + charsAdded, it->to + delta );
+    }
+  }
+}
+
+void HandlerScheduler::processSlice()
+{
+  mTimer->stop();
+
+  QTime time;
+  time.start();
+
+  QTextCharFormat currentFormat = mEditor->currentCharFormat();
+
+  // hide the magic highlighting from the user visible undo by
+  // putting it into existing undo blocks
+  QTextCursor editCursor( mEditor->document() );
+  editCursor.joinPreviousEditBlock();
+
+  // Process from the end of the document, so changes of the text don't
+  // affect the ranges still to be processed
+  bool skipped = false;
+  while( !mRanges.isEmpty() && time.elapsed() < sliceDuration ) {
+    if ( process( mRanges.takeLast(), mIdle ) ) skipped = true;
+  }
+
+  editCursor.endEditBlock();
+
+  mEditor->setCurrentCharFormat( currentFormat );
+
+  mLatency.record( time.elapsed() );
+
+  if ( !mRanges.isEmpty() ) {
+    mTimer->start( 0 );
+  } else if ( skipped ) {
+    // Process the word the user is still typing when typing pauses
+    int pos = mEditor->textCursor().position();
+    schedule( pos, pos, false );
+  }
+}
+
+bool HandlerScheduler::process( const Range &range, bool all )
+{
+  bool skipped = false;
+
+  QTextDocument *document = mEditor->document();
+  QTextCursor textCursor = mEditor->textCursor();
+
+  QTextBlock first = document->findBlock( range.from );
+  if ( !first.isValid() ) return false;
+  QTextBlock block = document->findBlock( range.to );
+  if ( !block.isValid() ) block = document->lastBlock();
+
+  while( block.isValid() ) {
+    QString text = block.text();
+    int blockPos = block.position();
+
+    int from = qMax( range.from - blockPos, 0 );
+    int to = qMin( range.to - blockPos, text.length() );
+
+    // Extend range to whole sequences
+    while( from > 0 && !text.at( from - 1 ).isSpace() ) --from;
+    while( to < text.length() && !text.at( to ).isSpace() ) ++to;
+
+    int cursorPos = -1;
+    if ( !all && textCursor.block() == block ) {
+      cursorPos = textCursor.position() - blockPos;
+    }
+
+    int end = to;
+    while( end > from ) {
+      while( end > from && text.at( end - 1 ).isSpace() ) --end;
+      int start = end;
+      while( start > from && !text.at( start - 1 ).isSpace() ) --start;
+      if ( start == end ) break;
+
+      if ( start <= cursorPos && cursorPos <= end ) {
+        skipped = true;
+      } else {
+        int wordEnd = end;
+        while( wordEnd > start ) {
+          while( wordEnd > start &&
+                 !text.at( wordEnd - 1 ).isLetterOrNumber() ) --wordEnd;
+          int wordStart = wordEnd;
+          while( wordStart > start &&
+                 text.at( wordStart - 1 ).isLetterOrNumber() ) --wordStart;
+          if ( wordStart < wordEnd ) {
+            runWordHandlers( blockPos + wordStart, blockPos + wordEnd,
+              text.mid( wordStart, wordEnd - wordStart ) );
+          }
+          wordEnd = wordStart;
+        }
+
+        runSequenceHandlers( blockPos + start, blockPos + end,
+          text.mid( start, end - start ) );
+      }
+
+      end = start;
+    }
+
+    if ( block == first ) break;
+    block = block.previous();
+  }
+
+  return skipped;
+}
+
+void HandlerScheduler::runWordHandlers( int from, int to,
+  const QString &word )
+{
+  QTextCursor cursor( mEditor->document() );
+  cursor.setPosition( from );
+  cursor.setPosition( to, QTextCursor::KeepAnchor );
+
+  for( int i = 0; i < mWordHandlers.count(); ++i ) {
+    if ( mWordHandlers.at( i ).handler->process( word, cursor ) ) break;
+  }
+}
+
+void HandlerScheduler::runSequenceHandlers( int from, int to,
+  const QString &sequence )
+{
+  QTextCursor cursor( mEditor->document() );
+  cursor.setPosition( from );
+  cursor.setPosition( to, QTextCursor::KeepAnchor );
+
+  for( int i = 0; i < mSequenceHandlers.count(); ++i ) {
+    if ( mSequenceHandlers.at( i ).handler->process( sequence, cursor ) ) {
+      break;
+    }
+  }
+}
@@ -0,0 +1,150 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef HANDLERSCHEDULER_H
+#define HANDLERSCHEDULER_H
+
+#include "keylatency.h"
+
+#include <QObject>
+#include <QList>
+
+class WordHandler;
+class SequenceHandler;
+
+class QTextEdit;
+class QTimer;
+
+/**
+  This class runs the word and sequence handlers of an editor outside of the
+  processing of key presses. While the user is typing the changed ranges of
+  the text are recorded. The handlers are run on the recorded ranges when the
+  user pauses typing or finishes a word. The work is split into short slices,
+  so key presses are processed in between.
+
+  Handlers run in the order of their priority. The first handler processing
+  a word or sequence wins. Changes made by handlers are merged into the
+  previous undo step, so they don't show up as separate step in the undo
+  history.
+*/
+class HandlerScheduler : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      Create scheduler for handlers working on the document of the given
+      editor.
+    */
+    HandlerScheduler( QTextEdit *editor );
+    ~HandlerScheduler();
+
+    /**
+      Add word handler. The scheduler takes ownership of the object.
+      
+      \param handler handler to add
+      \param priority handlers with higher priority are run first
+    */
+    void addHandler( WordHandler *handler, int priority = 0 );
+    /**
+      Add sequence handler. The scheduler takes ownership of the object.
+      
+      \param handler handler to add
+      \param priority handlers with higher priority are run first
+    */
+    void addHandler( SequenceHandler *handler, int priority = 0 );
+
+    /**
+      Record range of text changed by the user. The words and sequences
+      touching the range are processed later.
+      
+      \param from start position of range
+      \param to end position of range
+      \param boundary \c true, if a word was finished, so processing should
+        start as soon as the editor is idle, \c false to wait for a pause
+        in typing
+    */
+    void schedule( int from, int to, bool boundary );
+
+    /**
+      Cancel processing of all recorded ranges, e.g. because a different
+      document is loaded.
+    */
+    void cancel();
+
+    /**
+      Process all recorded ranges now.
+    */
+    void flush();
+
+    /**
+      Return, if there are ranges waiting to be processed.
+    */
+    bool isPending() const { return !mRanges.isEmpty(); }
+
+    /**
+      Return statistics of the time spent running handlers per slice of
+      work.
+    */
+    KeyLatency &latency() { return mLatency; }
+
+  protected slots:
+    void slotContentsChange( int position, int charsRemoved, int charsAdded );
+    void processSlice();
+
+  protected:
+    struct Range
+    {
+      int from;
+      int to;
+    };
+
+    /**
+      Run handlers on all words and sequences touching the range. The
+      sequence the cursor is positioned in is skipped, if \a all is \c false.
+      
+      \return \c true, if the sequence at the cursor was skipped
+    */
+    bool process( const Range &range, bool all );
+
+    void runWordHandlers( int from, int to, const QString &word );
+    void runSequenceHandlers( int from, int to, const QString &sequence );
+
+  private:
+    template<class Handler> struct Entry
+    {
+      Handler *handler;
+      int priority;
+    };
+
+    QTextEdit *mEditor;
+
+    QList<Entry<WordHandler> > mWordHandlers;
+    QList<Entry<SequenceHandler> > mSequenceHandlers;
+
+    /** Sorted list of disjoint ranges waiting to be processed */
+    QList<Range> mRanges;
+
+    QTimer *mTimer;
+    /** Set, if the user paused typing, so the word at the cursor is done */
+    bool mIdle;
+
+    KeyLatency mLatency;
+};
+
+#endif
@@ -23,6 +23,8 @@
 #include "dbg.h"
 #include "textformats.h"
 #include "wordhandler.h"
+#include "segmentindex.h"
+#include "handlerscheduler.h"
 
 #include <QMouseEvent>
 #include <QAbstractTextDocumentLayout>
@@ -32,6 +34,7 @@
 #include <QTextDocumentFragment>
 #include <QTextList>
 #include <QDebug>
+#include <QTime>
 
 /**
   This class provides automatic linking to web addresses.
@@ -58,15 +61,23 @@ class LinkHandler : public SequenceHandler
 class EmailHandler : public SequenceHandler
 {
   public:
+    EmailHandler()
+      : mPattern( "\\w+@[\\w\\-]+\\.\\w+" )
+    {
+    }
+
     bool process( const QString &word, QTextCursor &cursor )
     {
-      if ( !word.contains( QRegExp( "\\w+@[\\w\\-]+\\.\\w+" ) ) ) return false;
+      if ( !word.contains( '@' ) || !word.contains( mPattern ) ) return false;
 
       cursor.mergeCharFormat(
         TextFormats::hyperLinkCharFormat( "mailto:" + cursor.selectedText() ) );
 
       return true;
     }
+
+  private:
+    QRegExp mPattern;
 };
 
 /**
@@ -92,6 +103,12 @@ HyperTextEdit::HyperTextEdit( QWidget *parent )
   : QTextEdit( parent )
 {
   viewport()->setMouseTracking( true );
+
+  mSegmentIndex = new SegmentIndex;
+  connect( document(), SIGNAL( contentsChange( int, int, int ) ),
+    SLOT( slotContentsChange( int, int, int ) ) );
+
+  mHandlerScheduler = new HandlerScheduler( this );
   
   init();
   
@@ -104,8 +121,7 @@ HyperTextEdit::HyperTextEdit( QWidget *parent )
 
 HyperTextEdit::~HyperTextEdit()
 {
-  qDeleteAll( mWordHandlers );
-  qDeleteAll( mSequenceHandlers );
+  delete mSegmentIndex;
 }
 
 void HyperTextEdit::init()
@@ -113,16 +129,26 @@ void HyperTextEdit::init()
   QTextFrameFormat f;
   f.setMargin( 8 );
   document()->rootFrame()->setFrameFormat( f );
+
+  mHandlerScheduler->cancel();
+}
+
+void HyperTextEdit::addHandler( WordHandler *handler, int priority )
+{
+  mHandlerScheduler->addHandler( handler, priority );
 }
 
-void HyperTextEdit::addHandler( WordHandler *handler )
+void HyperTextEdit::addHandler( SequenceHandler *handler, int priority )
 {
-  mWordHandlers.append( handler );
+  mHandlerScheduler->addHandler( handler, priority );
 }
 
-void HyperTextEdit::addHandler( SequenceHandler *handler )
+void HyperTextEdit::slotContentsChange( int position, int charsRemoved,
+  int charsAdded )
 {
-  mSequenceHandlers.append( handler );
+  Q_UNUSED( charsRemoved );
+
+  mSegmentIndex->invalidate( document(), position, position + charsAdded );
 }
 
 bool HyperTextEdit::event( QEvent *ev )
@@ -308,82 +334,27 @@ void HyperTextEdit::keyPressEvent( QKeyEvent *ev )
     return;
   }
   
+  QTime time;
+  time.start();
+
   QTextEdit::keyPressEvent( ev );
 
   cursor = textCursor();
 
   if ( cursor.hasSelection() ) return;
 
-  QTextBlock block = cursor.block();
-
-  QString text = block.text();
-
-  QTextCursor wordCursor( cursor );
-  wordCursor.movePosition( QTextCursor::StartOfWord );
-  wordCursor.movePosition( QTextCursor::EndOfWord, QTextCursor::KeepAnchor );
-  if ( wordCursor.hasSelection() ) {
-    QString word = wordCursor.selectedText();
-
-//    dbg() << "WORD: " << word << endl;
-
-    QTextCharFormat currentFormat = currentCharFormat();
-
-    // hide the magic highlighting from the user visible undo by
-    // putting it into existing undo blocks
-    wordCursor.joinPreviousEditBlock();
-
-    foreach( WordHandler *handler, mWordHandlers ) {
-      if ( handler->process( word, wordCursor ) ) break;
-    }
-
-    wordCursor.endEditBlock();
-
-    setCurrentCharFormat( currentFormat );
-  }
-
-  int sequenceEnd = cursor.position();  
-  QTextCursor sequenceCursor( cursor );
-  sequenceCursor.movePosition( QTextCursor::Left, QTextCursor::KeepAnchor );
-  if ( sequenceCursor.selectedText() == " " ) {
-    sequenceEnd = sequenceCursor.position();
-  }
-  sequenceCursor.setPosition( sequenceEnd );
-  while( !sequenceCursor.atBlockStart() ) {
-    sequenceCursor.movePosition( QTextCursor::Left, QTextCursor::KeepAnchor );
-    if ( sequenceCursor.selectedText().contains( QRegExp( "^\\s" ) ) ) {
-      sequenceCursor.movePosition( QTextCursor::Right );
-      break;
-    }
+  // Link detection and other handlers run later, so typing isn't slowed
+  // down by them
+  QString typed = ev->text();
+  if ( !typed.isEmpty() ) {
+    int position = cursor.position();
+    bool boundary = !typed.at( 0 ).isLetterOrNumber();
+    mHandlerScheduler->schedule( qMax( position - 1, 0 ), position,
+      boundary );
   }
-  sequenceCursor.clearSelection();
-  sequenceCursor.setPosition( sequenceEnd, QTextCursor::KeepAnchor );
-  while( !sequenceCursor.atBlockEnd() ) {
-    sequenceCursor.movePosition( QTextCursor::Right, QTextCursor::KeepAnchor );
-    if ( sequenceCursor.selectedText().contains( QRegExp( "\\s$" ) ) ) {
-      sequenceCursor.movePosition( QTextCursor::Left, QTextCursor::KeepAnchor );
-      break;
-    }
-  }
-  if ( sequenceCursor.hasSelection() ) {
-    QString sequence = sequenceCursor.selectedText();
-
-//    dbg() << "SEQUENCE: " << sequence << endl;
 
-    QTextCharFormat currentFormat = currentCharFormat();
+  mKeyLatency.record( time.elapsed() );
 
-    // hide the magic highlighting from the user visible undo by
-    // putting it into existing undo blocks
-    sequenceCursor.joinPreviousEditBlock();
-
-    foreach( SequenceHandler *handler, mSequenceHandlers ) {
-      if ( handler->process( sequence, sequenceCursor ) ) break;
-    }
-
-    sequenceCursor.endEditBlock();
-
-    setCurrentCharFormat( currentFormat );
-  }
-  
   if ( key == Qt::Key_Backspace ) {
     if ( cursor.atBlockStart() && hasList && !cursor.currentList() ) {
       outdent();
@@ -397,6 +368,16 @@ void HyperTextEdit::keyPressEvent( QKeyEvent *ev )
   setTextCursor( cursor );
 }
 
+void HyperTextEdit::insertFromMimeData( const QMimeData *source )
+{
+  int from = textCursor().selectionStart();
+
+  QTextEdit::insertFromMimeData( source );
+
+  int to = textCursor().position();
+  if ( to > from ) emit textInserted( from, to );
+}
+
 QTextCursor getIncludingBlocks( const QTextCursor cursor )
 {
   int pos = cursor.position();
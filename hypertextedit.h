@@ -20,12 +20,17 @@
 #ifndef HYPERTEXTEDIT_H
 #define HYPERTEXTEDIT_H
 
+#include "keylatency.h"
+
 #include <QTextEdit>
 
 class WordHandler;
 class SequenceHandler;
+class SegmentIndex;
+class HandlerScheduler;
 
 class QHelpEvent;
+class QMimeData;
 
 /**
   This class provides the text editing widget used by Todoodle. It's derived
@@ -50,13 +55,37 @@ class HyperTextEdit : public QTextEdit
     void init();
 
     /**
-      Add word handler. HyperTextEdit takes ownership of the object.
+      Add word handler. HyperTextEdit takes ownership of the object. Handlers
+      are run in the background after the user typed text.
+      
+      \param handler handler to add
+      \param priority handlers with higher priority are run first
     */
-    void addHandler( WordHandler * );
+    void addHandler( WordHandler *handler, int priority = 0 );
     /**
       Add sequence handler. HyperTextEdit takes ownership of the object.
+      Handlers are run in the background after the user typed text.
+      
+      \param handler handler to add
+      \param priority handlers with higher priority are run first
+    */
+    void addHandler( SequenceHandler *handler, int priority = 0 );
+
+    /**
+      Return scheduler running the word and sequence handlers.
+    */
+    HandlerScheduler *handlerScheduler() const { return mHandlerScheduler; }
+
+    /**
+      Return index of segments used to only save changed blocks.
     */
-    void addHandler( SequenceHandler * );
+    SegmentIndex *segmentIndex() const { return mSegmentIndex; }
+
+    /**
+      Return statistics of the time spent processing typed text per key
+      press.
+    */
+    KeyLatency &keyLatency() { return mKeyLatency; }
 
   signals:
     /**
@@ -65,6 +94,16 @@ class HyperTextEdit : public QTextEdit
       \param link link reference
     */
     void anchorClicked( const QString &link );
+    /**
+      Emitted after text was pasted or dropped into the editor.
+      
+      \param from start position of inserted text
+      \param to end position of inserted text
+    */
+    void textInserted( int from, int to );
+
+  protected slots:
+    void slotContentsChange( int position, int charsRemoved, int charsAdded );
 
   protected:
     QPoint translateCoordinates(const QPoint &point);
@@ -76,6 +115,7 @@ class HyperTextEdit : public QTextEdit
     void mouseMoveEvent( QMouseEvent *ev );
     void mouseReleaseEvent( QMouseEvent *ev );
     void keyPressEvent( QKeyEvent *ev );
+    void insertFromMimeData( const QMimeData *source );
 
     void updent();
     void downdent();
@@ -84,8 +124,11 @@ class HyperTextEdit : public QTextEdit
     void removeBlock();
 
   private:
-    QList<WordHandler *> mWordHandlers;
-    QList<SequenceHandler *> mSequenceHandlers;
+    HandlerScheduler *mHandlerScheduler;
+
+    SegmentIndex *mSegmentIndex;
+
+    KeyLatency mKeyLatency;
 };
 
 #endif
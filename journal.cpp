@@ -0,0 +1,286 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "journal.h"
+
+#include "format.h"
+#include "savequeue.h"
+#include "dbg.h"
+
+#include <QDataStream>
+#include <QTextFrame>
+
+// "TDJ1"
+static const quint32 journalMagic = 0x54444a31;
+
+Journal::Journal( const QString &filename, QObject *parent )
+  : QObject( parent ), mFilename( filename ), mRevision( 0 ),
+    mFrameCount( 0 )
+{
+}
+
+Journal::~Journal()
+{
+  detach();
+}
+
+void Journal::attach( QTextDocument *document, const QByteArray &base )
+{
+  detach();
+
+  mDocument = document;
+  mBase = base;
+  mRevision = 0;
+  mFrameCount = countFrames( document->rootFrame() );
+
+  QByteArray journalBase;
+  QList<Record> records;
+  if ( readJournal( mFilename, journalBase, records ) ) {
+    if ( journalBase == base ) {
+      // Keep the recorded changes, they are contained in the document, but
+      // not in the topic file yet.
+      if ( !records.isEmpty() ) mRevision = records.last().revision;
+    } else {
+      dbg() << "Journal: Removing stale journal '" << mFilename << "'" << endl;
+      QFile::remove( mFilename );
+    }
+  }
+
+  connect( document, SIGNAL( contentsChange( int, int, int ) ),
+    SLOT( slotContentsChange( int, int, int ) ) );
+}
+
+void Journal::detach()
+{
+  if ( mDocument ) {
+    disconnect( mDocument, 0, this, 0 );
+  }
+  mDocument = 0;
+
+  mFile.close();
+}
+
+void Journal::slotContentsChange( int position, int charsRemoved,
+  int charsAdded )
+{
+  if ( !mDocument ) return;
+
+  Format format( mDocument );
+
+  Record record;
+  record.position = position;
+  record.charsRemoved = charsRemoved;
+
+  // Operations only cover blocks, so changes of the frame structure are
+  // recorded as a copy of the complete document.
+  int frameCount = countFrames( mDocument->rootFrame() );
+  if ( frameCount != mFrameCount ||
+       touchesFrameBoundary( mDocument->rootFrame(), position,
+                             position + charsAdded ) ) {
+    record.type = Checkpoint;
+    record.data = format.toString().toUtf8();
+  } else {
+    record.type = Operation;
+    record.data = format.rangeToString( position,
+      position + charsAdded ).toUtf8();
+  }
+  mFrameCount = frameCount;
+
+  append( record );
+}
+
+void Journal::recordCheckpoint()
+{
+  if ( !mDocument ) return;
+
+  Format format( mDocument );
+
+  Record record;
+  record.type = Checkpoint;
+  record.position = 0;
+  record.charsRemoved = 0;
+  record.data = format.toString().toUtf8();
+
+  append( record );
+}
+
+void Journal::append( const Record &r )
+{
+  Record record = r;
+  record.revision = ++mRevision;
+
+  if ( !mFile.isOpen() ) {
+    mFile.setFileName( mFilename );
+    bool exists = mFile.exists() && mFile.size() > 0;
+    if ( !mFile.open( QIODevice::WriteOnly | QIODevice::Append ) ) {
+      dbg() << "Journal: Unable to open '" << mFilename << "'" << endl;
+      return;
+    }
+    if ( !exists ) writeHeader( &mFile, mBase );
+  }
+
+  writeRecord( &mFile, record );
+  mFile.flush();
+}
+
+void Journal::checkpoint( int revision, const QByteArray &base )
+{
+  mBase = base;
+
+  QByteArray oldBase;
+  QList<Record> records;
+  readJournal( mFilename, oldBase, records );
+
+  QList<Record> remaining;
+  foreach( Record record, records ) {
+    if ( int( record.revision ) > revision ) remaining.append( record );
+  }
+
+  mFile.close();
+
+  if ( remaining.isEmpty() ) {
+    QFile::remove( mFilename );
+    return;
+  }
+
+  QFile file( SaveQueue::temporaryFilename( mFilename ) );
+  if ( !file.open( QIODevice::WriteOnly ) ) {
+    dbg() << "Journal: Unable to open '" << file.fileName() << "'" << endl;
+    return;
+  }
+  writeHeader( &file, base );
+  foreach( Record record, remaining ) writeRecord( &file, record );
+  SaveQueue::replaceFile( file, mFilename );
+}
+
+bool Journal::replay( const QString &filename, QTextDocument *document,
+  const QByteArray &base )
+{
+  QByteArray journalBase;
+  QList<Record> records;
+  if ( !readJournal( filename, journalBase, records ) ) return false;
+
+  if ( journalBase != base ) {
+    dbg() << "Journal: Discarding stale journal '" << filename << "'" << endl;
+    QFile::remove( filename );
+    return false;
+  }
+
+  if ( records.isEmpty() ) return false;
+
+  dbg() << "Journal: Replaying " << records.count() << " changes from '"
+    << filename << "'" << endl;
+
+  Format format( document );
+
+  foreach( Record record, records ) {
+    bool success;
+    if ( record.type == Checkpoint ) {
+      success = format.fromString( QString::fromUtf8( record.data ) );
+    } else {
+      success = format.replaceRange( record.position, record.charsRemoved,
+        QString::fromUtf8( record.data ) );
+    }
+    if ( !success ) {
+      qWarning( "Error replaying journal '%s' at revision %d.",
+        qPrintable( filename ), int( record.revision ) );
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool Journal::readJournal( const QString &filename, QByteArray &base,
+  QList<Record> &records )
+{
+  QFile file( filename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return false;
+
+  QDataStream stream( &file );
+
+  quint32 magic;
+  stream >> magic >> base;
+  if ( stream.status() != QDataStream::Ok || magic != journalMagic ) {
+    dbg() << "Journal: Invalid journal '" << filename << "'" << endl;
+    base = QByteArray();
+    return true;
+  }
+
+  // A record which was only partially written when the application crashed
+  // ends the journal.
+  while( !stream.atEnd() ) {
+    Record record;
+    quint32 size;
+    quint16 checksum;
+    stream >> size >> record.revision >> record.type >> record.position
+      >> record.charsRemoved >> checksum;
+    if ( stream.status() != QDataStream::Ok ) break;
+
+    record.data.resize( size );
+    if ( stream.readRawData( record.data.data(), size ) != int( size ) ) break;
+    if ( qChecksum( record.data.constData(), size ) != checksum ) break;
+
+    records.append( record );
+  }
+
+  return true;
+}
+
+void Journal::writeHeader( QIODevice *device, const QByteArray &base )
+{
+  QDataStream stream( device );
+  stream << journalMagic << base;
+}
+
+void Journal::writeRecord( QIODevice *device, const Record &record )
+{
+  QByteArray buffer;
+  QDataStream stream( &buffer, QIODevice::WriteOnly );
+  stream << quint32( record.data.size() ) << record.revision << record.type
+    << record.position << record.charsRemoved
+    << qChecksum( record.data.constData(), record.data.size() );
+  stream.writeRawData( record.data.constData(), record.data.size() );
+
+  // Write record in one go, so it is either complete or detected as broken
+  device->write( buffer );
+}
+
+int Journal::countFrames( QTextFrame *frame )
+{
+  int count = 1;
+  foreach( QTextFrame *child, frame->childFrames() ) {
+    count += countFrames( child );
+  }
+  return count;
+}
+
+bool Journal::touchesFrameBoundary( QTextFrame *frame, int from, int to )
+{
+  foreach( QTextFrame *child, frame->childFrames() ) {
+    int start = child->firstPosition() - 1;
+    int end = child->lastPosition();
+    if ( ( start >= from && start < to ) || ( end >= from && end < to ) ) {
+      return true;
+    }
+    if ( touchesFrameBoundary( child, from, to ) ) return true;
+  }
+  return false;
+}
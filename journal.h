@@ -0,0 +1,152 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QFile>
+#include <QPointer>
+#include <QTextDocument>
+
+/**
+  This class records the changes of a topic in a write-ahead journal. Each
+  change of the document is appended to the journal file as a small record
+  as soon as it happens, so that edits survive a crash, even if the topic
+  wasn't saved yet.
+
+  The journal refers to the topic file it is based on by the identity of the
+  file as returned by SaveQueue::fileIdentity(). When the topic is saved, the
+  changes contained in the saved data are dropped from the journal. A journal
+  which doesn't match the topic file on disk is stale and is discarded.
+*/
+class Journal : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      Create journal.
+      
+      \param filename name of journal file
+      \param parent parent object
+    */
+    Journal( const QString &filename, QObject *parent = 0 );
+    ~Journal();
+
+    /**
+      Return name of journal file.
+    */
+    QString filename() const { return mFilename; }
+
+    /**
+      Start recording the changes of the given document. The document has to
+      contain the data of the topic file with the given identity plus the
+      changes already recorded in the journal file, if any.
+      
+      \param document document to be recorded
+      \param base identity of topic file
+    */
+    void attach( QTextDocument *document, const QByteArray &base );
+    /**
+      Stop recording changes.
+    */
+    void detach();
+    /**
+      Return document whose changes are currently recorded.
+    */
+    QTextDocument *document() const { return mDocument; }
+
+    /**
+      Record the complete content of the document. This is used, when the
+      document was changed without the changes being recorded.
+    */
+    void recordCheckpoint();
+
+    /**
+      Return revision of the last recorded change.
+    */
+    int revision() const { return mRevision; }
+
+    /**
+      Drop all changes up to the given revision from the journal, because they
+      were written to the topic file.
+      
+      \param revision revision of the saved data
+      \param base identity of the written topic file
+    */
+    void checkpoint( int revision, const QByteArray &base );
+
+    /**
+      Apply changes recorded in the given journal file to the given document.
+      Nothing is applied, if the journal is not based on the topic file with
+      the given identity.
+      
+      \param filename name of journal file
+      \param document document holding the data of the topic file
+      \param base identity of topic file
+      \return \c true, if changes were applied, \c false otherwise
+    */
+    static bool replay( const QString &filename, QTextDocument *document,
+      const QByteArray &base );
+
+  protected slots:
+    void slotContentsChange( int position, int charsRemoved, int charsAdded );
+
+  protected:
+    /**
+      This enum represents the types of journal records.
+      
+      \param Operation Replace a range of the document by the given blocks
+      \param Checkpoint Replace the complete document by the given data
+    */
+    enum RecordType { Operation, Checkpoint };
+
+    struct Record
+    {
+      quint32 revision;
+      quint8 type;
+      qint32 position;
+      qint32 charsRemoved;
+      QByteArray data;
+    };
+
+    void append( const Record & );
+
+    static bool readJournal( const QString &filename, QByteArray &base,
+      QList<Record> &records );
+    static void writeHeader( QIODevice *, const QByteArray &base );
+    static void writeRecord( QIODevice *, const Record & );
+
+    static int countFrames( QTextFrame * );
+    static bool touchesFrameBoundary( QTextFrame *, int from, int to );
+
+  private:
+    QString mFilename;
+    QFile mFile;
+
+    QPointer<QTextDocument> mDocument;
+    QByteArray mBase;
+    int mRevision;
+    int mFrameCount;
+};
+
+#endif
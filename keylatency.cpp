@@ -0,0 +1,82 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "keylatency.h"
+
+#include <QStringList>
+
+// Upper limits of the histogram buckets in milliseconds. The last bucket
+// takes all longer times.
+const int KeyLatency::mBucketLimits[ BucketCount - 1 ] = { 1, 5, 16, 50 };
+
+KeyLatency::KeyLatency()
+{
+  reset();
+}
+
+void KeyLatency::record( int msecs )
+{
+  ++mCount;
+  mTotal += msecs;
+  if ( msecs > mMaximum ) mMaximum = msecs;
+
+  int bucket = 0;
+  while( bucket < BucketCount - 1 && msecs >= mBucketLimits[ bucket ] ) {
+    ++bucket;
+  }
+  ++mBuckets[ bucket ];
+}
+
+void KeyLatency::reset()
+{
+  mCount = 0;
+  mTotal = 0;
+  mMaximum = 0;
+  for( int i = 0; i < BucketCount; ++i ) mBuckets[ i ] = 0;
+}
+
+double KeyLatency::average() const
+{
+  if ( mCount == 0 ) return 0;
+  return double( mTotal ) / mCount;
+}
+
+QString KeyLatency::report() const
+{
+  QStringList lines;
+
+  lines.append( QString( "Keys: %1" ).arg( mCount ) );
+  lines.append( QString( "Average: %1 ms" ).arg( average(), 0, 'f', 2 ) );
+  lines.append( QString( "Maximum: %1 ms" ).arg( mMaximum ) );
+
+  int lower = 0;
+  for( int i = 0; i < BucketCount; ++i ) {
+    QString range;
+    if ( i < BucketCount - 1 ) {
+      range = QString( "%1-%2 ms" ).arg( lower ).arg( mBucketLimits[ i ] - 1 );
+      lower = mBucketLimits[ i ];
+    } else {
+      range = QString( ">= %1 ms" ).arg( lower );
+    }
+    lines.append( QString( "%1: %2" ).arg( range ).arg( mBuckets[ i ] ) );
+  }
+
+  return lines.join( "\n" );
+}
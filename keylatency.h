@@ -0,0 +1,77 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef KEYLATENCY_H
+#define KEYLATENCY_H
+
+#include <QString>
+
+/**
+  This class collects the time spent processing key presses. It records the
+  number of keys, the total and maximum time and a histogram of times, so the
+  cost of the handlers run on every key press can be monitored.
+*/
+class KeyLatency
+{
+  public:
+    /**
+      Create empty statistics.
+    */
+    KeyLatency();
+
+    /**
+      Record time needed to process one key.
+      
+      \param msecs time in milliseconds
+    */
+    void record( int msecs );
+    /**
+      Clear all recorded times.
+    */
+    void reset();
+
+    /**
+      Return number of recorded keys.
+    */
+    int count() const { return mCount; }
+    /**
+      Return average time per key in milliseconds.
+    */
+    double average() const;
+    /**
+      Return maximum time for a key in milliseconds.
+    */
+    int maximum() const { return mMaximum; }
+
+    /**
+      Return human readable summary of the statistics.
+    */
+    QString report() const;
+
+  private:
+    enum { BucketCount = 5 };
+    static const int mBucketLimits[ BucketCount - 1 ];
+
+    int mCount;
+    qint64 mTotal;
+    int mMaximum;
+    int mBuckets[ BucketCount ];
+};
+
+#endif
@@ -0,0 +1,136 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "linkindex.h"
+
+#include "format.h"
+#include "formatbinary.h"
+
+#include <QDataStream>
+#include <QTextDocument>
+
+static const quint32 linkIndexMagic = 0x54444c49;
+static const qint32 linkIndexVersion = 1;
+
+static QStringList sorted( const QSet<QString> &set )
+{
+  QStringList result = set.toList();
+  qSort( result );
+  return result;
+}
+
+
+LinkIndex::LinkIndex( const QString &filename, QObject *parent )
+  : TopicDataIndex( filename, linkIndexMagic, linkIndexVersion, parent )
+{
+}
+
+void LinkIndex::clearData()
+{
+  mLinks.clear();
+  mBacklinks.clear();
+}
+
+void LinkIndex::readData( QDataStream &stream, const QString &topic )
+{
+  QStringList links;
+  stream >> links;
+
+  mLinks.insert( topic, links.toSet() );
+  foreach( QString link, links ) mBacklinks[ link ].insert( topic );
+}
+
+void LinkIndex::writeData( QDataStream &stream, const QString &topic ) const
+{
+  stream << sorted( mLinks.value( topic ) );
+}
+
+bool LinkIndex::readFile( const QString &filename, QVariant &data ) const
+{
+  QTextDocument document;
+  bool loaded;
+  if ( FormatBinary::isBinary( filename ) ) {
+    FormatBinary format( &document );
+    loaded = format.load( filename );
+  } else {
+    Format format( &document );
+    loaded = format.load( filename );
+  }
+  if ( !loaded ) return false;
+
+  data = Format( &document ).topicLinks();
+  return true;
+}
+
+void LinkIndex::updateFromFile( const QString &topic, const QVariant &data,
+  const QByteArray &identity )
+{
+  update( topic, data.toStringList(), identity );
+}
+
+void LinkIndex::update( const QString &topic, const QStringList &links,
+  const QByteArray &identity )
+{
+  setTopicIdentity( topic, identity );
+
+  QSet<QString> newLinks = links.toSet();
+  QSet<QString> oldLinks = mLinks.value( topic );
+  if ( newLinks == oldLinks && mLinks.contains( topic ) ) return;
+
+  foreach( QString link, oldLinks - newLinks ) {
+    QHash<QString, QSet<QString> >::iterator b = mBacklinks.find( link );
+    if ( b == mBacklinks.end() ) continue;
+    b.value().remove( topic );
+    if ( b.value().isEmpty() ) mBacklinks.erase( b );
+  }
+  foreach( QString link, newLinks - oldLinks ) {
+    mBacklinks[ link ].insert( topic );
+  }
+  mLinks.insert( topic, newLinks );
+
+  emit linksChanged( topic );
+}
+
+void LinkIndex::remove( const QString &topic )
+{
+  if ( !contains( topic ) ) return;
+
+  update( topic, QStringList() );
+
+  removeTopic( topic );
+  mLinks.remove( topic );
+}
+
+QStringList LinkIndex::links( const QString &topic ) const
+{
+  return sorted( mLinks.value( topic ) );
+}
+
+QStringList LinkIndex::backlinks( const QString &topic ) const
+{
+  return sorted( mBacklinks.value( topic ) );
+}
+
+bool LinkIndex::linksTo( const QString &from, const QString &to ) const
+{
+  QHash<QString, QSet<QString> >::const_iterator it = mLinks.find( from );
+  if ( it == mLinks.constEnd() ) return false;
+  return it.value().contains( to );
+}
@@ -0,0 +1,105 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef LINKINDEX_H
+#define LINKINDEX_H
+
+#include "topicdataindex.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+
+/**
+  This class holds the graph of links between topics. For each topic it
+  records the topics it links to and the topics linking to it, so questions
+  like "what links here" can be answered without reading topic files.
+
+  The links of each topic are stored in a file in the topic directory
+  together with the identity of the topic file they were extracted from, as
+  provided by TopicDataIndex. Incoming links are computed when the index is
+  loaded.
+*/
+class LinkIndex : public TopicDataIndex
+{
+    Q_OBJECT
+  public:
+    /**
+      Create empty index stored in the given file.
+    */
+    LinkIndex( const QString &filename, QObject *parent = 0 );
+
+    /**
+      Set topics the given topic links to. Emits linksChanged(), if the
+      links differ from the links recorded before.
+      
+      \param topic name of topic
+      \param links names of linked topics
+      \param identity identity of the topic file holding the links
+    */
+    void update( const QString &topic, const QStringList &links,
+      const QByteArray &identity = QByteArray() );
+    /**
+      Remove outgoing links of topic from index. Links from other topics to
+      the topic are kept.
+    */
+    void remove( const QString &topic );
+
+    /**
+      Return sorted list of topics the given topic links to.
+    */
+    QStringList links( const QString &topic ) const;
+    /**
+      Return sorted list of topics linking to the given topic.
+    */
+    QStringList backlinks( const QString &topic ) const;
+    /**
+      Return, if the first topic links to the second one.
+    */
+    bool linksTo( const QString &from, const QString &to ) const;
+    /**
+      Return number of topics the given topic links to.
+    */
+    int linkCount( const QString &topic ) const
+    {
+      return mLinks.value( topic ).count();
+    }
+
+  signals:
+    /**
+      Emitted when the outgoing links of a topic changed.
+    */
+    void linksChanged( const QString &topic );
+
+  protected:
+    void clearData();
+    void readData( QDataStream &stream, const QString &topic );
+    void writeData( QDataStream &stream, const QString &topic ) const;
+    bool readFile( const QString &filename, QVariant &data ) const;
+    void updateFromFile( const QString &topic, const QVariant &data,
+      const QByteArray &identity );
+
+  private:
+    QHash<QString, QSet<QString> > mLinks;
+    QHash<QString, QSet<QString> > mBacklinks;
+};
+
+#endif
@@ -22,6 +22,7 @@
 #include "topicmanager.h"
 #include "dbg.h"
 #include "cmdlineargs.h"
+#include "format.h"
 
 #include <qapplication.h>
 #include <QDir>
@@ -60,6 +61,31 @@ int main( int argc, char ** argv )
     mode = TopicManager::Offline;
   }
 
+  if ( args.hasOption( "domparser" ) ) {
+    dbg() << "DOM PARSER" << endl;
+    Format::setDefaultParser( Format::DomParser );
+  }
+
+  if ( args.hasOption( "upgrade" ) || args.hasOption( "downgrade" ) ) {
+    TopicManager converter( topicDir, TopicManager::Offline );
+    bool binary = args.hasOption( "upgrade" );
+    dbg() << "CONVERT TO " << ( binary ? "BINARY" : "XML" ) << " FORMAT"
+      << endl;
+    return converter.convertTopics( binary ) ? 0 : 1;
+  }
+
+  if ( args.hasOption( "relink" ) ) {
+    TopicManager linker( topicDir, TopicManager::Offline );
+    dbg() << "RELINK TOPICS" << endl;
+    return linker.relinkTopics() < 0 ? 1 : 0;
+  }
+
+  if ( args.hasOption( "listtodos" ) ) {
+    TopicManager lister( topicDir, TopicManager::Offline );
+    lister.listTodos();
+    return 0;
+  }
+
   TopicManager::WindowMode windowMode;
   if ( args.hasOption( "singlewindow" ) ) {
     windowMode = TopicManager::Single;
@@ -69,6 +95,11 @@ int main( int argc, char ** argv )
 
   TopicManager topicManager( topicDir, mode, windowMode );
 
+  if ( args.hasOption( "nolazyload" ) ) {
+    dbg() << "NO LAZY LOADING" << endl;
+    topicManager.setLazyLoading( false );
+  }
+
   topicManager.loadStart();
   
   a.connect( &a, SIGNAL( lastWindowClosed() ), &topicManager,
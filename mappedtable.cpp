@@ -0,0 +1,250 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "mappedtable.h"
+
+#include "savequeue.h"
+#include "dbg.h"
+
+#include <QtEndian>
+
+// The header starts with magic, version and number of records and ends with
+// the offset of the strings
+static const int headerDataOffset = 12;
+
+MappedTable::MappedTable( const QString &filename, quint32 magic,
+  quint32 version, int headerDataSize, int recordSize )
+  : mFilename( filename ), mMagic( magic ), mVersion( version ),
+    mHeaderDataSize( headerDataSize ), mRecordSize( recordSize ), mData( 0 ),
+    mCount( 0 ), mStringsOffset( 0 )
+{
+}
+
+MappedTable::~MappedTable()
+{
+  unmap();
+}
+
+void MappedTable::unmap()
+{
+  if ( mData ) {
+    mFile.unmap( const_cast<uchar *>( mData ) );
+    mData = 0;
+  }
+  mFile.close();
+  mCount = 0;
+}
+
+bool MappedTable::open()
+{
+  unmap();
+
+  int headerSize = headerDataOffset + mHeaderDataSize + 4;
+
+  mFile.setFileName( mFilename );
+  if ( !mFile.open( QIODevice::ReadOnly ) ) return false;
+  if ( mFile.size() < headerSize ) {
+    mFile.close();
+    return false;
+  }
+
+  mData = mFile.map( 0, mFile.size() );
+  if ( !mData ) {
+    qWarning( "Unable to map '%s'.", qPrintable( mFilename ) );
+    mFile.close();
+    return false;
+  }
+
+  quint32 magic = qFromLittleEndian<quint32>( mData );
+  quint32 version = qFromLittleEndian<quint32>( mData + 4 );
+  quint32 count = qFromLittleEndian<quint32>( mData + 8 );
+  if ( magic != mMagic || version != mVersion ||
+       headerSize + qint64( count ) * mRecordSize > mFile.size() ) {
+    qWarning( "Unsupported file '%s'.", qPrintable( mFilename ) );
+    unmap();
+    return false;
+  }
+
+  mCount = count;
+
+  return true;
+}
+
+const uchar *MappedTable::record( int record ) const
+{
+  return mData + headerDataOffset + mHeaderDataSize + 4 +
+    record * mRecordSize;
+}
+
+QString MappedTable::string( quint32 offset, quint32 length ) const
+{
+  if ( offset + qint64( length ) * 2 > mFile.size() ) return QString();
+
+  QString result;
+  result.resize( length );
+  for( quint32 i = 0; i < length; ++i ) {
+    result[ i ] = QChar( qFromLittleEndian<quint16>( mData + offset + 2 * i ) );
+  }
+  return result;
+}
+
+QString MappedTable::name( int record ) const
+{
+  const uchar *r = this->record( record );
+  return string( qFromLittleEndian<quint32>( r ),
+    qFromLittleEndian<quint32>( r + 4 ) );
+}
+
+QStringList MappedTable::names() const
+{
+  QStringList result;
+  for( quint32 record = 0; record < mCount; ++record ) {
+    result.append( name( record ) );
+  }
+  return result;
+}
+
+int MappedTable::compareName( int record, const QString &name ) const
+{
+  // Compare in place, so looking up a record doesn't allocate strings
+  const uchar *r = this->record( record );
+  quint32 offset = qFromLittleEndian<quint32>( r );
+  quint32 length = qFromLittleEndian<quint32>( r + 4 );
+  if ( offset + qint64( length ) * 2 > mFile.size() ) length = 0;
+
+  quint32 common = qMin( length, quint32( name.size() ) );
+  for( quint32 i = 0; i < common; ++i ) {
+    ushort c = qFromLittleEndian<quint16>( mData + offset + 2 * i );
+    ushort n = name.at( i ).unicode();
+    if ( c != n ) return c < n ? -1 : 1;
+  }
+  if ( length == quint32( name.size() ) ) return 0;
+  return length < quint32( name.size() ) ? -1 : 1;
+}
+
+int MappedTable::find( const QString &name ) const
+{
+  int low = 0;
+  int high = mCount;
+  while ( low < high ) {
+    int middle = ( low + high ) / 2;
+    if ( compareName( middle, name ) < 0 ) low = middle + 1;
+    else high = middle;
+  }
+
+  if ( low < int( mCount ) && compareName( low, name ) == 0 ) return low;
+  return -1;
+}
+
+QByteArray MappedTable::headerData() const
+{
+  if ( !mData ) return QByteArray();
+  return QByteArray( reinterpret_cast<const char *>( mData +
+    headerDataOffset ), mHeaderDataSize );
+}
+
+bool MappedTable::writeHeaderData( const QByteArray &data )
+{
+  QFile file( mFilename );
+  if ( !file.open( QIODevice::ReadWrite ) ) return false;
+  if ( file.size() < headerDataOffset + mHeaderDataSize ) return false;
+
+  file.seek( headerDataOffset );
+  QByteArray d = data.leftJustified( mHeaderDataSize, 0, true );
+  return file.write( d ) == mHeaderDataSize;
+}
+
+void MappedTable::beginWrite( int count, const QByteArray &headerData )
+{
+  mStringsOffset = headerDataOffset + mHeaderDataSize + 4 +
+    count * mRecordSize;
+
+  mRecords.clear();
+  mRecords.reserve( mStringsOffset );
+  mStrings.clear();
+
+  appendUInt32( mMagic );
+  appendUInt32( mVersion );
+  appendUInt32( count );
+  appendBytes( headerData, mHeaderDataSize );
+  appendUInt32( mStringsOffset );
+}
+
+void MappedTable::appendString( const QString &string )
+{
+  appendUInt32( mStringsOffset + mStrings.size() );
+  appendUInt32( string.size() );
+
+  uchar buffer[ 2 ];
+  for( int i = 0; i < string.size(); ++i ) {
+    qToLittleEndian( string.at( i ).unicode(), buffer );
+    mStrings.append( reinterpret_cast<const char *>( buffer ), 2 );
+  }
+}
+
+void MappedTable::appendUInt32( quint32 value )
+{
+  uchar buffer[ 4 ];
+  qToLittleEndian( value, buffer );
+  mRecords.append( reinterpret_cast<const char *>( buffer ), 4 );
+}
+
+void MappedTable::appendInt64( qint64 value )
+{
+  uchar buffer[ 8 ];
+  qToLittleEndian( value, buffer );
+  mRecords.append( reinterpret_cast<const char *>( buffer ), 8 );
+}
+
+void MappedTable::appendBytes( const QByteArray &data, int size )
+{
+  mRecords.append( data.leftJustified( size, 0, true ) );
+}
+
+bool MappedTable::commit()
+{
+  QByteArray records = mRecords;
+  QByteArray strings = mStrings;
+  mRecords.clear();
+  mStrings.clear();
+
+  QFile file( SaveQueue::temporaryFilename( mFilename ) );
+  if ( !file.open( QIODevice::WriteOnly ) ) {
+    qWarning( "Unable to write '%s'.", qPrintable( mFilename ) );
+    return false;
+  }
+  if ( file.write( records ) != records.size() ||
+       file.write( strings ) != strings.size() ) {
+    qWarning( "Error writing '%s'.", qPrintable( mFilename ) );
+    file.close();
+    file.remove();
+    return false;
+  }
+
+  // The mapped file can't be replaced on all platforms. If replacing fails,
+  // the records of the old file are mapped again.
+  unmap();
+  if ( !SaveQueue::replaceFile( file, mFilename ) ) {
+    open();
+    return false;
+  }
+
+  return open();
+}
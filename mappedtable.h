@@ -0,0 +1,155 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef MAPPEDTABLE_H
+#define MAPPEDTABLE_H
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+#include <QByteArray>
+
+/**
+  This class provides a memory mapped file holding a table of fixed size
+  records sorted by name, which is searched in place, followed by the
+  strings referenced by the records. Strings are stored as UTF-16 in little
+  endian byte order.
+
+  The file starts with a header consisting of a magic number, a version, the
+  number of records, data specific to the type of table and the offset of
+  the strings. Each record starts with offset and length of its name. The
+  rest of the record is encoded by the user of the table.
+
+  A new file is written by calling beginWrite(), adding the records sorted
+  by name with the append functions and calling commit().
+*/
+class MappedTable
+{
+  public:
+    /**
+      Create table kept in the given file.
+      
+      \param filename name of file
+      \param magic magic number identifying the type of table
+      \param version version of the record format
+      \param headerDataSize size of type specific data in the header
+      \param recordSize size of a record including name offset and length
+    */
+    MappedTable( const QString &filename, quint32 magic, quint32 version,
+      int headerDataSize, int recordSize );
+    ~MappedTable();
+
+    QString filename() const { return mFilename; }
+
+    /**
+      Map table file.
+      
+      \return \c true on success, \c false if the file doesn't exist or isn't
+        valid
+    */
+    bool open();
+    /**
+      Unmap and close the table file.
+    */
+    void unmap();
+
+    /**
+      Return number of records in the mapped file.
+    */
+    int count() const { return mCount; }
+    /**
+      Return index of record with the given name or -1, if there is no such
+      record.
+    */
+    int find( const QString &name ) const;
+    /**
+      Return name of record.
+    */
+    QString name( int record ) const;
+    /**
+      Return names of all records.
+    */
+    QStringList names() const;
+    /**
+      Return data of record. The first eight bytes hold the name.
+    */
+    const uchar *record( int record ) const;
+    /**
+      Return string of the mapped file. An empty string is returned, if the
+      string isn't in the file.
+    */
+    QString string( quint32 offset, quint32 length ) const;
+    /**
+      Return type specific data of the header.
+    */
+    QByteArray headerData() const;
+    /**
+      Write type specific data of the header to the existing file in place,
+      so the directory of the file isn't modified by this.
+      
+      \return \c true on success, \c false on error
+    */
+    bool writeHeaderData( const QByteArray &data );
+
+    /**
+      Start writing a new file.
+      
+      \param count number of records
+      \param headerData type specific data of the header
+    */
+    void beginWrite( int count, const QByteArray &headerData );
+    /**
+      Append offset and length of a string to the current record and the
+      string to the strings of the file.
+    */
+    void appendString( const QString &string );
+    void appendUInt32( quint32 value );
+    void appendInt64( qint64 value );
+    /**
+      Append data padded with zeros or truncated to the given size.
+    */
+    void appendBytes( const QByteArray &data, int size );
+    /**
+      Replace the table file by the written data and map the new file. On
+      error the records of the old file stay mapped.
+      
+      \return \c true on success, \c false on error
+    */
+    bool commit();
+
+  protected:
+    int compareName( int record, const QString &name ) const;
+
+  private:
+    QString mFilename;
+    quint32 mMagic;
+    quint32 mVersion;
+    int mHeaderDataSize;
+    int mRecordSize;
+
+    QFile mFile;
+    const uchar *mData;
+    quint32 mCount;
+
+    QByteArray mRecords;
+    QByteArray mStrings;
+    quint32 mStringsOffset;
+};
+
+#endif
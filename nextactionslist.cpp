@@ -18,65 +18,165 @@
 
 #include "nextactionslist.h"
 
+#include "topicmanager.h"
+#include "todoindex.h"
+#include "todoodle.h"
 #include "hypertextedit.h"
+#include "topicloader.h"
 #include "dbg.h"
 
-#include <QTextEdit>
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QCheckBox>
 #include <QBoxLayout>
 #include <QPushButton>
+#include <QTextDocument>
 #include <QTextBlock>
 #include <QTextCursor>
-#include <QTextDocumentFragment>
+#include <QFont>
 
-NextActionsList::NextActionsList()
-  : QWidget( 0 )
+NextActionsList::NextActionsList( TopicManager *topicManager,
+  QWidget *parent )
+  : QWidget( parent ), mTopicManager( topicManager )
 {
+  setWindowTitle( "Next Actions - Todoodle" );
+
   QBoxLayout *topLayout = new QVBoxLayout( this );
   
-  mTextEdit = new QTextEdit( this );
-  topLayout->addWidget( mTextEdit );
-  mTextEdit->setReadOnly( true );
+  mListView = new QTreeWidget( this );
+  mListView->setColumnCount( 1 );
+  mListView->header()->hide();
+  topLayout->addWidget( mListView );
+  connect( mListView, SIGNAL( itemActivated( QTreeWidgetItem *, int ) ),
+    SLOT( slotItemActivated( QTreeWidgetItem * ) ) );
 
   QBoxLayout *buttonLayout = new QHBoxLayout;
   topLayout->addLayout( buttonLayout );
 
+  mShowDoneCheck = new QCheckBox( "Show &done items", this );
+  buttonLayout->addWidget( mShowDoneCheck );
+  connect( mShowDoneCheck, SIGNAL( toggled( bool ) ), SLOT( refreshList() ) );
+
   buttonLayout->addStretch( 1 );
 
-  QPushButton *button = new QPushButton( "Refresh", this );
-  buttonLayout->addWidget( button );
-  connect( button, SIGNAL( clicked() ), SLOT( refreshList() ) );
-  
-  button = new QPushButton( "Close", this );
+  QPushButton *button = new QPushButton( "C&lose", this );
   buttonLayout->addWidget( button );
   connect( button, SIGNAL( clicked() ), SLOT( close() ) );
+
+  connect( mTopicManager->todoIndex(),
+    SIGNAL( todosChanged( const QString & ) ),
+    SLOT( slotTodosChanged( const QString & ) ) );
+
+  resize( 500, 400 );
+
+  refreshList();
 }
 
-void NextActionsList::addEditor( HyperTextEdit *editor )
+void NextActionsList::refreshList()
 {
-  mEditors.append( editor );
+  mListView->clear();
+  mTopicItems.clear();
+
+  foreach( QString topic, mTopicManager->todoIndex()->topics() ) {
+    updateTopic( topic );
+  }
 }
 
-void NextActionsList::refreshList()
+QTreeWidgetItem *NextActionsList::topicItem( const QString &topic ) const
 {
-  mTextEdit->clear();
-
-  foreach( HyperTextEdit *editor, mEditors ) {
-    QTextDocument *doc = editor->document();
-    QTextBlock firstBlock = doc->begin();
-    QTextCursor cursor( doc );
-    cursor.setPosition( firstBlock.position() );
-    cursor.select( QTextCursor::BlockUnderCursor );
-    mTextEdit->textCursor().insertFragment( QTextDocumentFragment( cursor ) );
-    
-    QTextBlock block;
-    for( block = firstBlock.next(); block.isValid(); block = block.next() ) {
-      QString text = block.text();
-      if ( text.contains( 0xfffc ) ) {
-        cursor.setPosition( block.position() );
-        cursor.select( QTextCursor::BlockUnderCursor );
-        mTextEdit->textCursor().insertFragment(
-          QTextDocumentFragment( cursor ) );
+  return mTopicItems.value( topic );
+}
+
+void NextActionsList::updateTopic( const QString &topic )
+{
+  QList<QTreeWidgetItem *> children;
+  foreach( Format::Todo todo, mTopicManager->todoIndex()->todos( topic ) ) {
+    if ( todo.done && !mShowDoneCheck->isChecked() ) continue;
+
+    QTreeWidgetItem *child = new QTreeWidgetItem;
+    child->setText( 0, todo.text );
+    child->setData( 0, Qt::UserRole, todo.position );
+    if ( todo.done ) {
+      QFont font = child->font( 0 );
+      font.setStrikeOut( true );
+      child->setFont( 0, font );
+    }
+    children.append( child );
+  }
+
+  QTreeWidgetItem *item = topicItem( topic );
+
+  if ( children.isEmpty() ) {
+    if ( item ) {
+      mTopicItems.remove( topic );
+      delete item;
+    }
+    return;
+  }
+
+  if ( item ) {
+    qDeleteAll( item->takeChildren() );
+  } else {
+    item = new QTreeWidgetItem;
+    item->setText( 0, topic );
+    QFont font = item->font( 0 );
+    font.setBold( true );
+    item->setFont( 0, font );
+
+    // Keep topics sorted by name. When the list is rebuilt, topics come in
+    // order and are appended.
+    int count = mListView->topLevelItemCount();
+    if ( count == 0 ||
+         mListView->topLevelItem( count - 1 )->text( 0 ) < topic ) {
+      mListView->addTopLevelItem( item );
+    } else {
+      int low = 0;
+      int high = count;
+      while ( low < high ) {
+        int middle = ( low + high ) / 2;
+        if ( mListView->topLevelItem( middle )->text( 0 ) < topic ) {
+          low = middle + 1;
+        } else {
+          high = middle;
+        }
       }
+      mListView->insertTopLevelItem( low, item );
     }
+    mTopicItems.insert( topic, item );
+  }
+
+  item->addChildren( children );
+  item->setExpanded( true );
+}
+
+void NextActionsList::slotTodosChanged( const QString &topic )
+{
+  updateTopic( topic );
+}
+
+void NextActionsList::slotItemActivated( QTreeWidgetItem *item )
+{
+  QTreeWidgetItem *parent = item->parent();
+  if ( !parent ) return;
+
+  QString topic = parent->text( 0 );
+
+  Todoodle *t = mTopicManager->editor( topic );
+  t->show();
+  t->raise();
+
+  TopicLoader *loader = mTopicManager->loader( topic );
+  if ( loader ) loader->finish();
+
+  // The position recorded in the index is outdated, if the topic was changed
+  // since it was last saved. Fall back to searching for the text then.
+  int position = item->data( 0, Qt::UserRole ).toInt();
+  QTextDocument *document = t->editor()->document();
+  QTextBlock block = document->findBlock( position );
+  if ( !block.text().contains( item->text( 0 ).left( 20 ) ) ) {
+    QTextCursor cursor = document->find( item->text( 0 ) );
+    if ( !cursor.isNull() ) position = cursor.block().position();
   }
+
+  t->showPosition( position );
 }
@@ -19,30 +19,56 @@
 #define NEXTACTIONSLIST_H
 
 #include <QWidget>
+#include <QHash>
 
-class QTextEdit;
-class HyperTextEdit;
+class TopicManager;
 
-/**
-  This class provides a view on "next actions" extracted from topic data.
+class QTreeWidget;
+class QTreeWidgetItem;
+class QCheckBox;
 
-  It's work in progress.
+/**
+  This class provides a view on the "next actions" of all topics, the todo
+  items which aren't done yet. The items are taken from the todo index of the
+  topic manager and the view is updated whenever the items of a topic change.
+  Activating an item shows it in the editor of its topic.
 */
 class NextActionsList : public QWidget
 {
     Q_OBJECT
   public:
-    NextActionsList();
-
-    void addEditor( HyperTextEdit * );
+    NextActionsList( TopicManager *, QWidget *parent = 0 );
 
   public slots:
+    /**
+      Rebuild the list from the todo index.
+    */
     void refreshList();
 
+  protected:
+    /**
+      Fill item of topic with the todo items of the topic. The item is
+      created, if it doesn't exist yet, and removed, if there are no items
+      to be shown.
+    */
+    void updateTopic( const QString &topic );
+
+    /**
+      Return item of topic or 0, if the topic isn't shown.
+    */
+    QTreeWidgetItem *topicItem( const QString &topic ) const;
+
+  protected slots:
+    void slotTodosChanged( const QString &topic );
+    void slotItemActivated( QTreeWidgetItem *item );
+
   private:
-    QTextEdit *mTextEdit;
-    
-    QList<HyperTextEdit *> mEditors;
+    TopicManager *mTopicManager;
+
+    QTreeWidget *mListView;
+    QCheckBox *mShowDoneCheck;
+
+    QHash<QString, QTreeWidgetItem *> mTopicItems;
 };
 
 #endif
@@ -21,16 +21,22 @@
 #include "prefs.h"
 
 #include <QSettings>
+#include <QStringList>
+#include <QMap>
+#include <QVariant>
 
 Prefs::Prefs( const QString &topicDir )
 {
   mSettings = new QSettings( "kde.org", "todoodle" );
   mSettings->beginGroup( topicDir );
 
+  mStateStore = new TopicStateStore( topicDir + ".topicstate" );
+  if ( !mStateStore->open() ) mStateStore->migrate( mSettings );
 }
 
 Prefs::~Prefs()
 {
+  delete mStateStore;
   delete mSettings;
 }
 
@@ -43,3 +49,52 @@ QString Prefs::startTopic() const
 {
   return mSettings->value( "startTopic" ).toString();
 }
+
+void Prefs::setBinaryFormat( bool binary )
+{
+  mSettings->setValue( "binaryFormat", binary );
+}
+
+bool Prefs::binaryFormat() const
+{
+  return mSettings->value( "binaryFormat", false ).toBool();
+}
+
+void Prefs::renameTopic( const QString &from, const QString &to )
+{
+  mSettings->beginGroup( from );
+  QStringList keys = mSettings->allKeys();
+  QMap<QString, QVariant> values;
+  foreach( QString key, keys ) values.insert( key, mSettings->value( key ) );
+  mSettings->endGroup();
+
+  mSettings->remove( from );
+
+  mSettings->beginGroup( to );
+  QMap<QString, QVariant>::const_iterator it;
+  for( it = values.constBegin(); it != values.constEnd(); ++it ) {
+    mSettings->setValue( it.key(), it.value() );
+  }
+  mSettings->endGroup();
+
+  mStateStore->rename( from, to );
+
+  if ( startTopic() == from ) setStartTopic( to );
+}
+
+void Prefs::removeTopic( const QString &topic )
+{
+  mSettings->remove( topic );
+  mStateStore->remove( topic );
+}
+
+TopicStateStore::State Prefs::topicState( const QString &topic ) const
+{
+  return mStateStore->state( topic );
+}
+
+void Prefs::setTopicState( const QString &topic,
+  const TopicStateStore::State &state )
+{
+  mStateStore->setState( topic, state );
+}
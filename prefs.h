@@ -20,6 +20,8 @@
 #ifndef PREFS_H
 #define PREFS_H
 
+#include "topicstatestore.h"
+
 #include <QString>
 
 class QSettings;
@@ -49,6 +51,38 @@ class Prefs
     */
     QString startTopic() const;
 
+    /**
+      Set, if new topics are stored in the binary format.
+    */
+    void setBinaryFormat( bool );
+    /**
+      Return, if new topics are stored in the binary format.
+    */
+    bool binaryFormat() const;
+
+    /**
+      Move all preferences stored for a topic to a new name of the topic.
+      
+      \param from old name of topic
+      \param to new name of topic
+    */
+    void renameTopic( const QString &from, const QString &to );
+    /**
+      Remove all preferences stored for a topic.
+    */
+    void removeTopic( const QString &topic );
+
+    /**
+      Return state of the user interface for a topic, like the geometry of its
+      window or its position on the topic map.
+    */
+    TopicStateStore::State topicState( const QString &topic ) const;
+    /**
+      Set state of the user interface for a topic.
+    */
+    void setTopicState( const QString &topic,
+      const TopicStateStore::State &state );
+
     /**
       Return QSettings object which is used to store the preferences data.
     */
@@ -56,6 +90,7 @@ class Prefs
         
   private:
     QSettings *mSettings;
+    TopicStateStore *mStateStore;
 };
 
 #endif
@@ -0,0 +1,222 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "savequeue.h"
+
+#include "dbg.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutexLocker>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#endif
+
+SaveQueue::SaveQueue( QObject *parent )
+  : QThread( parent ), mStop( false )
+{
+  start();
+}
+
+SaveQueue::~SaveQueue()
+{
+  mMutex.lock();
+  mStop = true;
+  mJobAvailable.wakeAll();
+  mMutex.unlock();
+
+  wait();
+}
+
+void SaveQueue::enqueue( const QString &filename,
+  const QList<QByteArray> &segments, int revision )
+{
+  QMutexLocker locker( &mMutex );
+
+  Job job;
+  job.segments = segments;
+  job.revision = revision;
+
+  if ( !mJobs.contains( filename ) ) mPending.append( filename );
+  mJobs.insert( filename, job );
+
+  mJobAvailable.wakeOne();
+}
+
+void SaveQueue::waitFor( const QString &filename )
+{
+  QMutexLocker locker( &mMutex );
+
+  while( mJobs.contains( filename ) || mCurrent == filename ) {
+    mJobDone.wait( &mMutex );
+  }
+}
+
+void SaveQueue::waitForDone()
+{
+  QMutexLocker locker( &mMutex );
+
+  while( !mPending.isEmpty() || !mCurrent.isEmpty() ) {
+    mJobDone.wait( &mMutex );
+  }
+}
+
+void SaveQueue::run()
+{
+  mMutex.lock();
+
+  forever {
+    while( mPending.isEmpty() && !mStop ) {
+      mJobAvailable.wait( &mMutex );
+    }
+    if ( mPending.isEmpty() ) break;
+
+    QString filename = mPending.takeFirst();
+    Job job = mJobs.take( filename );
+    mCurrent = filename;
+
+    mMutex.unlock();
+
+    bool success = writeFile( filename, job.segments );
+    QByteArray identity;
+    if ( success ) identity = fileIdentity( filename );
+    emit saved( filename, success, job.revision, identity );
+
+    mMutex.lock();
+
+    mCurrent.clear();
+    mJobDone.wakeAll();
+  }
+
+  mMutex.unlock();
+}
+
+bool SaveQueue::writeFile( const QString &filename,
+  const QList<QByteArray> &segments )
+{
+  QFile file( temporaryFilename( filename ) );
+  if ( !file.open( QIODevice::WriteOnly ) ) {
+    dbg() << "SaveQueue: Unable to open '" << file.fileName() << "'" << endl;
+    return false;
+  }
+
+  foreach( QByteArray segment, segments ) {
+    if ( file.write( segment ) != segment.size() ) {
+      dbg() << "SaveQueue: Error writing '" << file.fileName() << "'" << endl;
+      file.close();
+      file.remove();
+      return false;
+    }
+  }
+
+  return replaceFile( file, filename );
+}
+
+QString SaveQueue::temporaryFilename( const QString &filename )
+{
+  return filename + ".new";
+}
+
+bool SaveQueue::replaceFile( QFile &file, const QString &filename )
+{
+  if ( !file.flush() ) {
+    file.close();
+    file.remove();
+    return false;
+  }
+
+#ifdef Q_OS_WIN
+  bool synced = _commit( file.handle() ) == 0;
+#else
+  bool synced = fsync( file.handle() ) == 0;
+#endif
+  file.close();
+
+  if ( !synced ) {
+    dbg() << "SaveQueue: Unable to sync '" << file.fileName() << "'" << endl;
+    file.remove();
+    return false;
+  }
+
+#ifdef Q_OS_WIN
+  bool renamed = MoveFileExW( (LPCWSTR)file.fileName().utf16(),
+    (LPCWSTR)filename.utf16(),
+    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+#else
+  bool renamed = ::rename( QFile::encodeName( file.fileName() ),
+    QFile::encodeName( filename ) ) == 0;
+
+  // Make sure the rename itself is on disk
+  if ( renamed ) {
+    int dir = ::open( QFile::encodeName( QFileInfo( filename ).absolutePath() ),
+      O_RDONLY );
+    if ( dir >= 0 ) {
+      fsync( dir );
+      ::close( dir );
+    }
+  }
+#endif
+
+  if ( !renamed ) {
+    dbg() << "SaveQueue: Unable to rename '" << file.fileName() << "' to '"
+      << filename << "'" << endl;
+    file.remove();
+    return false;
+  }
+
+  return true;
+}
+
+QByteArray SaveQueue::fileIdentity( const QString &filename )
+{
+  QFileInfo fi( filename );
+  if ( !fi.exists() ) return QByteArray();
+
+  QByteArray identity = QByteArray::number( fi.size() ) + ':' +
+    QByteArray::number( fi.lastModified().toTime_t() );
+
+#ifndef Q_OS_WIN
+  // The modification time has a resolution of one second. Add the fraction
+  // of the second and the inode, so that a file replaced twice within one
+  // second gets a new identity.
+  struct stat st;
+  if ( ::stat( QFile::encodeName( filename ), &st ) == 0 ) {
+#ifdef Q_OS_MAC
+    long nanoseconds = st.st_mtimespec.tv_nsec;
+#else
+    long nanoseconds = st.st_mtim.tv_nsec;
+#endif
+    identity += ':' + QByteArray::number( qint64( nanoseconds ) ) + ':' +
+      QByteArray::number( quint64( st.st_ino ) );
+  }
+#else
+  identity += ':' + QByteArray::number( fi.lastModified().time().msec() );
+#endif
+
+  return identity;
+}
@@ -0,0 +1,146 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef SAVEQUEUE_H
+#define SAVEQUEUE_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QMap>
+#include <QList>
+#include <QByteArray>
+
+class QFile;
+
+/**
+  This class writes topic data to disk in a background thread. The data is
+  handed over as a snapshot of serialized segments, so the document can be
+  edited while the data is written. Files are replaced atomically by writing
+  a temporary file which is synced to disk and then renamed to the target
+  file.
+
+  If data for a file is queued while older data for the same file is still
+  waiting to be written, only the newer data is written.
+
+  Each chunk of data can carry a revision number, which is reported back
+  together with the identity of the written file, when the data is on disk.
+*/
+class SaveQueue : public QThread
+{
+    Q_OBJECT
+  public:
+    /**
+      Create save queue. The worker thread is started immediately.
+      
+      \param parent parent object
+    */
+    SaveQueue( QObject *parent = 0 );
+    /**
+      Write all queued data and stop the worker thread.
+    */
+    ~SaveQueue();
+
+    /**
+      Queue data for writing it to the given file.
+      
+      \param filename name of file
+      \param segments data to be written
+      \param revision revision of the data, reported back by saved()
+    */
+    void enqueue( const QString &filename, const QList<QByteArray> &segments,
+      int revision = 0 );
+
+    /**
+      Block until all data queued for the given file is written.
+      
+      \param filename name of file
+    */
+    void waitFor( const QString &filename );
+    /**
+      Block until all queued data is written.
+    */
+    void waitForDone();
+
+    /**
+      Write data to file and atomically replace the file.
+      
+      \param filename name of file
+      \param segments data to be written
+      \return \c true on success, \c false on error
+    */
+    static bool writeFile( const QString &filename,
+      const QList<QByteArray> &segments );
+
+    /**
+      Return name of temporary file used for writing the given file.
+    */
+    static QString temporaryFilename( const QString &filename );
+    /**
+      Sync temporary file to disk, close it and rename it to the given
+      filename. On error the temporary file is removed.
+      
+      \param temporaryFile file opened for writing by temporaryFilename()
+      \param filename name of file to be replaced
+      \return \c true on success, \c false on error
+    */
+    static bool replaceFile( QFile &temporaryFile, const QString &filename );
+
+    /**
+      Return identity of the given file, which changes whenever the file is
+      replaced. Returns an empty identity, if the file doesn't exist.
+    */
+    static QByteArray fileIdentity( const QString &filename );
+
+  signals:
+    /**
+      Emitted from the worker thread when data was written to a file.
+      
+      \param filename name of file
+      \param success \c true, if the data was written successfully
+      \param revision revision of the written data as given to enqueue()
+      \param identity identity of the written file as returned by
+        fileIdentity()
+    */
+    void saved( const QString &filename, bool success, int revision,
+      const QByteArray &identity );
+
+  protected:
+    void run();
+
+  private:
+    struct Job
+    {
+      QList<QByteArray> segments;
+      int revision;
+    };
+
+    QMutex mMutex;
+    QWaitCondition mJobAvailable;
+    QWaitCondition mJobDone;
+
+    QStringList mPending;
+    QMap<QString, Job> mJobs;
+    QString mCurrent;
+
+    bool mStop;
+};
+
+#endif
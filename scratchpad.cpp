@@ -113,6 +113,11 @@ void ScratchPad::save( const QString &filename )
   mScratchWidget->save( filename );
 }
 
+void ScratchPad::setFilename( const QString &filename )
+{
+  mScratchWidget->setFilename( filename );
+}
+
 void ScratchPad::clear()
 {
   mScratchWidget->clearScreen();
@@ -53,6 +53,13 @@ class ScratchPad : public QWidget
       \param fielname name of file
     */
     void save( const QString &filename );
+    /**
+      Set name of file the scratch pad data is read from, when the file was
+      moved.
+      
+      \param filename name of file
+    */
+    void setFilename( const QString &filename );
 
   public slots:
     /**
@@ -36,31 +36,195 @@
 #include <qcursor.h>
 #include <qimage.h>
 #include <qpixmap.h>
+#include <qpainterpath.h>
 
 #include <QVector>
+#include <QFile>
+#include <QBuffer>
+#include <QDataStream>
+
+#include "savequeue.h"
+
+static const quint32 scratchPadMagic = 0x54445350;
+static const quint32 scratchPadVersion = 1;
+static const int tileSize = 128;
 
 ScratchWidget::ScratchWidget( QWidget *parent )
     : QWidget( parent ), pen( Qt::black, 2 ), polyline( 3 ),
-      mousePressed( false ), buffer( width(), height() )
+      mousePressed( false ), fileRead( true ), modified( false )
 {
-  buffer.fill( palette().base().color() );
   setCursor( Qt::CrossCursor );
 }
 
-void ScratchWidget::save( const QString &filename )
+quint32 ScratchWidget::tileKey( int column, int row )
 {
-  buffer.save( filename, "PNG" );
+  return quint32( column ) << 16 | quint32( row );
 }
 
 void ScratchWidget::load( const QString &filename )
 {
-  // FIXME: Why does the load crash when called for the second time?
-//  buffer.load( filename );
+  tiles.clear();
+  dataFilename = filename;
+  fileRead = false;
+  modified = false;
+
+  update();
+}
+
+void ScratchWidget::setFilename( const QString &filename )
+{
+  dataFilename = filename;
+}
+
+void ScratchWidget::readFile()
+{
+  if ( fileRead ) return;
+  fileRead = true;
+
+  QFile file( dataFilename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return;
+
+  QByteArray data = file.readAll();
+  file.close();
+
+  if ( data.startsWith( "\x89PNG" ) ) {
+    readImage( QImage::fromData( data, "PNG" ) );
+    return;
+  }
+
+  QDataStream stream( data );
+  stream.setVersion( QDataStream::Qt_4_0 );
+
+  quint32 magic, version, size, count;
+  stream >> magic >> version >> size >> count;
+  if ( magic != scratchPadMagic || version != scratchPadVersion ||
+       size != quint32( tileSize ) ) {
+    qWarning( "Unsupported scratch pad file '%s'.",
+      qPrintable( dataFilename ) );
+    return;
+  }
+
+  for( quint32 i = 0; i < count; ++i ) {
+    quint32 column, row, length;
+    stream >> column >> row >> length;
+    if ( stream.status() != QDataStream::Ok ||
+         length > quint32( data.size() ) ) break;
+
+    Tile tile;
+    tile.encoded.resize( length );
+    if ( stream.readRawData( tile.encoded.data(), length ) != int( length ) ) {
+      break;
+    }
+    tiles.insert( tileKey( column, row ), tile );
+  }
+}
+
+void ScratchWidget::readImage( const QImage &image )
+{
+  QRgb background = palette().base().color().rgb();
+
+  for( int row = 0; row * tileSize < image.height(); ++row ) {
+    for( int column = 0; column * tileSize < image.width(); ++column ) {
+      QImage part = image.copy( column * tileSize, row * tileSize,
+        tileSize, tileSize ).convertToFormat( QImage::Format_RGB32 );
+
+      // Don't keep tiles nothing was drawn on
+      bool empty = true;
+      for( int y = 0; y < part.height() && empty; ++y ) {
+        const QRgb *line = reinterpret_cast<const QRgb *>( part.scanLine( y ) );
+        for( int x = 0; x < part.width(); ++x ) {
+          if ( line[ x ] != background ) {
+            empty = false;
+            break;
+          }
+        }
+      }
+      if ( empty ) continue;
+
+      // The tile is encoded, when the file is written in the new format
+      Tile tile;
+      tile.image = part;
+      tiles.insert( tileKey( column, row ), tile );
+    }
+  }
+}
+
+QImage *ScratchWidget::tileImage( int column, int row, bool create )
+{
+  if ( column < 0 || row < 0 ) return 0;
+
+  QHash<quint32, Tile>::iterator it = tiles.find( tileKey( column, row ) );
+  if ( it == tiles.end() ) {
+    if ( !create ) return 0;
+
+    Tile tile;
+    tile.image = QImage( tileSize, tileSize, QImage::Format_RGB32 );
+    tile.image.fill( palette().base().color().rgb() );
+    it = tiles.insert( tileKey( column, row ), tile );
+  } else if ( it.value().image.isNull() ) {
+    it.value().image = QImage::fromData( it.value().encoded, "PNG" )
+      .convertToFormat( QImage::Format_RGB32 );
+    if ( it.value().image.isNull() ) {
+      qWarning( "Unable to decode scratch pad tile in '%s'.",
+        qPrintable( dataFilename ) );
+      tiles.erase( it );
+      return 0;
+    }
+  }
+
+  return &it.value().image;
+}
+
+void ScratchWidget::save( const QString &filename )
+{
+  if ( !modified ) return;
+
+  if ( tiles.isEmpty() ) {
+    QFile::remove( filename );
+    modified = false;
+    return;
+  }
+
+  QList<QByteArray> segments;
+
+  QByteArray header;
+  QDataStream stream( &header, QIODevice::WriteOnly );
+  stream.setVersion( QDataStream::Qt_4_0 );
+  stream << scratchPadMagic << scratchPadVersion << quint32( tileSize )
+         << quint32( tiles.count() );
+  segments.append( header );
+
+  QHash<quint32, Tile>::iterator it;
+  for( it = tiles.begin(); it != tiles.end(); ++it ) {
+    Tile &tile = it.value();
+    if ( tile.encoded.isEmpty() ) {
+      QBuffer buffer( &tile.encoded );
+      buffer.open( QIODevice::WriteOnly );
+      tile.image.save( &buffer, "PNG" );
+    }
+
+    QByteArray tileHeader;
+    QDataStream tileStream( &tileHeader, QIODevice::WriteOnly );
+    tileStream.setVersion( QDataStream::Qt_4_0 );
+    tileStream << quint32( it.key() >> 16 ) << quint32( it.key() & 0xffff )
+               << quint32( tile.encoded.size() );
+    segments.append( tileHeader );
+    segments.append( tile.encoded );
+  }
+
+  if ( SaveQueue::writeFile( filename, segments ) ) {
+    modified = false;
+  } else {
+    qWarning( "Unable to write scratch pad '%s'.", qPrintable( filename ) );
+  }
 }
 
 void ScratchWidget::clearScreen()
 {
-  buffer.fill( palette().base().color() );
+  if ( !fileRead || !tiles.isEmpty() ) modified = true;
+
+  tiles.clear();
+  fileRead = true;
   update();
 }
 
@@ -78,56 +242,80 @@ void ScratchWidget::mouseReleaseEvent( QMouseEvent * )
 void ScratchWidget::mouseMoveEvent( QMouseEvent *e )
 {
   if ( mousePressed ) {
-    QPainter painter;
-    painter.begin( &buffer );
-    painter.setPen( pen );
+    readFile();
+
     polyline[2] = polyline[1];
     polyline[1] = polyline[0];
     polyline[0] = e->pos();
-    painter.drawPolyline( polyline );
-    painter.end();
-
-    // FIXME(after beta1)
-    QRect r( polyline.boundingRect().x(),
-             polyline.boundingRect().y(),
-             polyline.boundingRect().width(),
-             polyline.boundingRect().height());
-    r = r.normalized();
-    r.setLeft( r.left() - penWidth() );
-    r.setTop( r.top() - penWidth() );
-    r.setRight( r.right() + penWidth() );
-    r.setBottom( r.bottom() + penWidth() );
 
-    update( r );
-  }
-}
+    QRect r = polyline.boundingRect().normalized();
+    r.adjust( -penWidth(), -penWidth(), penWidth(), penWidth() );
 
-void ScratchWidget::resizeEvent( QResizeEvent *e )
-{
-  QWidget::resizeEvent( e );
+    // There are no tiles left of or above the origin
+    if ( r.right() < 0 || r.bottom() < 0 ) return;
 
-  int w = width() > buffer.width() ?
-          width() : buffer.width();
-  int h = height() > buffer.height() ?
-          height() : buffer.height();
+    QPainterPath path( polyline.at( 2 ) );
+    path.lineTo( polyline.at( 1 ) );
+    path.lineTo( polyline.at( 0 ) );
+    QPainterPathStroker stroker;
+    stroker.setWidth( 2 * penWidth() );
+    QPainterPath stroke = stroker.createStroke( path );
 
-  QPixmap tmp( buffer );
-  buffer = QPixmap( w, h );
-  buffer.fill( palette().base().color() );
+    // Draw on the tiles touched by the line only, not on all tiles in its
+    // bounding rectangle
+    for( int row = qMax( r.top(), 0 ) / tileSize;
+         row <= r.bottom() / tileSize; ++row ) {
+      for( int column = qMax( r.left(), 0 ) / tileSize;
+           column <= r.right() / tileSize; ++column ) {
+        QRectF tileRect( column * tileSize, row * tileSize, tileSize,
+                         tileSize );
+        if ( !stroke.intersects( tileRect ) ) continue;
 
-  QPainter p( &buffer );
-  p.drawPixmap( 0, 0, tmp );
+        QImage *image = tileImage( column, row, true );
+        if ( !image ) continue;
+
+        QPainter painter( image );
+        painter.translate( -column * tileSize, -row * tileSize );
+        painter.setPen( pen );
+        painter.drawPolyline( polyline );
+        painter.end();
+
+        tiles[ tileKey( column, row ) ].encoded.clear();
+        modified = true;
+      }
+    }
+
+    update( r );
+  }
 }
 
 void ScratchWidget::paintEvent( QPaintEvent *e )
 {
   QWidget::paintEvent( e );
 
+  readFile();
+
   QPainter p( this );
 
+  QColor background = palette().base().color();
+
   QVector<QRect> rects = e->region().rects();
   for ( int i = 0; i < rects.count(); i++ ) {
     QRect r = rects[(int)i];
-    p.drawPixmap( r.x(), r.y(), buffer, r.x(), r.y(), r.width(), r.height() );
+    for( int row = r.top() / tileSize; row <= r.bottom() / tileSize; ++row ) {
+      for( int column = r.left() / tileSize; column <= r.right() / tileSize;
+           ++column ) {
+        QRect tileRect( column * tileSize, row * tileSize, tileSize,
+                        tileSize );
+        QRect target = tileRect & r;
+        QImage *image = tileImage( column, row, false );
+        if ( image ) {
+          p.drawImage( target, *image,
+            target.translated( -tileRect.topLeft() ) );
+        } else {
+          p.fillRect( target, background );
+        }
+      }
+    }
   }
 }
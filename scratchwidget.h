@@ -22,13 +22,15 @@
 
 #include <qpen.h>
 #include <qpoint.h>
-#include <qpixmap.h>
 #include <qwidget.h>
 #include <qstring.h>
 #include <qpolygon.h>
+#include <qimage.h>
+
+#include <QHash>
+#include <QByteArray>
 
 class QMouseEvent;
-class QResizeEvent;
 class QPaintEvent;
 class QToolButton;
 class QSpinBox;
@@ -36,6 +38,13 @@ class QSpinBox;
 /**
   This class provides a scratch pad area. It's used by ScratchPad to provide a
   full scratch pad including controls.
+
+  The drawing is kept in square tiles, which are only allocated, when
+  something is drawn on them. In the scratch pad file each tile is stored as
+  a separate PNG image. Tiles are decoded when they are first shown and only
+  tiles which were drawn on are encoded again on save. The file is read when
+  the scratch pad is first shown and is only written, if something was
+  changed.
 */
 class ScratchWidget : public QWidget
 {
@@ -75,17 +84,26 @@ class ScratchWidget : public QWidget
     { return pen.width(); }
 
     /**
-      Load scratch pad data from file.
+      Load scratch pad data from file. The file is read when the data is
+      needed.
       
       \param filename name of file.
     */
     void load( const QString &filename );
     /**
-      Save scratch pad data to file.
+      Save scratch pad data to file. Nothing is written, if the data wasn't
+      changed since it was loaded or saved the last time.
       
       \param filename name of file.
     */
     void save( const QString &filename );
+    /**
+      Set name of file the scratch pad data is read from, when the file was
+      moved. The data isn't reloaded.
+      
+      \param filename name of file.
+    */
+    void setFilename( const QString &filename );
 
     /**
       Clear scratch pad area.
@@ -96,16 +114,40 @@ class ScratchWidget : public QWidget
     void mousePressEvent( QMouseEvent *e );
     void mouseReleaseEvent( QMouseEvent *e );
     void mouseMoveEvent( QMouseEvent *e );
-    void resizeEvent( QResizeEvent *e );
     void paintEvent( QPaintEvent *e );
 
+    /**
+      Read tiles from file given to load(), if this wasn't done yet.
+    */
+    void readFile();
+    /**
+      Split image of the old single image file format into tiles.
+    */
+    void readImage( const QImage &image );
+    /**
+      Return image of tile. It's decoded, if necessary. If \a create is true
+      missing tiles are created.
+    */
+    QImage *tileImage( int column, int row, bool create );
+    static quint32 tileKey( int column, int row );
+
+    struct Tile
+    {
+      QImage image;
+      // PNG data of the tile, empty if it has to be encoded again
+      QByteArray encoded;
+    };
+
     QPen pen;
 
     QPolygon polyline;
 
     bool mousePressed;
 
-    QPixmap buffer;
+    QHash<quint32, Tile> tiles;
+    QString dataFilename;
+    bool fileRead;
+    bool modified;
 };
 
 #endif
@@ -0,0 +1,418 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "searchindex.h"
+
+#include "format.h"
+#include "formatbinary.h"
+#include "savequeue.h"
+#include "dbg.h"
+
+#include <QFile>
+#include <QDataStream>
+#include <QTextDocument>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+
+#include <math.h>
+
+static const quint32 searchIndexMagic = 0x54445849;
+static const qint32 searchIndexVersion = 1;
+
+// Number of characters shown before and after the match in snippets
+static const int snippetContext = 40;
+
+/**
+  This class reads the plain text of one topic file.
+*/
+class IndexJob : public QRunnable
+{
+  public:
+    typedef QPair<QString, QByteArray> Text;
+
+    IndexJob( const QString &topic, const QString &filename,
+      QMap<QString, Text> *texts, QMutex *mutex )
+      : mTopic( topic ), mFilename( filename ), mTexts( texts ),
+        mMutex( mutex )
+    {
+    }
+
+    void run()
+    {
+      // Take the identity first, so a concurrent change of the file is
+      // detected later
+      QByteArray identity = SaveQueue::fileIdentity( mFilename );
+
+      QTextDocument document;
+      bool loaded;
+      if ( FormatBinary::isBinary( mFilename ) ) {
+        FormatBinary format( &document );
+        loaded = format.load( mFilename );
+      } else {
+        Format format( &document );
+        loaded = format.load( mFilename );
+      }
+      if ( !loaded ) {
+        qWarning( "Error indexing '%s'.", qPrintable( mFilename ) );
+        return;
+      }
+
+      QString text = document.toPlainText();
+
+      QMutexLocker locker( mMutex );
+      mTexts->insert( mTopic, Text( text, identity ) );
+    }
+
+  private:
+    QString mTopic;
+    QString mFilename;
+    QMap<QString, Text> *mTexts;
+    QMutex *mMutex;
+};
+
+/**
+  Return offset of the word with the given position in the text.
+*/
+static int wordOffset( const QString &text, int position )
+{
+  int count = 0;
+  int i = 0;
+  while( i < text.length() ) {
+    while( i < text.length() && !text.at( i ).isLetterOrNumber() ) ++i;
+    if ( i == text.length() ) break;
+    if ( count == position ) return i;
+    while( i < text.length() && text.at( i ).isLetterOrNumber() ) ++i;
+    ++count;
+  }
+  return 0;
+}
+
+static bool containsPosition( const QVector<int> &positions, int position )
+{
+  return qBinaryFind( positions.begin(), positions.end(), position ) !=
+    positions.end();
+}
+
+
+SearchIndex::SearchIndex( const QString &filename )
+  : mFilename( filename ), mModified( false ), mNextId( 0 )
+{
+}
+
+bool SearchIndex::load()
+{
+  QFile file( mFilename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return false;
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_0 );
+
+  quint32 magic;
+  qint32 version;
+  stream >> magic >> version;
+  if ( magic != searchIndexMagic || version != searchIndexVersion ) {
+    qWarning( "Unsupported search index '%s'.", qPrintable( mFilename ) );
+    return false;
+  }
+
+  mDocuments.clear();
+  mDocumentIds.clear();
+  mPostings.clear();
+
+  qint32 count;
+  stream >> count >> mNextId;
+  for( int i = 0; i < count; ++i ) {
+    qint32 id;
+    Document d;
+    stream >> id >> d.topic >> d.identity >> d.text >> d.length >> d.terms;
+    mDocuments.insert( id, d );
+    mDocumentIds.insert( d.topic, id );
+  }
+  stream >> mPostings;
+
+  if ( stream.status() != QDataStream::Ok ) {
+    qWarning( "Error reading search index '%s'.", qPrintable( mFilename ) );
+    mDocuments.clear();
+    mDocumentIds.clear();
+    mPostings.clear();
+    mNextId = 0;
+    return false;
+  }
+
+  mModified = false;
+
+  return true;
+}
+
+bool SearchIndex::save()
+{
+  if ( !mModified ) return true;
+
+  QFile file( SaveQueue::temporaryFilename( mFilename ) );
+  if ( !file.open( QIODevice::WriteOnly ) ) {
+    qWarning( "Unable to write search index '%s'.", qPrintable( mFilename ) );
+    return false;
+  }
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_0 );
+
+  stream << searchIndexMagic << searchIndexVersion;
+
+  stream << qint32( mDocuments.count() ) << qint32( mNextId );
+  QHash<int, Document>::const_iterator it;
+  for( it = mDocuments.constBegin(); it != mDocuments.constEnd(); ++it ) {
+    const Document &d = it.value();
+    stream << qint32( it.key() ) << d.topic << d.identity << d.text
+      << qint32( d.length ) << d.terms;
+  }
+  stream << mPostings;
+
+  if ( !SaveQueue::replaceFile( file, mFilename ) ) return false;
+
+  mModified = false;
+
+  return true;
+}
+
+void SearchIndex::update( const QString &topic, const QString &text,
+  const QByteArray &identity )
+{
+  remove( topic );
+
+  int id = mNextId++;
+
+  Document d;
+  d.topic = topic;
+  d.identity = identity;
+  d.text = text;
+
+  QStringList w = words( text );
+  d.length = w.count();
+
+  QHash<QString, QVector<int> > positions;
+  for( int i = 0; i < w.count(); ++i ) {
+    positions[ w.at( i ) ].append( i );
+  }
+
+  QHash<QString, QVector<int> >::const_iterator it;
+  for( it = positions.constBegin(); it != positions.constEnd(); ++it ) {
+    mPostings[ it.key() ].insert( id, it.value() );
+    d.terms.append( it.key() );
+  }
+
+  mDocuments.insert( id, d );
+  mDocumentIds.insert( topic, id );
+
+  mModified = true;
+}
+
+void SearchIndex::setIdentity( const QString &topic,
+  const QByteArray &identity )
+{
+  QHash<QString, int>::const_iterator it = mDocumentIds.find( topic );
+  if ( it == mDocumentIds.constEnd() ) return;
+
+  mDocuments[ it.value() ].identity = identity;
+  mModified = true;
+}
+
+QByteArray SearchIndex::identity( const QString &topic ) const
+{
+  QHash<QString, int>::const_iterator it = mDocumentIds.find( topic );
+  if ( it == mDocumentIds.constEnd() ) return QByteArray();
+
+  return mDocuments.value( it.value() ).identity;
+}
+
+void SearchIndex::remove( const QString &topic )
+{
+  QHash<QString, int>::iterator it = mDocumentIds.find( topic );
+  if ( it == mDocumentIds.end() ) return;
+
+  int id = it.value();
+  mDocumentIds.erase( it );
+
+  Document d = mDocuments.take( id );
+  foreach( QString term, d.terms ) {
+    QHash<QString, PostingList>::iterator p = mPostings.find( term );
+    if ( p == mPostings.end() ) continue;
+    p.value().remove( id );
+    if ( p.value().isEmpty() ) mPostings.erase( p );
+  }
+
+  mModified = true;
+}
+
+void SearchIndex::indexFiles( const QMap<QString, QString> &files )
+{
+  if ( files.isEmpty() ) return;
+
+  dbg() << "Indexing " << files.count() << " topics" << endl;
+
+  QMap<QString, IndexJob::Text> texts;
+  QMutex mutex;
+
+  QThreadPool pool;
+  QMap<QString, QString>::const_iterator it;
+  for( it = files.constBegin(); it != files.constEnd(); ++it ) {
+    pool.start( new IndexJob( it.key(), it.value(), &texts, &mutex ) );
+  }
+  pool.waitForDone();
+
+  QMap<QString, IndexJob::Text>::const_iterator t;
+  for( t = texts.constBegin(); t != texts.constEnd(); ++t ) {
+    update( t.key(), t.value().first, t.value().second );
+  }
+}
+
+QList<SearchIndex::Result> SearchIndex::search( const QString &query,
+  int maxResults, int *total ) const
+{
+  QList<Result> results;
+
+  if ( total ) *total = 0;
+
+  QStringList terms = words( query );
+  if ( terms.isEmpty() ) return results;
+
+  QList<const PostingList *> postings;
+  foreach( QString term, terms ) {
+    QHash<QString, PostingList>::const_iterator it = mPostings.find( term );
+    if ( it == mPostings.constEnd() ) return results;
+    postings.append( &it.value() );
+  }
+
+  // Walk the rarest term and look up the others
+  int rarest = 0;
+  for( int i = 1; i < postings.count(); ++i ) {
+    if ( postings.at( i )->count() < postings.at( rarest )->count() ) {
+      rarest = i;
+    }
+  }
+
+  double documentCount = mDocuments.count();
+
+  QList<int> ids;
+  PostingList::const_iterator it;
+  for( it = postings.at( rarest )->constBegin();
+       it != postings.at( rarest )->constEnd(); ++it ) {
+    int id = it.key();
+
+    bool found = true;
+    for( int i = 0; i < postings.count(); ++i ) {
+      if ( !postings.at( i )->contains( id ) ) {
+        found = false;
+        break;
+      }
+    }
+    if ( !found ) continue;
+
+    Document d = mDocuments.value( id );
+    QStringList nameWords = words( d.topic );
+
+    double score = 0;
+    for( int i = 0; i < terms.count(); ++i ) {
+      double idf = log( 1 + documentCount / postings.at( i )->count() );
+      int tf = postings.at( i )->value( id ).count();
+      score += ( 1 + log( double( tf ) ) ) * idf;
+      if ( nameWords.contains( terms.at( i ) ) ) score += idf;
+    }
+    score /= sqrt( double( qMax( d.length, 1 ) ) );
+
+    if ( terms.count() > 1 ) {
+      foreach( int position, postings.at( 0 )->value( id ) ) {
+        bool phrase = true;
+        for( int i = 1; i < terms.count(); ++i ) {
+          if ( !containsPosition( postings.at( i )->value( id ),
+                                  position + i ) ) {
+            phrase = false;
+            break;
+          }
+        }
+        if ( phrase ) {
+          score *= 2;
+          break;
+        }
+      }
+    }
+
+    Result r;
+    r.topic = d.topic;
+    r.score = score;
+    results.append( r );
+    ids.append( id );
+  }
+
+  // Sort the results together with their ids by sorting a list of indexes
+  QList<QPair<double, int> > order;
+  for( int i = 0; i < results.count(); ++i ) {
+    order.append( qMakePair( -results.at( i ).score, i ) );
+  }
+  qSort( order );
+
+  if ( total ) *total = results.count();
+
+  QList<Result> ranked;
+  for( int i = 0; i < order.count() && i < maxResults; ++i ) {
+    int index = order.at( i ).second;
+    Result r = results.at( index );
+    int id = ids.at( index );
+    r.snippet = snippet( mDocuments.value( id ),
+      postings.at( rarest )->value( id ).first() );
+    ranked.append( r );
+  }
+
+  return ranked;
+}
+
+QString SearchIndex::snippet( const Document &document, int position ) const
+{
+  const QString &text = document.text;
+
+  int offset = wordOffset( text, position );
+
+  int from = qMax( offset - snippetContext, 0 );
+  int to = qMin( offset + snippetContext, text.length() );
+
+  QString result = text.mid( from, to - from ).simplified();
+  if ( from > 0 ) result.prepend( "..." );
+  if ( to < text.length() ) result.append( "..." );
+
+  return result;
+}
+
+QStringList SearchIndex::words( const QString &text )
+{
+  QStringList result;
+
+  int i = 0;
+  while( i < text.length() ) {
+    while( i < text.length() && !text.at( i ).isLetterOrNumber() ) ++i;
+    int start = i;
+    while( i < text.length() && text.at( i ).isLetterOrNumber() ) ++i;
+    if ( i > start ) result.append( text.mid( start, i - start ).toLower() );
+  }
+
+  return result;
+}
@@ -0,0 +1,155 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QVector>
+#include <QList>
+
+/**
+  This class provides a full text index of all topics. It maps each word to
+  the topics containing it and the positions of the word in the topics. The
+  index also holds the plain text of the topics, so results can be shown with
+  snippets without reading the topic files.
+
+  The index is stored in a file in the topic directory. Each topic is
+  recorded together with the identity of the topic file it was built from, so
+  outdated entries can be detected.
+*/
+class SearchIndex
+{
+  public:
+    /**
+      This struct represents a topic found by a search.
+    */
+    struct Result
+    {
+      QString topic;
+      double score;
+      /** Part of the text of the topic around the first match */
+      QString snippet;
+    };
+
+    /**
+      Create empty index stored in the given file.
+    */
+    SearchIndex( const QString &filename );
+
+    /**
+      Load index from file.
+      
+      \return \c true on success, \c false if the file couldn't be read
+    */
+    bool load();
+    /**
+      Write index to file, if it was modified.
+      
+      \return \c true on success, \c false on error
+    */
+    bool save();
+
+    /**
+      Set text of topic. This replaces previously indexed text of the topic.
+      
+      \param topic name of topic
+      \param text plain text of topic
+      \param identity identity of the topic file holding the text
+    */
+    void update( const QString &topic, const QString &text,
+      const QByteArray &identity = QByteArray() );
+    /**
+      Set identity of the topic file the indexed text of the topic was
+      written to.
+    */
+    void setIdentity( const QString &topic, const QByteArray &identity );
+    /**
+      Return identity of the topic file the indexed text was taken from.
+      Returns an empty identity, if the topic isn't indexed or the text
+      wasn't written yet.
+    */
+    QByteArray identity( const QString &topic ) const;
+    /**
+      Remove topic from index.
+    */
+    void remove( const QString &topic );
+
+    /**
+      Return names of all indexed topics.
+    */
+    QStringList topics() const { return mDocumentIds.keys(); }
+
+    /**
+      Index the given topic files. The files are read in parallel by a pool
+      of threads.
+      
+      \param files map of topic names to names of topic files
+    */
+    void indexFiles( const QMap<QString, QString> &files );
+
+    /**
+      Search topics containing all words of the query. Results are ranked by
+      the frequency of the words in the topic weighted by their rarity across
+      all topics. Topics containing the words as a phrase or in their name
+      rank higher.
+      
+      \param query words to search for
+      \param maxResults maximum number of returned results
+      \param total if not 0, set to the number of all matching topics
+      \return list of results, best match first
+    */
+    QList<Result> search( const QString &query, int maxResults = 50,
+      int *total = 0 ) const;
+
+    /**
+      Split text into lower case words.
+    */
+    static QStringList words( const QString &text );
+
+  protected:
+    typedef QMap<int, QVector<int> > PostingList;
+
+    struct Document
+    {
+      QString topic;
+      QByteArray identity;
+      QString text;
+      int length;
+      QStringList terms;
+    };
+
+    QString snippet( const Document &document, int position ) const;
+
+  private:
+    QString mFilename;
+    bool mModified;
+
+    QHash<int, Document> mDocuments;
+    QHash<QString, int> mDocumentIds;
+    int mNextId;
+
+    QHash<QString, PostingList> mPostings;
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "searchwindow.h"
+
+#include "topicmanager.h"
+#include "searchindex.h"
+#include "todoodle.h"
+#include "dbg.h"
+
+#include <QBoxLayout>
+#include <QLineEdit>
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QProgressDialog>
+#include <QTime>
+
+// Maximum number of shown results
+static const int maxResults = 50;
+
+SearchWindow::SearchWindow( TopicManager *topicManager, QWidget *parent )
+  : QWidget( parent ), mTopicManager( topicManager )
+{
+  setWindowTitle( "Search Topics - Todoodle" );
+
+  QBoxLayout *topLayout = new QVBoxLayout( this );
+
+  mQueryEdit = new QLineEdit( this );
+  topLayout->addWidget( mQueryEdit );
+  connect( mQueryEdit, SIGNAL( textChanged( const QString & ) ),
+    SLOT( search() ) );
+
+  mResultView = new QTreeWidget( this );
+  mResultView->setColumnCount( 2 );
+  mResultView->setHeaderLabels( QStringList() << "Topic" << "Text" );
+  mResultView->setRootIsDecorated( false );
+  mResultView->setAlternatingRowColors( true );
+  topLayout->addWidget( mResultView );
+  connect( mResultView, SIGNAL( itemActivated( QTreeWidgetItem *, int ) ),
+    SLOT( slotItemActivated( QTreeWidgetItem * ) ) );
+
+  QBoxLayout *buttonLayout = new QHBoxLayout;
+  topLayout->addLayout( buttonLayout );
+
+  mStatusLabel = new QLabel( this );
+  buttonLayout->addWidget( mStatusLabel, 1 );
+
+  QPushButton *button = new QPushButton( "C&lose", this );
+  buttonLayout->addWidget( button );
+  connect( button, SIGNAL( clicked() ), SLOT( close() ) );
+
+  resize( 600, 400 );
+}
+
+void SearchWindow::search()
+{
+  mResultView->clear();
+
+  QString query = mQueryEdit->text();
+  if ( query.trimmed().isEmpty() ) {
+    mStatusLabel->clear();
+    return;
+  }
+
+  if ( !mTopicManager->hasSearchIndex() ) {
+    // The index is built on first use, which takes a while with many topics.
+    // The dialog is shown only if indexing takes long.
+    QProgressDialog progress( "Indexing topics...", QString(), 0, 100, this );
+    progress.setWindowModality( Qt::ApplicationModal );
+    connect( mTopicManager, SIGNAL( indexProgress( int ) ),
+      &progress, SLOT( setValue( int ) ) );
+    mTopicManager->searchIndex();
+  }
+
+  QTime time;
+  time.start();
+
+  int total;
+  QList<SearchIndex::Result> results =
+    mTopicManager->searchIndex()->search( query, maxResults, &total );
+
+  int elapsed = time.elapsed();
+
+  foreach( SearchIndex::Result r, results ) {
+    QTreeWidgetItem *item = new QTreeWidgetItem( mResultView );
+    item->setText( 0, r.topic );
+    item->setText( 1, r.snippet );
+  }
+  mResultView->resizeColumnToContents( 0 );
+
+  if ( total > results.count() ) {
+    mStatusLabel->setText( QString( "%1 topics found in %2 ms, showing "
+      "first %3" ).arg( total ).arg( elapsed ).arg( results.count() ) );
+  } else {
+    mStatusLabel->setText( QString( "%1 topics found in %2 ms" )
+      .arg( total ).arg( elapsed ) );
+  }
+}
+
+void SearchWindow::slotItemActivated( QTreeWidgetItem *item )
+{
+  Todoodle *t = mTopicManager->editor( item->text( 0 ) );
+  t->show();
+  t->raise();
+}
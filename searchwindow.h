@@ -0,0 +1,60 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef SEARCHWINDOW_H
+#define SEARCHWINDOW_H
+
+#include <QWidget>
+
+class TopicManager;
+
+class QLineEdit;
+class QTreeWidget;
+class QTreeWidgetItem;
+class QLabel;
+
+/**
+  This class provides a window for searching the text of all topics. Results
+  are shown ranked with a snippet of the matching text. Activating a result
+  opens the topic.
+*/
+class SearchWindow : public QWidget
+{
+    Q_OBJECT
+  public:
+    SearchWindow( TopicManager *, QWidget *parent = 0 );
+
+  public slots:
+    /**
+      Search for the text of the query line edit.
+    */
+    void search();
+
+  protected slots:
+    void slotItemActivated( QTreeWidgetItem *item );
+
+  private:
+    TopicManager *mTopicManager;
+
+    QLineEdit *mQueryEdit;
+    QTreeWidget *mResultView;
+    QLabel *mStatusLabel;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "segmentindex.h"
+
+#include <QTextDocument>
+#include <QTextBlock>
+
+SegmentIndex::SegmentIndex()
+  : mDirty( false )
+{
+}
+
+void SegmentIndex::clear()
+{
+  mSegments.clear();
+  mDirty = false;
+}
+
+void SegmentIndex::invalidate( QTextDocument *document, int from, int to )
+{
+  mDirty = true;
+
+  QTextBlock block = document->findBlock( from );
+  QTextBlock last = document->findBlock( to );
+  while( block.isValid() ) {
+    block.setUserData( 0 );
+    if ( block == last ) break;
+    block = block.next();
+  }
+}
+
+void SegmentIndex::setSegments( const QList<QByteArray> &segments )
+{
+  mSegments = segments;
+  mDirty = false;
+}
+
+bool SegmentIndex::isUnchanged( const QList<QByteArray> &segments ) const
+{
+  if ( segments.count() != mSegments.count() ) return false;
+
+  for( int i = 0; i < segments.count(); ++i ) {
+    const QByteArray &segment = segments.at( i );
+    const QByteArray &oldSegment = mSegments.at( i );
+    if ( segment.constData() != oldSegment.constData() &&
+         segment != oldSegment ) return false;
+  }
+
+  return true;
+}
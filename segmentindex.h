@@ -0,0 +1,100 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef SEGMENTINDEX_H
+#define SEGMENTINDEX_H
+
+#include <QByteArray>
+#include <QList>
+#include <QTextBlockUserData>
+
+class QTextDocument;
+
+/**
+  This class holds the serialized representation of a single block. It's
+  attached to the block as user data and removed as soon as the block changes.
+*/
+class BlockSegment : public QTextBlockUserData
+{
+  public:
+    QByteArray data;
+};
+
+/**
+  This class holds the serialized representation of a topic as it was last
+  written to disk. The data is split into segments, one for each block and
+  frame tag, so that only changed blocks have to be serialized again when
+  saving.
+*/
+class SegmentIndex
+{
+  public:
+    /**
+      Create empty segment index.
+    */
+    SegmentIndex();
+
+    /**
+      Forget about the data on disk.
+    */
+    void clear();
+
+    /**
+      Mark blocks covering the given range of the document as changed.
+
+      \param document document containing the blocks
+      \param from first position of the changed range
+      \param to last position of the changed range
+    */
+    void invalidate( QTextDocument *document, int from, int to );
+
+    /**
+      Set, if the document was changed since it was last saved.
+    */
+    void setDirty( bool dirty ) { mDirty = dirty; }
+    /**
+      Return, if the document was changed since it was last saved.
+    */
+    bool isDirty() const { return mDirty; }
+
+    /**
+      Set segments which were handed over for writing to disk. This also
+      resets the dirty flag.
+
+      \param segments data of the file split into segments
+    */
+    void setSegments( const QList<QByteArray> &segments );
+    /**
+      Return segments last written to disk.
+    */
+    QList<QByteArray> segments() const { return mSegments; }
+
+    /**
+      Return, if the given segments are identical to the segments last written
+      to disk. Segments of unchanged blocks share their data with the index,
+      so this is cheap.
+    */
+    bool isUnchanged( const QList<QByteArray> &segments ) const;
+
+  private:
+    QList<QByteArray> mSegments;
+    bool mDirty;
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "todoindex.h"
+
+#include "formatbinary.h"
+
+#include <QDataStream>
+#include <QTextDocument>
+
+Q_DECLARE_METATYPE( QList<Format::Todo> )
+
+static const quint32 todoIndexMagic = 0x54445449;
+static const qint32 todoIndexVersion = 1;
+
+static bool equal( const QList<Format::Todo> &l1,
+  const QList<Format::Todo> &l2 )
+{
+  if ( l1.count() != l2.count() ) return false;
+  for( int i = 0; i < l1.count(); ++i ) {
+    const Format::Todo &t1 = l1.at( i );
+    const Format::Todo &t2 = l2.at( i );
+    if ( t1.text != t2.text || t1.done != t2.done ||
+         t1.position != t2.position ) return false;
+  }
+  return true;
+}
+
+
+TodoIndex::TodoIndex( const QString &filename, QObject *parent )
+  : TopicDataIndex( filename, todoIndexMagic, todoIndexVersion, parent )
+{
+}
+
+void TodoIndex::clearData()
+{
+  mTodos.clear();
+}
+
+void TodoIndex::readData( QDataStream &stream, const QString &topic )
+{
+  qint32 todoCount;
+  stream >> todoCount;
+
+  QList<Format::Todo> todos;
+  for( int i = 0; i < todoCount && stream.status() == QDataStream::Ok;
+       ++i ) {
+    Format::Todo todo;
+    qint32 position;
+    stream >> todo.text >> todo.done >> position;
+    todo.position = position;
+    todos.append( todo );
+  }
+
+  if ( !todos.isEmpty() ) mTodos.insert( topic, todos );
+}
+
+void TodoIndex::writeData( QDataStream &stream, const QString &topic ) const
+{
+  QList<Format::Todo> todos = mTodos.value( topic );
+  stream << qint32( todos.count() );
+  foreach( Format::Todo todo, todos ) {
+    stream << todo.text << todo.done << qint32( todo.position );
+  }
+}
+
+bool TodoIndex::readFile( const QString &filename, QVariant &data ) const
+{
+  // XML topics are scanned without building a document, which is much
+  // cheaper
+  QList<Format::Todo> todos;
+  if ( FormatBinary::isBinary( filename ) ) {
+    QTextDocument document;
+    FormatBinary format( &document );
+    if ( !format.load( filename ) ) return false;
+    todos = Format( &document ).todos();
+  } else {
+    if ( !Format::readTodos( filename, todos ) ) return false;
+  }
+
+  data = QVariant::fromValue( todos );
+  return true;
+}
+
+void TodoIndex::updateFromFile( const QString &topic, const QVariant &data,
+  const QByteArray &identity )
+{
+  update( topic, data.value<QList<Format::Todo> >(), identity );
+}
+
+void TodoIndex::update( const QString &topic,
+  const QList<Format::Todo> &todos, const QByteArray &identity )
+{
+  setTopicIdentity( topic, identity );
+
+  if ( equal( todos, mTodos.value( topic ) ) ) return;
+
+  if ( todos.isEmpty() ) mTodos.remove( topic );
+  else mTodos.insert( topic, todos );
+
+  emit todosChanged( topic );
+}
+
+void TodoIndex::remove( const QString &topic )
+{
+  if ( !removeTopic( topic ) ) return;
+
+  if ( mTodos.remove( topic ) > 0 ) emit todosChanged( topic );
+}
+
+QList<Format::Todo> TodoIndex::todos( const QString &topic ) const
+{
+  return mTodos.value( topic );
+}
+
+int TodoIndex::openCount( const QString &topic ) const
+{
+  int count = 0;
+  foreach( Format::Todo todo, mTodos.value( topic ) ) {
+    if ( !todo.done ) ++count;
+  }
+  return count;
+}
@@ -0,0 +1,91 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TODOINDEX_H
+#define TODOINDEX_H
+
+#include "format.h"
+#include "topicdataindex.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+
+/**
+  This class holds the todo items of all topics, so they can be listed
+  without reading topic files.
+
+  The items of each topic are stored in a file in the topic directory
+  together with the identity of the topic file they were extracted from, as
+  provided by TopicDataIndex.
+*/
+class TodoIndex : public TopicDataIndex
+{
+    Q_OBJECT
+  public:
+    /**
+      Create empty index stored in the given file.
+    */
+    TodoIndex( const QString &filename, QObject *parent = 0 );
+
+    /**
+      Set todo items of topic. Emits todosChanged(), if the items differ from
+      the items recorded before.
+      
+      \param topic name of topic
+      \param todos todo items of topic
+      \param identity identity of the topic file holding the items
+    */
+    void update( const QString &topic, const QList<Format::Todo> &todos,
+      const QByteArray &identity = QByteArray() );
+    /**
+      Remove topic from index.
+    */
+    void remove( const QString &topic );
+
+    /**
+      Return todo items of topic.
+    */
+    QList<Format::Todo> todos( const QString &topic ) const;
+    /**
+      Return number of todo items of topic, which aren't done yet.
+    */
+    int openCount( const QString &topic ) const;
+
+  signals:
+    /**
+      Emitted when the todo items of a topic changed.
+    */
+    void todosChanged( const QString &topic );
+
+  protected:
+    void clearData();
+    void readData( QDataStream &stream, const QString &topic );
+    void writeData( QDataStream &stream, const QString &topic ) const;
+    bool readFile( const QString &filename, QVariant &data ) const;
+    void updateFromFile( const QString &topic, const QVariant &data,
+      const QByteArray &identity );
+
+  private:
+    QHash<QString, QList<Format::Todo> > mTodos;
+};
+
+#endif
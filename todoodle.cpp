@@ -30,6 +30,11 @@
 #include "wordhandler.h"
 #include "formatplaintext.h"
 #include "prefs.h"
+#include "topicloader.h"
+#include "topicindex.h"
+#include "topiclinker.h"
+#include "handlerscheduler.h"
+#include "backlinklist.h"
 
 #include <qaction.h>
 #include <qapplication.h>
@@ -64,6 +69,8 @@
 #include <QCloseEvent>
 #include <QSplitter>
 #include <QTimer>
+#include <QProgressBar>
+#include <QStatusBar>
 #include <QProcess>
 #include <QDateTime>
 
@@ -83,7 +90,7 @@ class TopicHandler : public WordHandler
 
     bool process( const QString &word, QTextCursor &cursor )
     {
-      if ( !mTopicManager->topics().contains( word ) ) return false;
+      if ( !mTopicManager->topicIndex()->contains( word ) ) return false;
 
       cursor.mergeCharFormat( TextFormats::topicLinkCharFormat( word ) );
 
@@ -121,12 +128,32 @@ Todoodle::Todoodle( TopicManager *topicManager,
   mEditor->setFocus();
   connect( mEditor, SIGNAL( anchorClicked( const QString & ) ),
     SLOT( slotAnchorClicked( const QString & ) ) );
+  connect( mEditor, SIGNAL( textInserted( int, int ) ),
+    SLOT( slotTextInserted( int, int ) ) );
 
   mEditor->addHandler( new TopicHandler( mTopicManager ) );
 
   mScratchPad = new ScratchPad( mSplitter );
   mScratchPad->hide();
 
+  // The backlinks are shown on demand, because the link index is set up
+  // when it is used for the first time
+  mBacklinkList = 0;
+
+  mLoadProgress = new QProgressBar;
+  mLoadProgress->setRange( 0, 100 );
+  statusBar()->addPermanentWidget( mLoadProgress );
+  statusBar()->hide();
+
+  // Changes are recorded in the journal right away. Save the topic when the
+  // user pauses editing, so the journal is compacted.
+  mAutoSaveTimer = new QTimer( this );
+  mAutoSaveTimer->setSingleShot( true );
+  mAutoSaveTimer->setInterval( 5000 );
+  connect( mAutoSaveTimer, SIGNAL( timeout() ), SLOT( autoSave() ) );
+  connect( mEditor->document(), SIGNAL( contentsChange( int, int, int ) ),
+    mAutoSaveTimer, SLOT( start() ) );
+
   connect( mEditor->document(), SIGNAL( undoAvailable( bool ) ),
     actionUndo, SLOT( setEnabled( bool ) ) );
   connect( mEditor->document(), SIGNAL( redoAvailable( bool ) ),
@@ -202,6 +229,18 @@ void Todoodle::setupFileActions()
   connect( a, SIGNAL( triggered() ), SLOT( fileExtract() ) );
   menu->addAction( a );
 
+  a = new QAction( "Rename Topic...", this );
+  connect( a, SIGNAL( triggered() ), SLOT( fileRename() ) );
+  menu->addAction( a );
+
+  a = new QAction( "Delete Topic...", this );
+  connect( a, SIGNAL( triggered() ), SLOT( fileDelete() ) );
+  menu->addAction( a );
+
+  a = new QAction( "Relink All Topics", this );
+  connect( a, SIGNAL( triggered() ), SLOT( fileRelink() ) );
+  menu->addAction( a );
+
   a = new QAction( "Inline Topic", this );
   a->setShortcut(Qt::CTRL + Qt::Key_L);
   connect( a, SIGNAL( triggered() ), SLOT( fileInline() ) );
@@ -245,6 +284,11 @@ void Todoodle::setupFileActions()
   connect( a, SIGNAL( triggered() ), SLOT( showNextActionsList() ) );
   menu->addAction( a );
 
+  a = new QAction( "Search Topics...", this );
+  a->setShortcut( Qt::CTRL + Qt::SHIFT + Qt::Key_F );
+  connect( a, SIGNAL( triggered() ), SLOT( showSearch() ) );
+  menu->addAction( a );
+
   menu->addSeparator();
 
   mActionScratchPad = new QAction( QPixmap( ":/images/scratchpad.png" ), "Scratch Pad", this );
@@ -252,6 +296,11 @@ void Todoodle::setupFileActions()
   mActionScratchPad->setCheckable( true );
   menu->addAction( mActionScratchPad );
   mToolBar->addAction( mActionScratchPad );
+
+  mActionBacklinks = new QAction( "Backlinks", this );
+  connect( mActionBacklinks, SIGNAL( triggered() ), SLOT( showBacklinks() ) );
+  mActionBacklinks->setCheckable( true );
+  menu->addAction( mActionBacklinks );
   
   menu->addSeparator();
 
@@ -500,6 +549,28 @@ void Todoodle::setupHelpActions()
   a = new QAction( "Manual", this );
   connect( a, SIGNAL( triggered() ), SLOT( goManual() ) );
   menu->addAction( a );
+
+  menu->addSeparator();
+
+  a = new QAction( "Keystroke Latency...", this );
+  connect( a, SIGNAL( triggered() ), SLOT( showKeyLatency() ) );
+  menu->addAction( a );
+}
+
+void Todoodle::showKeyLatency()
+{
+  KeyLatency &keys = mEditor->keyLatency();
+  KeyLatency &handlers = mEditor->handlerScheduler()->latency();
+
+  int result = QMessageBox::information( this, "Keystroke Latency",
+    "Time spent processing typed text per key press:\n\n" +
+    keys.report() + "\n\n"
+    "Time spent running word and sequence handlers in the background:\n\n" +
+    handlers.report(), "Close", "Reset" );
+  if ( result == 1 ) {
+    keys.reset();
+    handlers.reset();
+  }
 }
 
 void Todoodle::goStart()
@@ -535,6 +606,13 @@ void Todoodle::fileLink()
   } else {
     QString topic = cursor.selectedText();
   
+    if ( !mTopicManager->topicExists( topic ) &&
+         !TopicManager::isValidTopicName( topic ) ) {
+      QMessageBox::warning( this, "Link", "'" + topic +
+        "' can't be used as name of a topic." );
+      return;
+    }
+
 //    QMessageBox::information( this, "Selected Text", topic );
     QTextCharFormat format = TextFormats::topicLinkCharFormat( topic );
     cursor.mergeCharFormat( format );
@@ -572,6 +650,9 @@ void Todoodle::fileExtract()
 
     if ( topic.isEmpty() ) {
       QMessageBox::warning( this, "No Topic", "No topic was given" );
+    } else if ( !TopicManager::isValidTopicName( topic ) ) {
+      QMessageBox::warning( this, "Topic", "'" + topic +
+        "' can't be used as name of a topic." );
     } else if ( mTopicManager->topicExists( topic ) ) {
       QMessageBox::warning( this, "Topic Exists", "Topic " + topic +
         " already exists." );
@@ -699,6 +780,83 @@ void Todoodle::printFrame( QTextFrame *frame )
   mIndent -= 2;
 }
 
+void Todoodle::fileDelete()
+{
+  if ( mTopic.isEmpty() ) return;
+
+  int result = QMessageBox::question( this, "Delete Topic",
+    "Do you really want to delete the topic '" + mTopic + "'?",
+    QMessageBox::Yes, QMessageBox::No );
+  if ( result != QMessageBox::Yes ) return;
+
+  // Make sure the deleted topic isn't saved again
+  QString topic = mTopic;
+  mTopic.clear();
+
+  if ( !mTopicManager->deleteTopic( topic ) ) {
+    QMessageBox::warning( this, "Delete Topic",
+      "Unable to delete topic '" + topic + "'." );
+  }
+
+  if ( mTopicManager->windowMode() == TopicManager::Single ) {
+    loadTopic( "Start" );
+  } else {
+    close();
+  }
+}
+
+void Todoodle::fileRename()
+{
+  if ( mTopic.isEmpty() ) return;
+
+  bool ok;
+  QString topic = QInputDialog::getText( this, "Rename Topic",
+    "New name of topic '" + mTopic + "':", QLineEdit::Normal, mTopic, &ok );
+  if ( !ok || topic.isEmpty() || topic == mTopic ) return;
+
+  if ( !TopicManager::isValidTopicName( topic ) ) {
+    QMessageBox::warning( this, "Rename Topic", "'" + topic +
+      "' can't be used as name of a topic." );
+    return;
+  }
+
+  if ( mTopicManager->topicExists( topic ) ) {
+    QMessageBox::warning( this, "Topic Exists", "Topic " + topic +
+      " already exists." );
+    return;
+  }
+
+  QApplication::setOverrideCursor( Qt::WaitCursor );
+  bool success = mTopicManager->renameTopic( mTopic, topic );
+  QApplication::restoreOverrideCursor();
+
+  if ( !success ) {
+    QMessageBox::warning( this, "Rename Topic",
+      "Unable to rename topic '" + mTopic + "'." );
+  }
+}
+
+void Todoodle::fileRelink()
+{
+  QApplication::setOverrideCursor( Qt::WaitCursor );
+  int changed = mTopicManager->relinkTopics();
+  QApplication::restoreOverrideCursor();
+
+  if ( changed < 0 ) {
+    QMessageBox::warning( this, "Relink Topics",
+      "Unable to relink all topics." );
+  } else {
+    QMessageBox::information( this, "Relink Topics",
+      QString( "Changed %1 topics." ).arg( changed ) );
+  }
+}
+
+void Todoodle::slotTextInserted( int from, int to )
+{
+  mTopicManager->topicLinker()->linkRange( mEditor->document(), from, to,
+    mTopic );
+}
+
 void Todoodle::fileClose()
 {
   close();
@@ -979,13 +1137,52 @@ void Todoodle::loadTopic( const QString &topic )
   mEditor->document()->setUndoRedoEnabled( false );
   mTopicManager->load( mTopic, mEditor );
   mScratchPad->load( mTopicManager->scratchPadFilename( mTopic ) );
-  mEditor->document()->setUndoRedoEnabled( true );
+
+  // The loader enables undo when it has finished
+  TopicLoader *loader = mTopicManager->loader( mTopic );
+  if ( loader ) {
+    mLoadProgress->setValue( 0 );
+    statusBar()->show();
+    connect( loader, SIGNAL( progress( int ) ),
+      mLoadProgress, SLOT( setValue( int ) ) );
+    connect( loader, SIGNAL( finished( TopicLoader * ) ),
+      statusBar(), SLOT( hide() ) );
+  } else {
+    mEditor->document()->setUndoRedoEnabled( true );
+  }
+
+  setTopicName( mTopic );
+
+  readConfig();
+}
+
+void Todoodle::setTopicName( const QString &topic )
+{
+  mTopic = topic;
 
   QString title = "Todoodle";
   if ( !mTopic.isEmpty() ) title.prepend( mTopic + " - " );
   setWindowTitle( title );
 
-  readConfig();
+  // The scratch pad file is read lazily and might have been moved by a
+  // rename of the topic
+  if ( !mTopic.isEmpty() ) {
+    mScratchPad->setFilename( mTopicManager->scratchPadFilename( mTopic ) );
+  }
+
+  if ( mBacklinkList ) mBacklinkList->setTopic( mTopic );
+}
+
+void Todoodle::showPosition( int position )
+{
+  TopicLoader *loader = mTopicManager->loader( mTopic );
+  if ( loader ) loader->finish();
+
+  QTextCursor cursor = mEditor->textCursor();
+  cursor.setPosition( qBound( 0, position,
+    mEditor->document()->characterCount() - 1 ) );
+  mEditor->setTextCursor( cursor );
+  mEditor->ensureCursorVisible();
 }
 
 void Todoodle::saveTopic()
@@ -994,12 +1191,33 @@ void Todoodle::saveTopic()
 
   if ( mTopic.isEmpty() ) return;
 
+  // Include links for the words typed last
+  mEditor->handlerScheduler()->flush();
+
   mTopicManager->save( mTopic, mEditor );
   mScratchPad->save( mTopicManager->scratchPadFilename( mTopic ) );
 }
 
+void Todoodle::autoSave()
+{
+  if ( mTopic.isEmpty() ) return;
+
+  // Include links for the words typed last
+  mEditor->handlerScheduler()->flush();
+
+  mTopicManager->save( mTopic, mEditor );
+}
+
 void Todoodle::openTopic( const QString &topic )
 {
+  // Links might refer to topics, which can't be created
+  if ( !mTopicManager->topicExists( topic ) &&
+       !TopicManager::isValidTopicName( topic ) ) {
+    QMessageBox::warning( this, "Open Topic", "'" + topic +
+      "' can't be used as name of a topic." );
+    return;
+  }
+
   Todoodle *editor = mTopicManager->editor( topic );
   editor->show();
   editor->raise();
@@ -1033,9 +1251,15 @@ void Todoodle::showNextActionsList()
   mTopicManager->showNextActionsList();
 }
 
+void Todoodle::showSearch()
+{
+  mTopicManager->showSearch();
+}
+
 void Todoodle::readConfig()
 {
   QSettings *settings = mTopicManager->prefs()->settings();
+  TopicStateStore::State state = mTopicManager->prefs()->topicState( mTopic );
 
   if ( mTopicManager->windowMode() == TopicManager::Single ) {
     if ( settings->contains( "singlewindowmode/pos" ) ) {
@@ -1047,25 +1271,21 @@ void Todoodle::readConfig()
       resize( size );
     }
   } else {
-    if ( settings->contains( mTopic + "/pos" ) ) {
-      QPoint pos = settings->value( mTopic + "/pos" ).toPoint();
-      move( pos );
-    }
-    if ( settings->contains( mTopic + "/size" ) ) {
-      QSize size = settings->value( mTopic + "/size" ).toSize();
-      resize( size );
+    if ( state.hasWindowGeometry ) {
+      move( state.windowPos );
+      resize( state.windowSize );
     }
   }
 
-  if ( settings->value( mTopic + "/scratchpad", false ).toBool() ) {
+  if ( state.scratchPad ) {
     mEditor->show();
     mScratchPad->show();
     mActionScratchPad->setChecked( true );
   }
 
-  if ( settings->contains( mTopic + "/cursor/position" ) ) {
+  if ( state.hasCursor ) {
     QTextCursor cursor = mEditor->textCursor();
-    int pos = settings->value( mTopic + "/cursor/position" ).toInt();
+    int pos = state.cursorPosition;
     QTextCursor end( cursor );
     end.movePosition( QTextCursor::End );
     if ( pos <= end.position() ) {
@@ -1079,12 +1299,12 @@ void Todoodle::readConfig()
 
 void Todoodle::readSplitterConfig()
 {
-  QSettings *settings = mTopicManager->prefs()->settings();
+  TopicStateStore::State state = mTopicManager->prefs()->topicState( mTopic );
 
-  if ( settings->contains( mTopic + "/splitter/left" ) ) {
+  if ( state.hasSplitter ) {
     QList<int> sizes;
-    sizes.append( settings->value( mTopic + "/splitter/left" ).toInt() );
-    sizes.append( settings->value( mTopic + "/splitter/right" ).toInt() );
+    sizes.append( state.splitterLeft );
+    sizes.append( state.splitterRight );
     mSplitter->setSizes( sizes );
     dbg() << "SIZE left: " << sizes.at( 0 ) << "  right: " << sizes.at( 1 )
       << endl;
@@ -1093,26 +1313,33 @@ void Todoodle::readSplitterConfig()
 
 void Todoodle::writeConfig()
 {
-  QSettings *settings = mTopicManager->prefs()->settings();
+  if ( mTopic.isEmpty() ) return;
+
+  Prefs *prefs = mTopicManager->prefs();
+  TopicStateStore::State state = prefs->topicState( mTopic );
 
   if ( mTopicManager->windowMode() == TopicManager::Single ) {
-    settings->setValue( "singlewindowmode/pos", pos() );
-    settings->setValue( "singlewindowmode/size", size() );
+    prefs->settings()->setValue( "singlewindowmode/pos", pos() );
+    prefs->settings()->setValue( "singlewindowmode/size", size() );
   } else {
-    settings->setValue( mTopic + "/pos", pos() );
-    settings->setValue( mTopic + "/size", size() );
+    state.hasWindowGeometry = true;
+    state.windowPos = pos();
+    state.windowSize = size();
   }
 
-  settings->setValue( mTopic + "/scratchpad", mActionScratchPad->isChecked() );
+  state.scratchPad = mActionScratchPad->isChecked();
 
   QList<int> sizes = mSplitter->sizes();
   if ( sizes.count() == 2 ) {
-    settings->setValue( mTopic + "/splitter/left", sizes.at( 0 ) );
-    settings->setValue( mTopic + "/splitter/right", sizes.at( 1 ) );
+    state.hasSplitter = true;
+    state.splitterLeft = sizes.at( 0 );
+    state.splitterRight = sizes.at( 1 );
   }
   
-  settings->setValue( mTopic + "/cursor/position",
-    mEditor->textCursor().position() );
+  state.hasCursor = true;
+  state.cursorPosition = mEditor->textCursor().position();
+
+  prefs->setTopicState( mTopic, state );
 }
 
 void Todoodle::showScratchPad()
@@ -1124,6 +1351,26 @@ void Todoodle::showScratchPad()
   }
 }
 
+void Todoodle::showBacklinks()
+{
+  if ( mActionBacklinks->isChecked() ) {
+    if ( !mBacklinkList ) {
+      mBacklinkList = new BacklinkList( mTopicManager, mSplitter );
+      connect( mBacklinkList, SIGNAL( topicSelected( const QString & ) ),
+        SLOT( slotTopicSelected( const QString & ) ) );
+    }
+    mBacklinkList->setTopic( mTopic );
+    mBacklinkList->show();
+  } else if ( mBacklinkList ) {
+    mBacklinkList->hide();
+  }
+}
+
+void Todoodle::slotTopicSelected( const QString &topic )
+{
+  openTopic( topic );
+}
+
 void Todoodle::exportHtml()
 {
   QString saveFile = QFileDialog::getSaveFileName( this, "HTML Export File" );
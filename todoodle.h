@@ -35,9 +35,12 @@ class QMenu;
 class QTextFrame;
 class QSettings;
 class QSplitter;
+class QTimer;
+class QProgressBar;
 
 class TopicManager;
 class ScratchPad;
+class BacklinkList;
 class HyperTextEdit;
 
 /**
@@ -98,6 +101,23 @@ class Todoodle : public QMainWindow
     */
     QString topic() const { return mTopic; }
 
+    /**
+      Set new name of the topic shown in the window after the topic was
+      renamed. The data of the topic isn't reloaded.
+      
+      \param topic new name of topic
+    */
+    void setTopicName( const QString &topic );
+
+    /**
+      Move cursor to the given position in the editing area and scroll it
+      into view. A topic which is still being loaded is loaded completely
+      before.
+      
+      \param position position in the document of the topic
+    */
+    void showPosition( int position );
+
     /**
       Return pointer to editor widget.
       
@@ -126,6 +146,9 @@ class Todoodle : public QMainWindow
     void fileLink();
     void fileExtract();
     void fileInline();
+    void fileDelete();
+    void fileRename();
+    void fileRelink();
     void filePrint();
     void dumpStructure();
     void exportHtml();
@@ -159,20 +182,28 @@ class Todoodle : public QMainWindow
     void goBack();
     void goForward();
 
+    void showKeyLatency();
+
     void currentCharFormatChanged(const QTextCharFormat &format);
 
     void clipboardDataChanged();
 
     void slotAnchorClicked( const QString & );
+    void slotTextInserted( int from, int to );
 
     void showTopicList();
     void showTopicMap();
     void showNextActionsList();
+    void showSearch();
 
     void showScratchPad();
+    void showBacklinks();
+    void slotTopicSelected( const QString &topic );
 
     void readSplitterConfig();
 
+    void autoSave();
+
   private:
     void fontChanged(const QFont &f);
     void colorChanged(const QColor &c);
@@ -197,6 +228,7 @@ class Todoodle : public QMainWindow
         *actionPaste;
 
     QAction *mActionScratchPad;
+    QAction *mActionBacklinks;
 
     QToolBar *mToolBar;
     
@@ -211,8 +243,12 @@ class Todoodle : public QMainWindow
 
     HyperTextEdit *mEditor;
     ScratchPad *mScratchPad;
+    BacklinkList *mBacklinkList;
     QSplitter *mSplitter;
 
+    QTimer *mAutoSaveTimer;
+    QProgressBar *mLoadProgress;
+
     int mIndent;
 };
 
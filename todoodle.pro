@@ -7,14 +7,29 @@ HEADERS         = todoodle.h hypertextedit.h format.h topicmanager.h \
                   topiclist.h topicmap.h versioncontrol.h scratchpad.h \
                   textformats.h scratchwidget.h topicmapwidget.h topicinfo.h \
                   wordhandler.h cmdlineargs.h formatplaintext.h prefs.h \
-                  nextactionslist.h
+                  nextactionslist.h segmentindex.h savequeue.h journal.h \
+                  formatbinary.h topicloader.h topicindex.h \
+                  topicwatcher.h topiclinker.h keylatency.h \
+                  handlerscheduler.h searchindex.h searchwindow.h \
+                  linkindex.h backlinklist.h todoindex.h \
+                  topiccatalog.h topicinfocache.h topicgrid.h \
+                  topicmaplayout.h topicstatestore.h mappedtable.h \
+                  topicdataindex.h
 
 SOURCES         = todoodle.cpp format.cpp \
                   main.cpp hypertextedit.cpp topicmanager.cpp \
                   topiclist.cpp topicmap.cpp versioncontrol.cpp \
                   scratchpad.cpp textformats.cpp scratchwidget.cpp \
                   topicmapwidget.cpp topicinfo.cpp cmdlineargs.cpp \
-                  formatplaintext.cpp prefs.cpp nextactionslist.cpp
+                  formatplaintext.cpp prefs.cpp nextactionslist.cpp \
+                  segmentindex.cpp savequeue.cpp journal.cpp \
+                  formatbinary.cpp topicloader.cpp topicindex.cpp \
+                  topicwatcher.cpp topiclinker.cpp keylatency.cpp \
+                  handlerscheduler.cpp searchindex.cpp searchwindow.cpp \
+                  linkindex.cpp backlinklist.cpp todoindex.cpp \
+                  topiccatalog.cpp topicinfocache.cpp topicgrid.cpp \
+                  topicmaplayout.cpp topicstatestore.cpp mappedtable.cpp \
+                  topicdataindex.cpp
 
 RESOURCES += todoodle.qrc
 
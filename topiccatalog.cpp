@@ -0,0 +1,202 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topiccatalog.h"
+
+#include "topicmanager.h"
+#include "topicindex.h"
+#include "topicinfo.h"
+#include "dbg.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QtAlgorithms>
+
+TopicCatalog::TopicCatalog( TopicManager *topicManager, QObject *parent )
+  : QObject( parent ), mTopicManager( topicManager )
+{
+  mColumns.revision = 0;
+
+  TopicIndex *index = mTopicManager->topicIndex();
+  connect( index, SIGNAL( topicAboutToBeAdded( const QString &, int ) ),
+    SLOT( slotTopicAboutToBeAdded( const QString &, int ) ) );
+  connect( index, SIGNAL( topicAboutToBeRemoved( const QString &, int ) ),
+    SLOT( slotTopicAboutToBeRemoved( const QString &, int ) ) );
+  connect( index, SIGNAL( topicsReset() ), SLOT( slotTopicsReset() ) );
+
+  connect( mTopicManager, SIGNAL( topicInfoChanged( const QString & ) ),
+    SLOT( slotInfoChanged( const QString & ) ) );
+
+  slotTopicsReset();
+}
+
+int TopicCatalog::indexOf( const QString &topic ) const
+{
+  QStringList::const_iterator it = qBinaryFind( mColumns.names.begin(),
+    mColumns.names.end(), topic );
+  if ( it == mColumns.names.end() ) return -1;
+  return it - mColumns.names.begin();
+}
+
+bool TopicCatalog::lessThan( const Columns &columns, Column column, int row1,
+  int row2 )
+{
+  switch ( column ) {
+    case Modified:
+      if ( columns.modified.at( row1 ) != columns.modified.at( row2 ) ) {
+        return columns.modified.at( row1 ) < columns.modified.at( row2 );
+      }
+      break;
+    case Size:
+      if ( columns.sizes.at( row1 ) != columns.sizes.at( row2 ) ) {
+        return columns.sizes.at( row1 ) < columns.sizes.at( row2 );
+      }
+      break;
+    case Links:
+      if ( columns.linkCounts.at( row1 ) != columns.linkCounts.at( row2 ) ) {
+        return columns.linkCounts.at( row1 ) < columns.linkCounts.at( row2 );
+      }
+      break;
+    case Todos:
+      if ( columns.todoCounts.at( row1 ) != columns.todoCounts.at( row2 ) ) {
+        return columns.todoCounts.at( row1 ) < columns.todoCounts.at( row2 );
+      }
+      break;
+    default:
+      break;
+  }
+
+  // Rows are ordered by name
+  return row1 < row2;
+}
+
+QList<quint64> TopicCatalog::trigrams( const QString &text )
+{
+  QList<quint64> result;
+
+  QString lower = text.toLower();
+  for( int i = 0; i + 3 <= lower.size(); ++i ) {
+    quint64 trigram = quint64( lower.at( i ).unicode() ) << 32 |
+      quint64( lower.at( i + 1 ).unicode() ) << 16 |
+      lower.at( i + 2 ).unicode();
+    if ( !result.contains( trigram ) ) result.append( trigram );
+  }
+
+  return result;
+}
+
+void TopicCatalog::shiftTrigramRows( int row, int offset )
+{
+  QHash<quint64, QVector<int> >::iterator it;
+  for( it = mColumns.trigramRows.begin(); it != mColumns.trigramRows.end();
+       ++it ) {
+    QVector<int> &rows = it.value();
+    // The lists are sorted, so only the tail has to be shifted
+    QVector<int>::iterator r = qLowerBound( rows.begin(), rows.end(), row );
+    for( ; r != rows.end(); ++r ) *r += offset;
+  }
+}
+
+void TopicCatalog::slotTopicAboutToBeAdded( const QString &topic, int row )
+{
+  mColumns.names.insert( row, topic );
+  mColumns.modified.insert( row, 0 );
+  mColumns.sizes.insert( row, 0 );
+  mColumns.linkCounts.insert( row, 0 );
+  mColumns.todoCounts.insert( row, 0 );
+  readInfo( row );
+
+  shiftTrigramRows( row, 1 );
+  foreach( quint64 trigram, trigrams( topic ) ) {
+    QVector<int> &rows = mColumns.trigramRows[ trigram ];
+    rows.insert( qLowerBound( rows.begin(), rows.end(), row ), row );
+  }
+  ++mColumns.revision;
+
+  emit topicAdded( row );
+}
+
+void TopicCatalog::slotTopicAboutToBeRemoved( const QString &topic, int row )
+{
+  foreach( quint64 trigram, trigrams( topic ) ) {
+    QVector<int> &rows = mColumns.trigramRows[ trigram ];
+    QVector<int>::iterator it = qBinaryFind( rows.begin(), rows.end(), row );
+    if ( it != rows.end() ) rows.erase( it );
+    if ( rows.isEmpty() ) mColumns.trigramRows.remove( trigram );
+  }
+  shiftTrigramRows( row + 1, -1 );
+  ++mColumns.revision;
+
+  mColumns.names.removeAt( row );
+  mColumns.modified.remove( row );
+  mColumns.sizes.remove( row );
+  mColumns.linkCounts.remove( row );
+  mColumns.todoCounts.remove( row );
+
+  emit topicRemoved( row );
+}
+
+void TopicCatalog::slotTopicsReset()
+{
+  mColumns.names = mTopicManager->topicIndex()->topics();
+
+  int count = mColumns.names.count();
+  mColumns.modified.fill( 0, count );
+  mColumns.sizes.fill( 0, count );
+  mColumns.linkCounts.fill( 0, count );
+  mColumns.todoCounts.fill( 0, count );
+
+  // The info is taken from the topic info cache, so no files are read
+  for( int row = 0; row < count; ++row ) readInfo( row );
+
+  // Rows are visited in ascending order, so the lists stay sorted
+  mColumns.trigramRows.clear();
+  for( int row = 0; row < count; ++row ) {
+    foreach( quint64 trigram, trigrams( mColumns.names.at( row ) ) ) {
+      mColumns.trigramRows[ trigram ].append( row );
+    }
+  }
+  ++mColumns.revision;
+
+  dbg() << "TopicCatalog: " << count << " topics" << endl;
+
+  emit topicsReset();
+}
+
+void TopicCatalog::readInfo( int row )
+{
+  TopicInfo *info = mTopicManager->info( mColumns.names.at( row ) );
+  if ( !info ) return;
+
+  mColumns.modified[ row ] = info->lastModified().toTime_t();
+  mColumns.sizes[ row ] = info->size();
+  mColumns.linkCounts[ row ] = info->linkCount();
+  mColumns.todoCounts[ row ] = info->todoCount();
+}
+
+void TopicCatalog::slotInfoChanged( const QString &topic )
+{
+  int row = indexOf( topic );
+  if ( row < 0 ) return;
+
+  readInfo( row );
+
+  emit topicChanged( row );
+}
@@ -0,0 +1,157 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICCATALOG_H
+#define TOPICCATALOG_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QList>
+
+class TopicManager;
+
+/**
+  This class holds the attributes of all topics shown in lists, the name,
+  the time of last modification, the size of the topic file and the number of
+  links and open todo items. The attributes are stored column by column in
+  the order of the sorted list of topic names, so they can be accessed by row
+  in constant time and copied cheaply for sorting them in another thread.
+
+  The catalog follows the topic index and takes the attributes from the topic
+  info cache of the topic manager. Rows are inserted and removed one by one,
+  when topics are created or deleted.
+
+  For filtering topics by name the catalog maintains an index of the
+  trigrams of the lower case names, mapping each trigram to the sorted list
+  of rows whose name contains it.
+*/
+class TopicCatalog : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      Columns of the catalog. Relevance isn't a column, it stands for the
+      order of topics by how well their name matches a filter.
+    */
+    enum Column { Relevance = -1, Name, Modified, Size, Links, Todos,
+      ColumnCount };
+
+    /**
+      This struct holds the columns of the catalog. Copying it is cheap, as
+      the containers are implicitly shared.
+    */
+    struct Columns
+    {
+      QStringList names;
+      /** Time of last modification in seconds since the epoch */
+      QVector<uint> modified;
+      QVector<qint64> sizes;
+      QVector<int> linkCounts;
+      QVector<int> todoCounts;
+      /** Rows of names containing a trigram, see trigrams() */
+      QHash<quint64, QVector<int> > trigramRows;
+      /** Number incremented whenever rows are inserted or removed */
+      int revision;
+    };
+
+    /**
+      Create catalog of topics managed by the given topic manager and fill it
+      from the current state of the topic directory.
+    */
+    TopicCatalog( TopicManager *, QObject *parent = 0 );
+
+    /**
+      Return number of topics.
+    */
+    int count() const { return mColumns.names.count(); }
+
+    /**
+      Return row of topic or -1, if the topic isn't in the catalog.
+    */
+    int indexOf( const QString &topic ) const;
+
+    QString name( int row ) const { return mColumns.names.at( row ); }
+    uint modified( int row ) const { return mColumns.modified.at( row ); }
+    qint64 size( int row ) const { return mColumns.sizes.at( row ); }
+    int linkCount( int row ) const { return mColumns.linkCounts.at( row ); }
+    int todoCount( int row ) const { return mColumns.todoCounts.at( row ); }
+
+    /**
+      Return snapshot of all columns.
+    */
+    Columns columns() const { return mColumns; }
+
+    /**
+      Return, if the first row sorts before the second row by the given
+      column. Rows with equal values are ordered by name.
+    */
+    static bool lessThan( const Columns &columns, Column column, int row1,
+      int row2 );
+
+    /**
+      Return the distinct trigrams of the lower case version of the given
+      text. Each trigram is packed into one integer.
+    */
+    static QList<quint64> trigrams( const QString &text );
+
+  signals:
+    /**
+      Emitted when a topic was inserted at the given row.
+    */
+    void topicAdded( int row );
+    /**
+      Emitted when the topic at the given row was removed.
+    */
+    void topicRemoved( int row );
+    /**
+      Emitted when attributes of the topic at the given row changed.
+    */
+    void topicChanged( int row );
+    /**
+      Emitted when the complete content of the catalog was replaced.
+    */
+    void topicsReset();
+
+  protected slots:
+    void slotTopicAboutToBeAdded( const QString &topic, int row );
+    void slotTopicAboutToBeRemoved( const QString &topic, int row );
+    void slotTopicsReset();
+    void slotInfoChanged( const QString &topic );
+
+  protected:
+    /**
+      Read attributes of the topic of the given row from its topic info.
+    */
+    void readInfo( int row );
+
+    /**
+      Shift rows in the trigram index, which are greater than or equal to the
+      given row, by the given offset.
+    */
+    void shiftTrigramRows( int row, int offset );
+
+  private:
+    TopicManager *mTopicManager;
+    Columns mColumns;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topicdataindex.h"
+
+#include "savequeue.h"
+#include "dbg.h"
+
+#include <QFile>
+#include <QDataStream>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+
+/**
+  This class extracts the data of one topic file.
+*/
+class TopicDataJob : public QRunnable
+{
+  public:
+    typedef QPair<QVariant, QByteArray> Data;
+
+    TopicDataJob( const TopicDataIndex *index, const QString &topic,
+      const QString &filename, QMap<QString, Data> *data, QMutex *mutex )
+      : mIndex( index ), mTopic( topic ), mFilename( filename ),
+        mData( data ), mMutex( mutex )
+    {
+    }
+
+    void run()
+    {
+      // Take the identity first, so a concurrent change of the file is
+      // detected later
+      QByteArray identity = SaveQueue::fileIdentity( mFilename );
+
+      QVariant data;
+      if ( !mIndex->readFile( mFilename, data ) ) {
+        qWarning( "Error indexing '%s'.", qPrintable( mFilename ) );
+        return;
+      }
+
+      QMutexLocker locker( mMutex );
+      mData->insert( mTopic, Data( data, identity ) );
+    }
+
+  private:
+    const TopicDataIndex *mIndex;
+    QString mTopic;
+    QString mFilename;
+    QMap<QString, Data> *mData;
+    QMutex *mMutex;
+};
+
+
+TopicDataIndex::TopicDataIndex( const QString &filename, quint32 magic,
+  qint32 version, QObject *parent )
+  : QObject( parent ), mFilename( filename ), mMagic( magic ),
+    mVersion( version ), mModified( false )
+{
+}
+
+bool TopicDataIndex::load()
+{
+  QFile file( mFilename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return false;
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_0 );
+
+  quint32 magic;
+  qint32 version;
+  stream >> magic >> version;
+  if ( magic != mMagic || version != mVersion ) {
+    qWarning( "Unsupported index '%s'.", qPrintable( mFilename ) );
+    return false;
+  }
+
+  mIdentities.clear();
+  clearData();
+
+  qint32 count;
+  stream >> count;
+  for( int i = 0; i < count && stream.status() == QDataStream::Ok; ++i ) {
+    QString topic;
+    QByteArray identity;
+    stream >> topic >> identity;
+    mIdentities.insert( topic, identity );
+    readData( stream, topic );
+  }
+
+  if ( stream.status() != QDataStream::Ok ) {
+    qWarning( "Error reading index '%s'.", qPrintable( mFilename ) );
+    mIdentities.clear();
+    clearData();
+    return false;
+  }
+
+  mModified = false;
+
+  return true;
+}
+
+bool TopicDataIndex::save()
+{
+  if ( !mModified ) return true;
+
+  QFile file( SaveQueue::temporaryFilename( mFilename ) );
+  if ( !file.open( QIODevice::WriteOnly ) ) {
+    qWarning( "Unable to write index '%s'.", qPrintable( mFilename ) );
+    return false;
+  }
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_0 );
+
+  stream << mMagic << mVersion;
+
+  stream << qint32( mIdentities.count() );
+  QHash<QString, QByteArray>::const_iterator it;
+  for( it = mIdentities.constBegin(); it != mIdentities.constEnd(); ++it ) {
+    stream << it.key() << it.value();
+    writeData( stream, it.key() );
+  }
+
+  if ( !SaveQueue::replaceFile( file, mFilename ) ) return false;
+
+  mModified = false;
+
+  return true;
+}
+
+void TopicDataIndex::setTopicIdentity( const QString &topic,
+  const QByteArray &identity )
+{
+  mIdentities.insert( topic, identity );
+  mModified = true;
+}
+
+bool TopicDataIndex::removeTopic( const QString &topic )
+{
+  if ( mIdentities.remove( topic ) == 0 ) return false;
+
+  mModified = true;
+  return true;
+}
+
+void TopicDataIndex::setIdentity( const QString &topic,
+  const QByteArray &identity )
+{
+  if ( !mIdentities.contains( topic ) ) return;
+
+  setTopicIdentity( topic, identity );
+}
+
+QByteArray TopicDataIndex::identity( const QString &topic ) const
+{
+  return mIdentities.value( topic );
+}
+
+QStringList TopicDataIndex::topics() const
+{
+  QStringList result = mIdentities.keys();
+  qSort( result );
+  return result;
+}
+
+void TopicDataIndex::indexFiles( const QMap<QString, QString> &files )
+{
+  if ( files.isEmpty() ) return;
+
+  dbg() << "Indexing " << files.count() << " topics for '" << mFilename
+    << "'" << endl;
+
+  QMap<QString, TopicDataJob::Data> data;
+  QMutex mutex;
+
+  QThreadPool pool;
+  QMap<QString, QString>::const_iterator it;
+  for( it = files.constBegin(); it != files.constEnd(); ++it ) {
+    pool.start( new TopicDataJob( this, it.key(), it.value(), &data,
+      &mutex ) );
+  }
+  pool.waitForDone();
+
+  QMap<QString, TopicDataJob::Data>::const_iterator d;
+  for( d = data.constBegin(); d != data.constEnd(); ++d ) {
+    updateFromFile( d.key(), d.value().first, d.value().second );
+  }
+}
@@ -0,0 +1,150 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICDATAINDEX_H
+#define TOPICDATAINDEX_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QVariant>
+
+class QDataStream;
+class TopicDataJob;
+
+/**
+  This class is the base class for indexes holding data extracted from the
+  topic files, like links or todo items.
+
+  The data of each topic is stored in a file in the topic directory together
+  with the identity of the topic file it was extracted from, so outdated
+  entries can be detected. Subclasses encode the data of a topic and extract
+  it from topic files.
+*/
+class TopicDataIndex : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      Create empty index stored in the given file.
+      
+      \param filename name of index file
+      \param magic magic number identifying the type of index
+      \param version version of the encoding of the data
+      \param parent parent object
+    */
+    TopicDataIndex( const QString &filename, quint32 magic, qint32 version,
+      QObject *parent = 0 );
+
+    /**
+      Load index from file.
+      
+      \return \c true on success, \c false if the file couldn't be read
+    */
+    bool load();
+    /**
+      Write index to file, if it was modified.
+      
+      \return \c true on success, \c false on error
+    */
+    bool save();
+
+    /**
+      Set identity of the topic file the data of the topic was written to.
+    */
+    void setIdentity( const QString &topic, const QByteArray &identity );
+    /**
+      Return identity of the topic file the data was taken from. Returns an
+      empty identity, if the topic isn't indexed or the data wasn't written
+      yet.
+    */
+    QByteArray identity( const QString &topic ) const;
+
+    /**
+      Return sorted list of all indexed topics.
+    */
+    QStringList topics() const;
+
+    /**
+      Extract data from the given topic files. The files are read in parallel
+      by a pool of threads.
+      
+      \param files map of topic names to names of topic files
+    */
+    void indexFiles( const QMap<QString, QString> &files );
+
+  protected:
+    /**
+      Remove data of all topics.
+    */
+    virtual void clearData() = 0;
+    /**
+      Read data of topic from index file.
+    */
+    virtual void readData( QDataStream &stream, const QString &topic ) = 0;
+    /**
+      Write data of topic to index file.
+    */
+    virtual void writeData( QDataStream &stream,
+      const QString &topic ) const = 0;
+    /**
+      Extract data from topic file. This is called from the threads of a
+      pool, so it must not access the index.
+      
+      \param filename name of topic file
+      \param data extracted data, passed to updateFromFile()
+      \return \c true on success, \c false on error
+    */
+    virtual bool readFile( const QString &filename, QVariant &data ) const = 0;
+    /**
+      Set data of topic extracted by readFile().
+    */
+    virtual void updateFromFile( const QString &topic, const QVariant &data,
+      const QByteArray &identity ) = 0;
+
+    /**
+      Record identity of topic file and mark index as modified.
+    */
+    void setTopicIdentity( const QString &topic, const QByteArray &identity );
+    /**
+      Remove topic from index.
+      
+      \return \c true, if the topic was indexed
+    */
+    bool removeTopic( const QString &topic );
+    bool contains( const QString &topic ) const
+    {
+      return mIdentities.contains( topic );
+    }
+
+  private:
+    friend class TopicDataJob;
+
+    QString mFilename;
+    quint32 mMagic;
+    qint32 mVersion;
+    bool mModified;
+
+    QHash<QString, QByteArray> mIdentities;
+};
+
+#endif
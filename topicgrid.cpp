@@ -0,0 +1,104 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topicgrid.h"
+
+#include <QSet>
+
+TopicGrid::TopicGrid( int cellSize )
+  : mCellSize( cellSize )
+{
+}
+
+void TopicGrid::clear()
+{
+  mCells.clear();
+}
+
+int TopicGrid::cell( int coordinate ) const
+{
+  // Round towards negative infinity, so cells don't overlap at the origin
+  if ( coordinate >= 0 ) return coordinate / mCellSize;
+  else return ( coordinate + 1 ) / mCellSize - 1;
+}
+
+quint64 TopicGrid::key( int column, int row )
+{
+  return quint64( quint32( column ) ) << 32 | quint32( row );
+}
+
+void TopicGrid::insert( TopicItem *item, const QRect &rect )
+{
+  for( int column = cell( rect.left() ); column <= cell( rect.right() );
+       ++column ) {
+    for( int row = cell( rect.top() ); row <= cell( rect.bottom() ); ++row ) {
+      mCells[ key( column, row ) ].append( item );
+    }
+  }
+}
+
+void TopicGrid::remove( TopicItem *item, const QRect &rect )
+{
+  for( int column = cell( rect.left() ); column <= cell( rect.right() );
+       ++column ) {
+    for( int row = cell( rect.top() ); row <= cell( rect.bottom() ); ++row ) {
+      QHash<quint64, QList<TopicItem *> >::iterator it =
+        mCells.find( key( column, row ) );
+      if ( it == mCells.end() ) continue;
+      it.value().removeAll( item );
+      if ( it.value().isEmpty() ) mCells.erase( it );
+    }
+  }
+}
+
+int TopicGrid::count( const QRect &rect, int limit ) const
+{
+  int result = 0;
+
+  for( int column = cell( rect.left() ); column <= cell( rect.right() );
+       ++column ) {
+    for( int row = cell( rect.top() ); row <= cell( rect.bottom() ); ++row ) {
+      QHash<quint64, QList<TopicItem *> >::const_iterator it =
+        mCells.find( key( column, row ) );
+      if ( it == mCells.end() ) continue;
+      result += it.value().count();
+      if ( result >= limit ) return result;
+    }
+  }
+
+  return result;
+}
+
+QList<TopicItem *> TopicGrid::items( const QRect &rect ) const
+{
+  QSet<TopicItem *> result;
+
+  for( int column = cell( rect.left() ); column <= cell( rect.right() );
+       ++column ) {
+    for( int row = cell( rect.top() ); row <= cell( rect.bottom() ); ++row ) {
+      QHash<quint64, QList<TopicItem *> >::const_iterator it =
+        mCells.find( key( column, row ) );
+      if ( it == mCells.end() ) continue;
+      foreach( TopicItem *item, it.value() ) result.insert( item );
+    }
+  }
+
+  return result.toList();
+}
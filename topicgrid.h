@@ -0,0 +1,81 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICGRID_H
+#define TOPICGRID_H
+
+#include <QHash>
+#include <QList>
+#include <QRect>
+
+class TopicItem;
+
+/**
+  This class is a spatial index of the items of the topic map. The plane is
+  divided into square cells and each item is recorded in all cells its
+  rectangle overlaps, so the items in an area can be found without looking
+  at all items.
+*/
+class TopicGrid
+{
+  public:
+    /**
+      Create empty grid.
+      
+      \param cellSize width and height of the cells in pixels
+    */
+    TopicGrid( int cellSize = 64 );
+
+    /**
+      Remove all items.
+    */
+    void clear();
+
+    /**
+      Add item covering the given rectangle.
+    */
+    void insert( TopicItem *item, const QRect &rect );
+    /**
+      Remove item, which was added with the given rectangle.
+    */
+    void remove( TopicItem *item, const QRect &rect );
+
+    /**
+      Return items in cells overlapping the given rectangle. Each item is
+      returned once, but not all of them necessarily intersect the
+      rectangle.
+    */
+    QList<TopicItem *> items( const QRect &rect ) const;
+    /**
+      Return number of entries in cells overlapping the given rectangle.
+      Items covering several cells are counted for each cell. Counting stops
+      when the limit is reached.
+    */
+    int count( const QRect &rect, int limit ) const;
+
+  protected:
+    int cell( int coordinate ) const;
+    static quint64 key( int column, int row );
+
+  private:
+    int mCellSize;
+    QHash<quint64, QList<TopicItem *> > mCells;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topicindex.h"
+
+#include <QtAlgorithms>
+
+TopicIndex::TopicIndex( QObject *parent )
+  : QObject( parent )
+{
+}
+
+void TopicIndex::setTopics( const QStringList &topics )
+{
+  mSortedTopics = topics;
+  qSort( mSortedTopics );
+
+  mTopics.clear();
+  mTopics.reserve( topics.count() );
+  foreach( QString topic, topics ) mTopics.insert( topic );
+
+  emit topicsReset();
+}
+
+void TopicIndex::add( const QString &topic )
+{
+  if ( mTopics.contains( topic ) ) return;
+
+  QStringList::const_iterator it = qLowerBound( mSortedTopics.constBegin(),
+    mSortedTopics.constEnd(), topic );
+  int row = it - mSortedTopics.constBegin();
+
+  emit topicAboutToBeAdded( topic, row );
+
+  mTopics.insert( topic );
+  mSortedTopics.insert( row, topic );
+
+  emit topicAdded( topic );
+}
+
+void TopicIndex::remove( const QString &topic )
+{
+  int row = indexOf( topic );
+  if ( row < 0 ) return;
+
+  emit topicAboutToBeRemoved( topic, row );
+
+  mTopics.remove( topic );
+  mSortedTopics.removeAt( row );
+
+  emit topicRemoved( topic );
+}
+
+int TopicIndex::indexOf( const QString &topic ) const
+{
+  if ( !mTopics.contains( topic ) ) return -1;
+
+  QStringList::const_iterator it = qLowerBound( mSortedTopics.begin(),
+    mSortedTopics.end(), topic );
+  return it - mSortedTopics.begin();
+}
+
+QStringList TopicIndex::topicsWithPrefix( const QString &prefix ) const
+{
+  QStringList result;
+
+  QStringList::const_iterator it = qLowerBound( mSortedTopics.begin(),
+    mSortedTopics.end(), prefix );
+  for( ; it != mSortedTopics.end() && (*it).startsWith( prefix ); ++it ) {
+    result.append( *it );
+  }
+
+  return result;
+}
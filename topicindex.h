@@ -0,0 +1,114 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICINDEX_H
+#define TOPICINDEX_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QSet>
+
+/**
+  This class holds the names of all topics. It provides constant time lookup
+  of names and prefix queries on the sorted list of names. The index is kept
+  up to date when topics are created or deleted.
+*/
+class TopicIndex : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      Create empty index.
+    */
+    TopicIndex( QObject *parent = 0 );
+
+    /**
+      Set names of all topics. This replaces the current content of the
+      index and emits topicsReset().
+    */
+    void setTopics( const QStringList &topics );
+
+    /**
+      Add topic to index. Nothing happens, if the topic already is in the
+      index.
+      
+      \param topic name of topic
+    */
+    void add( const QString &topic );
+    /**
+      Remove topic from index.
+      
+      \param topic name of topic
+    */
+    void remove( const QString &topic );
+
+    /**
+      Return, if the index contains the given topic.
+    */
+    bool contains( const QString &topic ) const
+    {
+      return mTopics.contains( topic );
+    }
+
+    /**
+      Return number of topics.
+    */
+    int count() const { return mSortedTopics.count(); }
+
+    /**
+      Return sorted list of all topics.
+    */
+    QStringList topics() const { return mSortedTopics; }
+
+    /**
+      Return position of topic in the sorted list of topics or -1, if the
+      topic isn't in the index.
+    */
+    int indexOf( const QString &topic ) const;
+
+    /**
+      Return sorted list of topics starting with the given prefix.
+    */
+    QStringList topicsWithPrefix( const QString &prefix ) const;
+
+  signals:
+    /**
+      Emitted before a topic is added at the given position of the sorted
+      list of topics.
+    */
+    void topicAboutToBeAdded( const QString &topic, int row );
+    void topicAdded( const QString &topic );
+    /**
+      Emitted before a topic is removed from the given position of the sorted
+      list of topics.
+    */
+    void topicAboutToBeRemoved( const QString &topic, int row );
+    void topicRemoved( const QString &topic );
+    /**
+      Emitted when the complete content of the index was replaced.
+    */
+    void topicsReset();
+
+  private:
+    QSet<QString> mTopics;
+    QStringList mSortedTopics;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "topicinfo.h"
 
 TopicInfo::TopicInfo()
+  : mSize( 0 ), mLinkCount( 0 ), mTodoCount( 0 ), mDoneCount( 0 )
 {
 }
 
@@ -37,3 +38,63 @@ QDateTime TopicInfo::lastModified() const
 {
   return mLastModified;
 }
+
+void TopicInfo::setSize( qint64 size )
+{
+  mSize = size;
+}
+
+qint64 TopicInfo::size() const
+{
+  return mSize;
+}
+
+void TopicInfo::setTitle( const QString &title )
+{
+  mTitle = title;
+}
+
+QString TopicInfo::title() const
+{
+  return mTitle;
+}
+
+void TopicInfo::setLinkCount( int count )
+{
+  mLinkCount = count;
+}
+
+int TopicInfo::linkCount() const
+{
+  return mLinkCount;
+}
+
+void TopicInfo::setTodoCount( int count )
+{
+  mTodoCount = count;
+}
+
+int TopicInfo::todoCount() const
+{
+  return mTodoCount;
+}
+
+void TopicInfo::setDoneCount( int count )
+{
+  mDoneCount = count;
+}
+
+int TopicInfo::doneCount() const
+{
+  return mDoneCount;
+}
+
+void TopicInfo::setHash( const QByteArray &hash )
+{
+  mHash = hash;
+}
+
+QByteArray TopicInfo::hash() const
+{
+  return mHash;
+}
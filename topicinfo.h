@@ -22,6 +22,7 @@
 
 #include <QString>
 #include <QDateTime>
+#include <QByteArray>
 
 /**
   This class holds information about a topic.
@@ -44,8 +45,68 @@ class TopicInfo
     */
     QDateTime lastModified() const;
 
+    /**
+      Set size of topic file in bytes.
+    */
+    void setSize( qint64 size );
+    /**
+      Return size of topic file in bytes.
+    */
+    qint64 size() const;
+
+    /**
+      Set title of topic, the text of its first block.
+    */
+    void setTitle( const QString &title );
+    /**
+      Return title of topic.
+    */
+    QString title() const;
+
+    /**
+      Set number of topics the topic links to.
+    */
+    void setLinkCount( int count );
+    /**
+      Return number of topics the topic links to.
+    */
+    int linkCount() const;
+
+    /**
+      Set number of todo items, which aren't done yet.
+    */
+    void setTodoCount( int count );
+    /**
+      Return number of todo items, which aren't done yet.
+    */
+    int todoCount() const;
+
+    /**
+      Set number of todo items, which are done.
+    */
+    void setDoneCount( int count );
+    /**
+      Return number of todo items, which are done.
+    */
+    int doneCount() const;
+
+    /**
+      Set hash of the content of the topic file.
+    */
+    void setHash( const QByteArray &hash );
+    /**
+      Return hash of the content of the topic file.
+    */
+    QByteArray hash() const;
+
   private:
     QDateTime mLastModified;
+    qint64 mSize;
+    QString mTitle;
+    int mLinkCount;
+    int mTodoCount;
+    int mDoneCount;
+    QByteArray mHash;
 };
 
 #endif
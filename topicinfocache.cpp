@@ -0,0 +1,291 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topicinfocache.h"
+
+#include "format.h"
+#include "formatbinary.h"
+#include "dbg.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QTextDocument>
+#include <QCryptographicHash>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <QtAlgorithms>
+
+static const quint32 topicInfoCacheMagic = 0x54444943;
+static const quint32 topicInfoCacheVersion = 2;
+
+// Type specific data of the header: hash of the identity of the topic
+// directory
+static const int hashSize = 16;
+
+// Layout of a record: offset and length of name, offset and length of
+// title, modification time, link count, todo count, done count, file size,
+// hash
+static const int recordSize = 56;
+
+/**
+  This class reads the information about one topic file.
+*/
+class InfoJob : public QRunnable
+{
+  public:
+    InfoJob( const QString &topic, const QString &filename,
+      QMap<QString, TopicInfo> *infos, QMutex *mutex )
+      : mTopic( topic ), mFilename( filename ), mInfos( infos ),
+        mMutex( mutex )
+    {
+    }
+
+    void run()
+    {
+      TopicInfo info;
+      if ( !TopicInfoCache::readFile( mFilename, info ) ) {
+        qWarning( "Error reading info of '%s'.", qPrintable( mFilename ) );
+        return;
+      }
+
+      QMutexLocker locker( mMutex );
+      mInfos->insert( mTopic, info );
+    }
+
+  private:
+    QString mTopic;
+    QString mFilename;
+    QMap<QString, TopicInfo> *mInfos;
+    QMutex *mMutex;
+};
+
+
+TopicInfoCache::TopicInfoCache( const QString &filename )
+  : mTable( filename, topicInfoCacheMagic, topicInfoCacheVersion, hashSize,
+      recordSize ),
+    mModified( false )
+{
+}
+
+bool TopicInfoCache::open()
+{
+  if ( !mTable.open() ) return false;
+
+  mDirIdentity = mTable.headerData();
+
+  return true;
+}
+
+void TopicInfoCache::readRecord( int record, TopicInfo &info ) const
+{
+  const uchar *r = mTable.record( record );
+
+  info.setTitle( mTable.string( qFromLittleEndian<quint32>( r + 8 ),
+    qFromLittleEndian<quint32>( r + 12 ) ) );
+  info.setLastModified(
+    QDateTime::fromTime_t( qFromLittleEndian<quint32>( r + 16 ) ) );
+  info.setLinkCount( qFromLittleEndian<quint32>( r + 20 ) );
+  info.setTodoCount( qFromLittleEndian<quint32>( r + 24 ) );
+  info.setDoneCount( qFromLittleEndian<quint32>( r + 28 ) );
+  info.setSize( qFromLittleEndian<qint64>( r + 32 ) );
+  info.setHash( QByteArray( reinterpret_cast<const char *>( r + 40 ),
+    hashSize ) );
+}
+
+bool TopicInfoCache::lookup( const QString &topic, TopicInfo &info ) const
+{
+  QMap<QString, TopicInfo>::ConstIterator it = mChanged.find( topic );
+  if ( it != mChanged.end() ) {
+    info = it.value();
+    return true;
+  }
+  if ( mRemoved.contains( topic ) ) return false;
+
+  int record = mTable.find( topic );
+  if ( record < 0 ) return false;
+
+  readRecord( record, info );
+  return true;
+}
+
+void TopicInfoCache::update( const QString &topic, const TopicInfo &info )
+{
+  mChanged.insert( topic, info );
+  mRemoved.remove( topic );
+  mModified = true;
+}
+
+void TopicInfoCache::remove( const QString &topic )
+{
+  mChanged.remove( topic );
+  mRemoved.insert( topic );
+  mModified = true;
+}
+
+QStringList TopicInfoCache::topics() const
+{
+  QStringList result;
+  foreach( QString topic, mTable.names() ) {
+    if ( !mRemoved.contains( topic ) && !mChanged.contains( topic ) ) {
+      result.append( topic );
+    }
+  }
+  result += mChanged.keys();
+  qSort( result );
+  return result;
+}
+
+bool TopicInfoCache::save()
+{
+  if ( !mModified ) return true;
+
+  QMap<QString, TopicInfo> infos;
+  for( int record = 0; record < mTable.count(); ++record ) {
+    QString topic = mTable.name( record );
+    if ( mRemoved.contains( topic ) || mChanged.contains( topic ) ) continue;
+    TopicInfo info;
+    readRecord( record, info );
+    infos.insert( topic, info );
+  }
+  QMap<QString, TopicInfo>::ConstIterator it;
+  for( it = mChanged.begin(); it != mChanged.end(); ++it ) {
+    infos.insert( it.key(), it.value() );
+  }
+
+  mTable.beginWrite( infos.count(), mDirIdentity );
+  for( it = infos.begin(); it != infos.end(); ++it ) {
+    const TopicInfo &info = it.value();
+
+    mTable.appendString( it.key() );
+    mTable.appendString( info.title() );
+    mTable.appendUInt32( info.lastModified().toTime_t() );
+    mTable.appendUInt32( info.linkCount() );
+    mTable.appendUInt32( info.todoCount() );
+    mTable.appendUInt32( info.doneCount() );
+    mTable.appendInt64( info.size() );
+    mTable.appendBytes( info.hash(), hashSize );
+  }
+
+  // On error the changes stay pending
+  if ( !mTable.commit() ) return false;
+
+  mChanged.clear();
+  mRemoved.clear();
+  mModified = false;
+
+  return true;
+}
+
+static QByteArray identityHash( const QByteArray &identity )
+{
+  return QCryptographicHash::hash( identity, QCryptographicHash::Md5 );
+}
+
+bool TopicInfoCache::hasDirIdentity( const QByteArray &identity ) const
+{
+  return !identity.isEmpty() && mDirIdentity == identityHash( identity );
+}
+
+bool TopicInfoCache::writeDirIdentity( const QByteArray &identity )
+{
+  mDirIdentity = identityHash( identity );
+
+  return mTable.writeHeaderData( mDirIdentity );
+}
+
+void TopicInfoCache::readFiles( const QMap<QString, QString> &files )
+{
+  if ( files.isEmpty() ) return;
+
+  dbg() << "Reading info of " << files.count() << " topics" << endl;
+
+  QMap<QString, TopicInfo> infos;
+  QMutex mutex;
+
+  QThreadPool pool;
+  QMap<QString, QString>::const_iterator it;
+  for( it = files.constBegin(); it != files.constEnd(); ++it ) {
+    pool.start( new InfoJob( it.key(), it.value(), &infos, &mutex ) );
+  }
+  pool.waitForDone();
+
+  QMap<QString, TopicInfo>::const_iterator i;
+  for( i = infos.constBegin(); i != infos.constEnd(); ++i ) {
+    update( i.key(), i.value() );
+  }
+}
+
+bool TopicInfoCache::readFile( const QString &filename, TopicInfo &info )
+{
+  QFile file( filename );
+  if ( !file.open( QIODevice::ReadOnly ) ) return false;
+
+  QByteArray data = file.readAll();
+  file.close();
+
+  Format::Summary summary;
+  if ( FormatBinary::isBinary( filename ) ) {
+    QTextDocument document;
+    FormatBinary format( &document );
+    if ( !format.load( filename ) ) return false;
+    summary = Format( &document ).summary();
+  } else {
+    QBuffer buffer( &data );
+    buffer.open( QIODevice::ReadOnly );
+    if ( !Format::readSummary( &buffer, summary ) ) return false;
+  }
+
+  info.setLastModified( QFileInfo( filename ).lastModified() );
+  info.setSize( data.size() );
+  info.setHash( QCryptographicHash::hash( data, QCryptographicHash::Md5 ) );
+  info.setTitle( summary.title );
+  info.setLinkCount( summary.links.count() );
+  info.setTodoCount( summary.todoCount );
+  info.setDoneCount( summary.doneCount );
+
+  return true;
+}
+
+TopicInfo TopicInfoCache::documentInfo( QTextDocument *document,
+  const QList<QByteArray> &segments )
+{
+  TopicInfo info;
+
+  QCryptographicHash hash( QCryptographicHash::Md5 );
+  qint64 size = 0;
+  foreach( QByteArray segment, segments ) {
+    hash.addData( segment );
+    size += segment.size();
+  }
+  info.setSize( size );
+  info.setHash( hash.result() );
+
+  Format::Summary summary = Format( document ).summary();
+  info.setTitle( summary.title );
+  info.setLinkCount( summary.links.count() );
+  info.setTodoCount( summary.todoCount );
+  info.setDoneCount( summary.doneCount );
+
+  return info;
+}
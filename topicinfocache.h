@@ -0,0 +1,144 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICINFOCACHE_H
+#define TOPICINFOCACHE_H
+
+#include "topicinfo.h"
+#include "mappedtable.h"
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QSet>
+#include <QList>
+#include <QByteArray>
+
+class QTextDocument;
+
+/**
+  This class caches the information about all topics in a file in the topic
+  directory, so lists of topics can be shown without reading the topic
+  files.
+
+  The file is a MappedTable with a record for each topic. Changes are kept
+  in memory until the cache is saved.
+
+  Along with the records the file holds the identity of the topic directory
+  as returned by SaveQueue::fileIdentity(). As topic files are replaced by
+  renaming them, it changes whenever a topic is written, so the cache can be
+  trusted as a whole, if the identity is unchanged.
+*/
+class TopicInfoCache
+{
+  public:
+    /**
+      Create empty cache stored in the given file.
+    */
+    TopicInfoCache( const QString &filename );
+
+    /**
+      Map cache file.
+      
+      \return \c true on success, \c false if the file doesn't exist or isn't
+        valid
+    */
+    bool open();
+    /**
+      Write cache to file, if it was modified, and map the new file.
+      
+      \return \c true on success, \c false on error
+    */
+    bool save();
+
+    /**
+      Return, if the given identity of the topic directory is the one
+      recorded in the cache.
+    */
+    bool hasDirIdentity( const QByteArray &identity ) const;
+    /**
+      Record identity of the topic directory. It is written to the existing
+      file in place, so the directory isn't modified by this.
+      
+      \param identity identity as returned by SaveQueue::fileIdentity()
+      \return \c true on success, \c false on error
+    */
+    bool writeDirIdentity( const QByteArray &identity );
+
+    /**
+      Look up information about topic.
+      
+      \param topic name of topic
+      \param info information filled from the cache
+      \return \c true, if the topic is cached, \c false otherwise
+    */
+    bool lookup( const QString &topic, TopicInfo &info ) const;
+    /**
+      Set information about topic.
+    */
+    void update( const QString &topic, const TopicInfo &info );
+    /**
+      Remove topic from cache.
+    */
+    void remove( const QString &topic );
+    /**
+      Return names of all cached topics.
+    */
+    QStringList topics() const;
+
+    /**
+      Read information from the given topic files and put it into the cache.
+      The files are read in parallel by a pool of threads.
+      
+      \param files map of topic names to names of topic files
+    */
+    void readFiles( const QMap<QString, QString> &files );
+
+    /**
+      Read information about a topic from its file.
+      
+      \param filename name of topic file
+      \param info information filled from the file
+      \return \c true on success, \c false on error
+    */
+    static bool readFile( const QString &filename, TopicInfo &info );
+    /**
+      Return information about a topic from its document and the segments
+      written to its file. The time of last modification isn't set.
+      
+      \param document document of topic
+      \param segments data of topic file
+    */
+    static TopicInfo documentInfo( QTextDocument *document,
+      const QList<QByteArray> &segments );
+
+  protected:
+    void readRecord( int record, TopicInfo &info ) const;
+
+  private:
+    MappedTable mTable;
+    /** Hash of the identity of the topic directory */
+    QByteArray mDirIdentity;
+
+    QMap<QString, TopicInfo> mChanged;
+    QSet<QString> mRemoved;
+    bool mModified;
+};
+
+#endif
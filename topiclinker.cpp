@@ -0,0 +1,531 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topiclinker.h"
+
+#include "topicindex.h"
+#include "textformats.h"
+#include "format.h"
+#include "formatbinary.h"
+#include "journal.h"
+#include "savequeue.h"
+#include "dbg.h"
+
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QFileInfo>
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+
+/**
+  This class implements an Aho-Corasick automaton matching all topic names at
+  once. After it is built it is only read, so it can be shared by threads.
+*/
+class TopicAutomaton
+{
+  public:
+    struct Match
+    {
+      int start;
+      int length;
+      int topic;
+    };
+
+    TopicAutomaton( const QStringList &topics )
+      : mTopics( topics )
+    {
+      mNodes.append( Node() );
+
+      for( int i = 0; i < mTopics.count(); ++i ) {
+        const QString &topic = mTopics.at( i );
+        if ( topic.isEmpty() ) continue;
+        int n = 0;
+        foreach( QChar c, topic ) {
+          int next = mNodes.at( n ).next.value( c, -1 );
+          if ( next < 0 ) {
+            next = mNodes.count();
+            mNodes.append( Node() );
+            mNodes[ n ].next.insert( c, next );
+          }
+          n = next;
+        }
+        mNodes[ n ].topic = i;
+      }
+
+      // Breadth first traversal, so the failure links of the shorter
+      // prefixes are known when they are needed
+      QList<int> queue;
+      foreach( int child, mNodes.at( 0 ).next ) {
+        mNodes[ child ].fail = 0;
+        queue.append( child );
+      }
+      while( !queue.isEmpty() ) {
+        int n = queue.takeFirst();
+        QHash<QChar, int>::const_iterator it;
+        for( it = mNodes.at( n ).next.constBegin();
+             it != mNodes.at( n ).next.constEnd(); ++it ) {
+          int child = it.value();
+          int f = mNodes.at( n ).fail;
+          while( f > 0 && !mNodes.at( f ).next.contains( it.key() ) ) {
+            f = mNodes.at( f ).fail;
+          }
+          f = mNodes.at( f ).next.value( it.key(), 0 );
+          mNodes[ child ].fail = f;
+          if ( mNodes.at( f ).topic >= 0 ) mNodes[ child ].output = f;
+          else mNodes[ child ].output = mNodes.at( f ).output;
+          queue.append( child );
+        }
+      }
+    }
+
+    QString topic( int i ) const { return mTopics.at( i ); }
+
+    /**
+      Return all names occurring as whole words in the text. Overlapping
+      matches are resolved by taking the leftmost and then longest one.
+    */
+    QList<Match> scan( const QString &text ) const
+    {
+      QList<Match> matches;
+
+      int n = 0;
+      for( int i = 0; i < text.length(); ++i ) {
+        QChar c = text.at( i );
+        while( n > 0 && !mNodes.at( n ).next.contains( c ) ) {
+          n = mNodes.at( n ).fail;
+        }
+        n = mNodes.at( n ).next.value( c, 0 );
+
+        int m = mNodes.at( n ).topic >= 0 ? n : mNodes.at( n ).output;
+        while( m > 0 ) {
+          Match match;
+          match.topic = mNodes.at( m ).topic;
+          match.length = mTopics.at( match.topic ).length();
+          match.start = i + 1 - match.length;
+          if ( isWordBoundary( text, match.start ) &&
+               isWordBoundary( text, i + 1 ) ) {
+            matches.append( match );
+          }
+          m = mNodes.at( m ).output;
+        }
+      }
+
+      qSort( matches.begin(), matches.end(), lessThan );
+
+      QList<Match> result;
+      int end = 0;
+      foreach( Match match, matches ) {
+        if ( match.start < end ) continue;
+        result.append( match );
+        end = match.start + match.length;
+      }
+      return result;
+    }
+
+  protected:
+    static bool isWordChar( QChar c )
+    {
+      return c.isLetterOrNumber() || c == '_';
+    }
+
+    static bool isWordBoundary( const QString &text, int pos )
+    {
+      if ( pos <= 0 || pos >= text.length() ) return true;
+      return !isWordChar( text.at( pos - 1 ) ) || !isWordChar( text.at( pos ) );
+    }
+
+    static bool lessThan( const Match &m1, const Match &m2 )
+    {
+      if ( m1.start != m2.start ) return m1.start < m2.start;
+      return m1.length > m2.length;
+    }
+
+  private:
+    struct Node
+    {
+      Node() : fail( 0 ), output( -1 ), topic( -1 ) {}
+
+      QHash<QChar, int> next;
+      int fail;
+      /** Next node on the failure path which matches a name */
+      int output;
+      int topic;
+    };
+
+    QStringList mTopics;
+    QVector<Node> mNodes;
+};
+
+static bool containsLink( const QTextBlock &block, int from, int to )
+{
+  QTextBlock::iterator it;
+  for( it = block.begin(); !it.atEnd(); ++it ) {
+    QTextFragment fragment = it.fragment();
+    int start = fragment.position() - block.position();
+    int end = start + fragment.length();
+    if ( end <= from ) continue;
+    if ( start >= to ) break;
+    if ( fragment.charFormat().isAnchor() ) return true;
+  }
+  return false;
+}
+
+static int linkBlocks( const TopicAutomaton *automaton,
+  QTextDocument *document, int from, int to, const QString &topic )
+{
+  int count = 0;
+
+  QTextCursor cursor( document );
+
+  // Add the links to the edit which inserted the text, so they don't show up
+  // as separate step in the undo history
+  cursor.joinPreviousEditBlock();
+
+  QTextBlock block = document->findBlock( from );
+  QTextBlock last = document->findBlock( to );
+  while( block.isValid() ) {
+    QList<TopicAutomaton::Match> matches = automaton->scan( block.text() );
+    foreach( TopicAutomaton::Match match, matches ) {
+      QString name = automaton->topic( match.topic );
+      if ( name == topic ) continue;
+      if ( containsLink( block, match.start, match.start + match.length ) ) {
+        continue;
+      }
+      cursor.setPosition( block.position() + match.start );
+      cursor.setPosition( block.position() + match.start + match.length,
+        QTextCursor::KeepAnchor );
+      cursor.mergeCharFormat( TextFormats::topicLinkCharFormat( name ) );
+      ++count;
+    }
+
+    if ( block == last ) break;
+    block = block.next();
+  }
+
+  cursor.endEditBlock();
+
+  return count;
+}
+
+/**
+  This struct records the position of a link in a document.
+*/
+struct LinkFragment
+{
+  int position;
+  int length;
+  /** Text of the whole link, which might consist of several fragments */
+  QString text;
+};
+
+/**
+  This class changes the links in one topic file. Pending changes recorded in
+  the journal of the topic are included. The file is only written, if
+  something changed.
+*/
+class TopicFileJob : public QRunnable
+{
+  public:
+    TopicFileJob( const QString &filename, const QString &journalFilename,
+      QMutex *mutex, int *changed )
+      : mFilename( filename ), mJournalFilename( journalFilename ),
+        mMutex( mutex ), mChanged( changed )
+    {
+    }
+
+    void run()
+    {
+      QString topic = QFileInfo( mFilename ).completeBaseName();
+
+      bool binary = FormatBinary::isBinary( mFilename );
+
+      QTextDocument document;
+      bool loaded;
+      if ( binary ) {
+        FormatBinary format( &document );
+        loaded = format.load( mFilename );
+      } else {
+        Format format( &document );
+        loaded = format.load( mFilename );
+      }
+      if ( !loaded ) {
+        qWarning( "Error processing '%s': unable to load.",
+          qPrintable( mFilename ) );
+        setFailed();
+        return;
+      }
+
+      bool replayed = Journal::replay( mJournalFilename, &document,
+        SaveQueue::fileIdentity( mFilename ) );
+
+      int changes = process( &document, topic );
+      if ( changes == 0 && !replayed ) return;
+
+      dbg() << "Processed " << topic << ": " << changes << " changes" << endl;
+
+      bool saved;
+      if ( binary ) {
+        FormatBinary format( &document );
+        saved = format.save( mFilename );
+      } else {
+        Format format( &document );
+        saved = format.save( mFilename );
+      }
+      if ( !saved ) {
+        qWarning( "Error processing '%s': unable to save.",
+          qPrintable( mFilename ) );
+        setFailed();
+        return;
+      }
+
+      QFile::remove( mJournalFilename );
+
+      QMutexLocker locker( mMutex );
+      if ( *mChanged >= 0 ) ++(*mChanged);
+    }
+
+  protected:
+    /**
+      Change the document holding the data of the given topic.
+      
+      \return number of changes
+    */
+    virtual int process( QTextDocument *document, const QString &topic ) = 0;
+
+    void setFailed()
+    {
+      QMutexLocker locker( mMutex );
+      *mChanged = -1;
+    }
+
+  private:
+    QString mFilename;
+    QString mJournalFilename;
+    QMutex *mMutex;
+    int *mChanged;
+};
+
+/**
+  This class links the topic names in one topic file.
+*/
+class RelinkJob : public TopicFileJob
+{
+  public:
+    RelinkJob( const TopicAutomaton *automaton, const QString &filename,
+      const QString &journalFilename, QMutex *mutex, int *changed )
+      : TopicFileJob( filename, journalFilename, mutex, changed ),
+        mAutomaton( automaton )
+    {
+    }
+
+  protected:
+    int process( QTextDocument *document, const QString &topic )
+    {
+      return linkBlocks( mAutomaton, document, 0,
+        document->characterCount(), topic );
+    }
+
+  private:
+    const TopicAutomaton *mAutomaton;
+};
+
+/**
+  This class changes the links to a renamed topic in one topic file. The title
+  of the renamed topic itself is changed as well.
+*/
+class RenameJob : public TopicFileJob
+{
+  public:
+    RenameJob( const QString &from, const QString &to,
+      const QString &filename, const QString &journalFilename,
+      QMutex *mutex, int *changed )
+      : TopicFileJob( filename, journalFilename, mutex, changed ),
+        mFrom( from ), mTo( to )
+    {
+    }
+
+  protected:
+    int process( QTextDocument *document, const QString &topic )
+    {
+      int count = TopicLinker::renameLinks( document, mFrom, mTo );
+      if ( topic == mTo ) {
+        if ( TopicLinker::renameTitle( document, mFrom, mTo ) ) ++count;
+      }
+      return count;
+    }
+
+  private:
+    QString mFrom;
+    QString mTo;
+};
+
+TopicLinker::TopicLinker( TopicIndex *index, QObject *parent )
+  : QObject( parent ), mIndex( index ), mAutomaton( 0 )
+{
+  connect( mIndex, SIGNAL( topicAdded( const QString & ) ),
+    SLOT( slotInvalidate() ) );
+  connect( mIndex, SIGNAL( topicRemoved( const QString & ) ),
+    SLOT( slotInvalidate() ) );
+  connect( mIndex, SIGNAL( topicsReset() ), SLOT( slotInvalidate() ) );
+}
+
+TopicLinker::~TopicLinker()
+{
+  delete mAutomaton;
+}
+
+void TopicLinker::slotInvalidate()
+{
+  delete mAutomaton;
+  mAutomaton = 0;
+}
+
+const TopicAutomaton *TopicLinker::automaton()
+{
+  if ( !mAutomaton ) {
+    mAutomaton = new TopicAutomaton( mIndex->topics() );
+  }
+  return mAutomaton;
+}
+
+int TopicLinker::linkRange( QTextDocument *document, int from, int to,
+  const QString &topic )
+{
+  return linkBlocks( automaton(), document, from, to, topic );
+}
+
+int TopicLinker::linkDocument( QTextDocument *document,
+  const QString &topic )
+{
+  return linkBlocks( automaton(), document, 0, document->characterCount(),
+    topic );
+}
+
+int TopicLinker::relinkFiles( const QMap<QString, QString> &files )
+{
+  const TopicAutomaton *a = automaton();
+
+  QMutex mutex;
+  int changed = 0;
+
+  QThreadPool pool;
+  QMap<QString, QString>::const_iterator it;
+  for( it = files.constBegin(); it != files.constEnd(); ++it ) {
+    pool.start( new RelinkJob( a, it.key(), it.value(), &mutex, &changed ) );
+  }
+  pool.waitForDone();
+
+  return changed;
+}
+
+int TopicLinker::renameInFiles( const QMap<QString, QString> &files,
+  const QString &from, const QString &to )
+{
+  QMutex mutex;
+  int changed = 0;
+
+  QThreadPool pool;
+  QMap<QString, QString>::const_iterator it;
+  for( it = files.constBegin(); it != files.constEnd(); ++it ) {
+    pool.start( new RenameJob( from, to, it.key(), it.value(), &mutex,
+      &changed ) );
+  }
+  pool.waitForDone();
+
+  return changed;
+}
+
+int TopicLinker::renameLinks( QTextDocument *document, const QString &from,
+  const QString &to )
+{
+  QString fromHref = "todoodle:" + from;
+
+  QList<LinkFragment> links;
+  QTextBlock block;
+  for( block = document->begin(); block.isValid(); block = block.next() ) {
+    QTextBlock::iterator it;
+    for( it = block.begin(); !it.atEnd(); ++it ) {
+      QTextFragment fragment = it.fragment();
+      if ( fragment.charFormat().anchorHref() != fromHref ) continue;
+
+      // Parts of a link with different formats are separate fragments
+      if ( !links.isEmpty() && links.last().position + links.last().length ==
+           fragment.position() ) {
+        links.last().length += fragment.length();
+        links.last().text += fragment.text();
+      } else {
+        LinkFragment link;
+        link.position = fragment.position();
+        link.length = fragment.length();
+        link.text = fragment.text();
+        links.append( link );
+      }
+    }
+  }
+
+  QTextCursor cursor( document );
+  cursor.beginEditBlock();
+
+  // Replace from the end, so the positions of the remaining links stay valid
+  // when the text changes
+  for( int i = links.count() - 1; i >= 0; --i ) {
+    const LinkFragment &link = links.at( i );
+    cursor.setPosition( link.position );
+    cursor.setPosition( link.position + link.length,
+      QTextCursor::KeepAnchor );
+
+    if ( link.text == from ) {
+      QTextCharFormat format = cursor.charFormat();
+      format.setAnchorHref( "todoodle:" + to );
+      cursor.insertText( to, format );
+    } else {
+      // Keep the formats of the parts of the link
+      QTextCharFormat format;
+      format.setAnchorHref( "todoodle:" + to );
+      cursor.mergeCharFormat( format );
+    }
+  }
+
+  cursor.endEditBlock();
+
+  return links.count();
+}
+
+bool TopicLinker::renameTitle( QTextDocument *document, const QString &from,
+  const QString &to )
+{
+  QTextBlock title = document->begin();
+  if ( title.text() != from ) return false;
+
+  QTextCharFormat format = title.begin().fragment().charFormat();
+
+  QTextCursor cursor( title );
+  cursor.movePosition( QTextCursor::EndOfBlock, QTextCursor::KeepAnchor );
+  cursor.insertText( to, format );
+
+  return true;
+}
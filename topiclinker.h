@@ -0,0 +1,125 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICLINKER_H
+#define TOPICLINKER_H
+
+#include <QObject>
+#include <QString>
+#include <QMap>
+
+class TopicIndex;
+class TopicAutomaton;
+
+class QTextDocument;
+
+/**
+  This class converts all occurrences of topic names in a text into links to
+  the topics. It uses an automaton built from the names in the topic index,
+  which finds all names, including names consisting of multiple words, in one
+  pass over the text. The automaton is rebuilt, when the index changes.
+
+  Only whole words are linked. Text which already is a link is left alone.
+  When names overlap the longest name starting first wins.
+*/
+class TopicLinker : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      Create linker for the topics of the given index.
+    */
+    TopicLinker( TopicIndex *index, QObject *parent = 0 );
+    ~TopicLinker();
+
+    /**
+      Link topic names in the blocks of the document touching the given range.
+      
+      \param document document to be modified
+      \param from start position of range
+      \param to end position of range
+      \param topic name of the topic shown in the document. It isn't linked
+        to itself.
+      \return number of created links
+    */
+    int linkRange( QTextDocument *document, int from, int to,
+      const QString &topic );
+    /**
+      Link topic names in the whole document.
+      
+      \return number of created links
+    */
+    int linkDocument( QTextDocument *document, const QString &topic );
+
+    /**
+      Link topic names in the given topic files. The files are processed in
+      parallel by a pool of threads. Pending changes recorded in the journals
+      are included in the linked files and the journals of changed files are
+      removed. Files are kept in their format.
+      
+      \param files map of names of topic files to names of their journals
+      \return number of changed files or -1, if a file couldn't be processed
+    */
+    int relinkFiles( const QMap<QString, QString> &files );
+
+    /**
+      Change all links to a topic into links to the new name of the topic.
+      Link text showing the old name is changed to the new name.
+      
+      \param document document to be modified
+      \param from old name of topic
+      \param to new name of topic
+      \return number of changed links
+    */
+    static int renameLinks( QTextDocument *document, const QString &from,
+      const QString &to );
+    /**
+      Change title of document, if it is the old name of a topic.
+      
+      \return \c true, if the title was changed, \c false otherwise
+    */
+    static bool renameTitle( QTextDocument *document, const QString &from,
+      const QString &to );
+    /**
+      Change links to a renamed topic in the given topic files. The files are
+      processed in parallel by a pool of threads. Pending changes recorded in
+      the journals are included in the changed files and the journals of
+      changed files are removed. The title of the renamed topic is changed,
+      if its file is included.
+      
+      \param files map of names of topic files to names of their journals
+      \param from old name of topic
+      \param to new name of topic
+      \return number of changed files or -1, if a file couldn't be processed
+    */
+    static int renameInFiles( const QMap<QString, QString> &files,
+      const QString &from, const QString &to );
+
+  protected slots:
+    void slotInvalidate();
+
+  protected:
+    const TopicAutomaton *automaton();
+
+  private:
+    TopicIndex *mIndex;
+    TopicAutomaton *mAutomaton;
+};
+
+#endif
@@ -23,187 +23,518 @@
 #include "topicmanager.h"
 #include "todoodle.h"
 #include "dbg.h"
-#include "topicinfo.h"
 
-#include "qlayout.h"
-#include "QListWidget"
-#include "QPushButton"
-#include <QTreeView>
-#include <QTreeWidget>
+#include <QBoxLayout>
+#include <QLineEdit>
+#include <QPushButton>
 #include <QTableView>
 #include <QHeaderView>
+#include <QDateTime>
+#include <QMetaType>
+#include <QtAlgorithms>
+
+/**
+  This class compares rows of a topic catalog for sorting them.
+*/
+class RowLessThan
+{
+  public:
+    RowLessThan( const TopicCatalog::Columns &columns,
+      TopicCatalog::Column column, Qt::SortOrder order )
+      : mColumns( columns ), mColumn( column ), mOrder( order )
+    {
+    }
+
+    bool operator()( int row1, int row2 ) const
+    {
+      if ( mOrder == Qt::AscendingOrder ) {
+        return TopicCatalog::lessThan( mColumns, mColumn, row1, row2 );
+      } else {
+        return TopicCatalog::lessThan( mColumns, mColumn, row2, row1 );
+      }
+    }
+
+  private:
+    const TopicCatalog::Columns &mColumns;
+    TopicCatalog::Column mColumn;
+    Qt::SortOrder mOrder;
+};
+
+
+/**
+  Row of a topic catalog ranked by relevance.
+*/
+struct RankedRow
+{
+  int row;
+  int score;
+  uint modified;
+
+  bool operator<( const RankedRow &other ) const
+  {
+    if ( score != other.score ) return score > other.score;
+    if ( modified != other.modified ) return modified > other.modified;
+    return row < other.row;
+  }
+};
+
+// Scores of the different kinds of matches, fuzzy matches score up to
+// fuzzyScore depending on the fraction of shared trigrams
+static const int prefixScore = 3000;
+static const int substringScore = 2000;
+static const int fuzzyScore = 1000;
+
+
+TopicSorter::TopicSorter( QObject *parent )
+  : QThread( parent ), mPending( false ), mStop( false ),
+    mLastRevision( -1 ), mLastTrigramCount( 0 )
+{
+  qRegisterMetaType<QVector<int> >( "QVector<int>" );
+
+  start();
+}
+
+TopicSorter::~TopicSorter()
+{
+  mMutex.lock();
+  mStop = true;
+  mRequestAvailable.wakeAll();
+  mMutex.unlock();
+
+  wait();
+}
+
+void TopicSorter::sort( const TopicCatalog::Columns &columns,
+  TopicCatalog::Column column, Qt::SortOrder order, const QString &filter,
+  int generation )
+{
+  QMutexLocker locker( &mMutex );
+
+  mRequest.columns = columns;
+  mRequest.column = column;
+  mRequest.order = order;
+  mRequest.filter = filter;
+  mRequest.generation = generation;
+  mPending = true;
+
+  mRequestAvailable.wakeOne();
+}
+
+void TopicSorter::run()
+{
+  mMutex.lock();
+
+  forever {
+    while( !mPending && !mStop ) {
+      mRequestAvailable.wait( &mMutex );
+    }
+    if ( mStop ) break;
+
+    Request request = mRequest;
+    mPending = false;
+    // Don't keep the snapshot shared, the catalog would have to copy its
+    // columns on the next change
+    mRequest.columns = TopicCatalog::Columns();
+
+    mMutex.unlock();
+
+    QVector<int> rows;
+    QVector<int> scores;
+    filter( request, rows, scores );
+
+    if ( request.column == TopicCatalog::Relevance &&
+         !request.filter.isEmpty() ) {
+      QVector<RankedRow> ranked;
+      ranked.reserve( rows.count() );
+      for( int i = 0; i < rows.count(); ++i ) {
+        RankedRow r;
+        r.row = rows.at( i );
+        r.score = scores.at( i );
+        r.modified = request.columns.modified.at( r.row );
+        ranked.append( r );
+      }
+      qSort( ranked );
+      for( int i = 0; i < ranked.count(); ++i ) rows[ i ] = ranked.at( i ).row;
+    } else {
+      qSort( rows.begin(), rows.end(),
+        RowLessThan( request.columns, request.column, request.order ) );
+    }
+
+    emit sorted( rows, request.generation );
+
+    mMutex.lock();
+  }
+
+  mMutex.unlock();
+}
+
+void TopicSorter::filter( const Request &request, QVector<int> &rows,
+  QVector<int> &scores )
+{
+  const TopicCatalog::Columns &columns = request.columns;
+  const QStringList &names = columns.names;
+
+  if ( request.filter.isEmpty() ) {
+    rows.resize( names.count() );
+    for( int row = 0; row < names.count(); ++row ) rows[ row ] = row;
+    scores.fill( 0, names.count() );
+    return;
+  }
+
+  QString filter = request.filter.toLower();
+
+  bool extended = columns.revision == mLastRevision &&
+    !mLastFilter.isEmpty() && filter.startsWith( mLastFilter );
+
+  // Count for each row how many trigrams of the filter its name contains.
+  // When the filter was extended, the trigrams of the previous filter come
+  // first, so only the counts of the added trigrams have to be added.
+  QList<quint64> trigrams = TopicCatalog::trigrams( filter );
+  QHash<int, int> hits;
+  int first = 0;
+  if ( extended ) {
+    hits = mLastHits;
+    first = mLastTrigramCount;
+  }
+  for( int i = first; i < trigrams.count(); ++i ) {
+    foreach( int row, columns.trigramRows.value( trigrams.at( i ) ) ) {
+      ++hits[ row ];
+    }
+  }
+  mLastHits = hits;
+  mLastTrigramCount = trigrams.count();
+
+  // Names containing the filter are found among the names matching the
+  // previous filter, if the filter was only extended, or among the names
+  // containing all trigrams of the filter
+  QVector<int> candidates;
+  if ( extended ) {
+    candidates = mLastSubstringRows;
+  } else if ( !trigrams.isEmpty() ) {
+    QHash<int, int>::const_iterator it;
+    for( it = hits.constBegin(); it != hits.constEnd(); ++it ) {
+      if ( it.value() == trigrams.count() ) candidates.append( it.key() );
+    }
+    qSort( candidates );
+  } else {
+    candidates.resize( names.count() );
+    for( int row = 0; row < names.count(); ++row ) candidates[ row ] = row;
+  }
+
+  QVector<int> substringRows;
+  foreach( int row, candidates ) {
+    const QString &name = names.at( row );
+    if ( !name.contains( filter, Qt::CaseInsensitive ) ) continue;
+
+    substringRows.append( row );
+    rows.append( row );
+    if ( name.startsWith( filter, Qt::CaseInsensitive ) ) {
+      scores.append( prefixScore );
+    } else {
+      scores.append( substringScore );
+    }
+    hits.remove( row );
+  }
+
+  mLastRevision = columns.revision;
+  mLastFilter = filter;
+  mLastSubstringRows = substringRows;
+
+  // A single trigram doesn't say anything about similarity
+  if ( trigrams.count() < 2 ) return;
+
+  int threshold = ( trigrams.count() + 1 ) / 2;
+  QHash<int, int>::const_iterator it;
+  for( it = hits.constBegin(); it != hits.constEnd(); ++it ) {
+    if ( it.value() < threshold ) continue;
+    rows.append( it.key() );
+    scores.append( fuzzyScore * it.value() / trigrams.count() );
+  }
+}
+
 
 TopicModel::TopicModel( TopicManager *topicManager, QObject *parent )
-  : QAbstractItemModel( parent ), mTopicManager( topicManager )
+  : QAbstractTableModel( parent ), mSortColumn( TopicCatalog::Name ),
+    mSortOrder( Qt::AscendingOrder ), mGeneration( 0 ),
+    mSortPending( false ), mAppliedColumn( TopicCatalog::Name ),
+    mAppliedOrder( Qt::AscendingOrder )
+{
+  mCatalog = topicManager->topicCatalog();
+  connect( mCatalog, SIGNAL( topicAdded( int ) ),
+    SLOT( slotTopicAdded( int ) ) );
+  connect( mCatalog, SIGNAL( topicRemoved( int ) ),
+    SLOT( slotTopicRemoved( int ) ) );
+  connect( mCatalog, SIGNAL( topicChanged( int ) ),
+    SLOT( slotTopicChanged( int ) ) );
+  connect( mCatalog, SIGNAL( topicsReset() ), SLOT( slotTopicsReset() ) );
+
+  mSorter = new TopicSorter( this );
+  connect( mSorter, SIGNAL( sorted( const QVector<int> &, int ) ),
+    SLOT( slotSorted( const QVector<int> &, int ) ) );
+
+  slotTopicsReset();
+}
+
+int TopicModel::columnCount( const QModelIndex &parent ) const
 {
+  if ( parent.isValid() ) return 0;
+  return TopicCatalog::ColumnCount;
 }
 
-int TopicModel::columnCount( const QModelIndex & ) const
+int TopicModel::rowCount( const QModelIndex &parent ) const
 {
-  return 2;
+  if ( parent.isValid() ) return 0;
+  return mRows.count();
 }
 
-QVariant TopicModel::data( const QModelIndex & index, int role ) const
+QVariant TopicModel::data( const QModelIndex &index, int role ) const
 {
   if ( !index.isValid() ) return QVariant();
 
+  int row = mRows.at( index.row() );
+
   if ( role == Qt::DisplayRole ) {
-    QStringList topics = mTopicManager->topics();
-    QString topic = topics.at( index.row() );
-    if ( index.column() == 0 ) {
-      return topic;
-    } else if ( index.column() == 1 ) {
-      TopicInfo *info = mTopicManager->info( topic );
-      if ( info ) {
-        return info->lastModified().toString();
-      } else {
-        return "Unknown";
-      }
-    } else {
-      dbg() << "TopicModel::data(): Index out of range: " << index.column()
-        << endl;
+    switch ( index.column() ) {
+      case TopicCatalog::Name:
+        return mCatalog->name( row );
+      case TopicCatalog::Modified:
+        return QDateTime::fromTime_t( mCatalog->modified( row ) ).toString();
+      case TopicCatalog::Size:
+        return mCatalog->size( row );
+      case TopicCatalog::Links:
+        return mCatalog->linkCount( row );
+      case TopicCatalog::Todos:
+        return mCatalog->todoCount( row );
+      default:
+        dbg() << "TopicModel::data(): Index out of range: " << index.column()
+          << endl;
+    }
+  } else if ( role == Qt::TextAlignmentRole ) {
+    if ( index.column() >= TopicCatalog::Size ) {
+      return int( Qt::AlignRight | Qt::AlignVCenter );
     }
-#if 0
-  } else if ( role == QAbstractItemModel::DecorationRole ) {
-    return QPixmap( ":/images/filenew.png" );
-#endif
   }
   
   return QVariant();
 }
 
-QModelIndex TopicModel::index( int row, int column,
-  const QModelIndex & ) const
+QVariant TopicModel::headerData( int section, Qt::Orientation orientation,
+  int role ) const
 {
-  return createIndex( row, column, 0 );
+  if ( orientation != Qt::Horizontal || role != Qt::DisplayRole ) {
+    return QAbstractTableModel::headerData( section, orientation, role );
+  }
+
+  switch ( section ) {
+    case TopicCatalog::Name: return "Topic";
+    case TopicCatalog::Modified: return "Last Modified";
+    case TopicCatalog::Size: return "Size";
+    case TopicCatalog::Links: return "Links";
+    case TopicCatalog::Todos: return "Todos";
+    default: return QVariant();
+  }
+}
+
+void TopicModel::sort( int column, Qt::SortOrder order )
+{
+  dbg() << "TopicModel::sort() column: " << column << endl;
+
+  mSortColumn = TopicCatalog::Column( column );
+  mSortOrder = order;
+
+  startSort();
 }
 
-QModelIndex TopicModel::parent( const QModelIndex & ) const
+void TopicModel::setFilter( const QString &filter )
 {
-  return QModelIndex();
+  mFilter = filter;
+
+  startSort();
 }
 
-int TopicModel::rowCount( const QModelIndex & ) const
+QString TopicModel::topic( const QModelIndex &index ) const
 {
-  return mTopicManager->topics().count();
+  if ( !index.isValid() ) return QString();
+
+  return mCatalog->name( mRows.at( index.row() ) );
 }
 
-bool TopicModel::hasChildren( const QModelIndex & ) const
+void TopicModel::startSort()
 {
-  return false;
+  mSorter->sort( mCatalog->columns(), mSortColumn, mSortOrder, mFilter,
+    ++mGeneration );
+  mSortPending = true;
 }
 
-void TopicModel::slotClicked( const QModelIndex & index, Qt::MouseButton /*button*/, Qt::KeyboardModifiers /*modifiers*/ )
+void TopicModel::slotSorted( const QVector<int> &rows, int generation )
 {
-  dbg() << "Clicked: " << index.row() << endl;
+  // Results of requests which were superseded refer to outdated rows
+  if ( generation != mGeneration ) return;
+
+  mSortPending = false;
+
+  if ( mFilter != mAppliedFilter ) {
+    mRows = rows;
+    mAppliedColumn = mSortColumn;
+    mAppliedOrder = mSortOrder;
+    mAppliedFilter = mFilter;
+    reset();
+    return;
+  }
+
+  emit layoutAboutToBeChanged();
+
+  // Keep selection and current item on the same topics
+  QVector<int> positions( mCatalog->count(), -1 );
+  for( int i = 0; i < rows.count(); ++i ) positions[ rows.at( i ) ] = i;
+
+  foreach( QModelIndex i, persistentIndexList() ) {
+    int position = positions.at( mRows.at( i.row() ) );
+    if ( position < 0 ) changePersistentIndex( i, QModelIndex() );
+    else changePersistentIndex( i, index( position, i.column() ) );
+  }
 
-  QModelIndex i = createIndex( index.row(), 0 );
+  mRows = rows;
+  mAppliedColumn = mSortColumn;
+  mAppliedOrder = mSortOrder;
 
-  emit topicSelected( data( i, Qt::DisplayRole ).toString() );
+  emit layoutChanged();
 }
- 
-void TopicModel::slotReturnPressed( const QModelIndex & index )
+
+void TopicModel::slotTopicAdded( int row )
 {
-  dbg() << "Return pressed: " << index.row() << endl;
+  for( int i = 0; i < mRows.count(); ++i ) {
+    if ( mRows.at( i ) >= row ) ++mRows[ i ];
+  }
 
-  emit topicSelected( data( index, Qt::DisplayRole ).toString() );
-}
+  // Whether and where a new topic matches a filter is determined by sorting
+  // again
+  if ( !mAppliedFilter.isEmpty() ) {
+    startSort();
+    return;
+  }
 
+  TopicCatalog::Columns columns = mCatalog->columns();
+  QVector<int>::iterator it = qLowerBound( mRows.begin(), mRows.end(), row,
+    RowLessThan( columns, mAppliedColumn, mAppliedOrder ) );
+  int position = it - mRows.begin();
 
-TopicProxyModel::TopicProxyModel( QObject *parent )
-  : QProxyModel( parent )
-{
+  beginInsertRows( QModelIndex(), position, position );
+  mRows.insert( position, row );
+  endInsertRows();
+
+  if ( mSortPending ) startSort();
 }
 
-bool TopicProxyModel::isSortable() const
+void TopicModel::slotTopicRemoved( int row )
 {
-  return true;
+  int position = mRows.indexOf( row );
+  if ( position >= 0 ) {
+    beginRemoveRows( QModelIndex(), position, position );
+    mRows.remove( position );
+  }
+
+  for( int i = 0; i < mRows.count(); ++i ) {
+    if ( mRows.at( i ) > row ) --mRows[ i ];
+  }
+
+  if ( position >= 0 ) endRemoveRows();
+
+  if ( mSortPending ) startSort();
 }
 
-void TopicProxyModel::sort( int column, const QModelIndex &parent,
-  Qt::SortOrder order )
+void TopicModel::slotTopicChanged( int row )
 {
-  Q_UNUSED( parent );
-  Q_UNUSED( order );
+  int position = mRows.indexOf( row );
+  if ( position < 0 ) return;
+
+  emit dataChanged( index( position, 0 ),
+    index( position, TopicCatalog::ColumnCount - 1 ) );
+}
 
-  dbg() << "TopicProxyModel::sort() column: " << column << endl;
+void TopicModel::slotTopicsReset()
+{
+  // Show the topics in the order of the catalog until the sorted rows are
+  // available
+  mRows.resize( mCatalog->count() );
+  for( int i = 0; i < mRows.count(); ++i ) mRows[ i ] = i;
+  mAppliedColumn = TopicCatalog::Name;
+  mAppliedOrder = Qt::AscendingOrder;
+  mAppliedFilter.clear();
+  reset();
+
+  if ( mSortColumn != TopicCatalog::Name ||
+       mSortOrder != Qt::AscendingOrder || !mFilter.isEmpty() ) {
+    startSort();
+  }
 }
 
 
 TopicList::TopicList( TopicManager *topicManager, QWidget *parent )
   : QWidget( parent ), mTopicManager( topicManager )
 {
-  qDebug( "TopicList()" );
+  setWindowTitle( "Topics - Todoodle" );
+  setAttribute( Qt::WA_DeleteOnClose );
 
   QBoxLayout *topLayout = new QVBoxLayout( this );
-  
-#if 0
-  QListWidget *list = new QListWidget( this );
-  connect( list, SIGNAL( clicked( QListWidgetItem *,
-    ButtonState ) ), SLOT( slotItemClicked( QListWidgetItem * ) ) );
-  connect( list, SIGNAL( returnPressed( QListWidgetItem * ) ),
-    SLOT( slotItemClicked( QListWidgetItem * ) ) );
-  topLayout->addWidget( list );
-
-  QStringList topics = mTopicManager->topics();
-  
-  foreach( QString topic, topics ) {
-    new QListWidgetItem( topic, list );
-  }
-#endif
 
-  TopicModel *model = new TopicModel( mTopicManager, this );
-  
-  TopicProxyModel *proxyModel = new TopicProxyModel( this );
-  proxyModel->setModel( model );
-  
-#if 0
-  QListView *view = new QListView( this );
-  view->setViewMode( QListView::IconMode );
-#endif
-#if 1
-  QTableView *view = new QTableView( this );
-  view->verticalHeader()->hide();
-//  view->horizontalHeader()->hide();
-  view->setAlternatingRowColors( true );
-  view->setShowGrid( false );
-#else
-#if 0
-  QTreeWidget *treeWidget = new QTreeWidget( this );
-  treeWidget->setSortingEnabled( true );
-  QTreeView *view = treeWidget;
-#else
-  QTreeView = new QTreeView( this );
-#endif
-  view->setAlternatingRowColors( true );
-  view->header()->setMovable( true );
-#endif
-  topLayout->addWidget( view );
-  view->setModel( proxyModel );
-
-  connect( view, SIGNAL( clicked( const QModelIndex &, Qt::MouseButton, Qt::KeyboardModifier ) ),
-    model, SLOT( slotClicked( const QModelIndex &, Qt::ButtonState, Qt::KeyboardModifier ) ) );
-  connect( view, SIGNAL( returnPressed( const QModelIndex & ) ),
-    model, SLOT( slotReturnPressed( const QModelIndex & ) ) );
-
-  connect( model, SIGNAL( topicSelected( const QString & ) ),
-    SLOT( slotTopicSelected( const QString & ) ) );
+  // Typing narrows down the list, return opens the best match
+  mFilterEdit = new QLineEdit( this );
+  topLayout->addWidget( mFilterEdit );
+  connect( mFilterEdit, SIGNAL( textChanged( const QString & ) ),
+    SLOT( slotFilterChanged( const QString & ) ) );
+  connect( mFilterEdit, SIGNAL( returnPressed() ), SLOT( openFirst() ) );
+
+  mModel = new TopicModel( mTopicManager, this );
+
+  mView = new QTableView( this );
+  mView->verticalHeader()->hide();
+  // Rows of fixed height don't have to be measured, which keeps scrolling
+  // through large numbers of topics fast
+  mView->verticalHeader()->setResizeMode( QHeaderView::Fixed );
+  mView->setAlternatingRowColors( true );
+  mView->setShowGrid( false );
+  mView->setSelectionBehavior( QAbstractItemView::SelectRows );
+  mView->setModel( mModel );
+  mView->setSortingEnabled( true );
+  mView->sortByColumn( TopicCatalog::Name, Qt::AscendingOrder );
+  topLayout->addWidget( mView );
+
+  connect( mView, SIGNAL( activated( const QModelIndex & ) ),
+    SLOT( slotActivated( const QModelIndex & ) ) );
 
   QPushButton *button = new QPushButton( "C&lose", this );
   connect( button, SIGNAL( clicked() ), SLOT( close() ) );
   topLayout->addWidget( button );
+
+  resize( 600, 500 );
 }
 
-void TopicList::slotItemClicked( QListWidgetItem *item )
+void TopicList::slotFilterChanged( const QString &filter )
 {
-  dbg() << "TopicList::slotItemClicked()" << endl;
+  // Matches of a new filter are ranked by relevance, which isn't a column,
+  // until the user chooses a column
+  if ( mModel->filter().isEmpty() && !filter.isEmpty() ) {
+    mView->horizontalHeader()->setSortIndicator( TopicCatalog::Relevance,
+      Qt::AscendingOrder );
+    mModel->sort( TopicCatalog::Relevance, Qt::AscendingOrder );
+  }
 
-  slotTopicSelected( item->text() );
+  mModel->setFilter( filter );
 }
 
-void TopicList::slotTopicSelected( const QString &topic )
+void TopicList::openFirst()
 {
-  dbg() << "TopicList::slotTopicSelected() " << topic << endl;
+  if ( mModel->rowCount( QModelIndex() ) == 0 ) return;
+
+  slotActivated( mModel->index( 0, 0 ) );
+}
+
+void TopicList::slotActivated( const QModelIndex &index )
+{
+  QString topic = mModel->topic( index );
+  
+  dbg() << "TopicList::slotActivated() " << topic << endl;
 
   Todoodle *t = mTopicManager->editor( topic );
   t->show();
@@ -20,18 +20,111 @@
 #ifndef TOPICLIST_H
 #define TOPICLIST_H
 
+#include "topiccatalog.h"
+
 #include <qwidget.h>
-#include <QAbstractItemModel>
-#include <QProxyModel>
+#include <QAbstractTableModel>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QHash>
 
 class TopicManager;
 
-class QListWidgetItem;
+class QModelIndex;
+class QLineEdit;
+class QTableView;
+
+/**
+  This class sorts and filters the rows of a topic catalog in a background
+  thread. Only the latest request is processed, requests which are
+  superseded before the thread got to them are dropped.
+
+  Topics match a filter, if their name contains it, or fuzzily, if their
+  name shares at least half of the trigrams of the filter. Candidates are
+  taken from the trigram index of the catalog. When the filter was extended
+  since the last request, the matches of the last request are narrowed
+  down instead. Sorted by relevance, prefix matches come first, then other
+  substring matches and then fuzzy matches, each ordered by recency.
+*/
+class TopicSorter : public QThread
+{
+    Q_OBJECT
+  public:
+    /**
+      Create sorter. The worker thread is started immediately.
+    */
+    TopicSorter( QObject *parent = 0 );
+    /**
+      Stop the worker thread.
+    */
+    ~TopicSorter();
+
+    /**
+      Request sorting of the rows of the given columns.
+      
+      \param columns snapshot of the catalog
+      \param column column to sort by
+      \param order sort order
+      \param filter only rows whose name contains this text are kept
+      \param generation number reported back by sorted()
+    */
+    void sort( const TopicCatalog::Columns &columns,
+      TopicCatalog::Column column, Qt::SortOrder order,
+      const QString &filter, int generation );
+
+  signals:
+    /**
+      Emitted from the worker thread when a request was processed.
+      
+      \param rows sorted rows of the catalog matching the filter
+      \param generation number given to sort()
+    */
+    void sorted( const QVector<int> &rows, int generation );
+
+  protected:
+    void run();
+
+  private:
+    struct Request
+    {
+      TopicCatalog::Columns columns;
+      TopicCatalog::Column column;
+      Qt::SortOrder order;
+      QString filter;
+      int generation;
+    };
+
+    QMutex mMutex;
+    QWaitCondition mRequestAvailable;
+    Request mRequest;
+    bool mPending;
+    bool mStop;
+
+    /**
+      Put rows matching the filter of the request into the given list. For
+      each row a score is appended to the list of scores.
+    */
+    void filter( const Request &request, QVector<int> &rows,
+      QVector<int> &scores );
+
+    // Only accessed by the worker thread
+    int mLastRevision;
+    QString mLastFilter;
+    QVector<int> mLastSubstringRows;
+    QHash<int, int> mLastHits;
+    int mLastTrigramCount;
+};
 
 /**
-  This class represents a model of Todoodle topics.
+  This class represents a model of Todoodle topics. The data is taken from
+  the topic catalog, so no files are accessed for showing the model. The
+  rows can be sorted by any column and filtered by name. Sorting and
+  filtering is done in a background thread, the model shows the previous
+  order until the result is available.
 */
-class TopicModel : public QAbstractItemModel
+class TopicModel : public QAbstractTableModel
 {
     Q_OBJECT
   public:
@@ -43,35 +136,63 @@ class TopicModel : public QAbstractItemModel
     */
     TopicModel( TopicManager *tm, QObject *parent );
 
-    int columnCount ( const QModelIndex & parent ) const;
-    QVariant data ( const QModelIndex & index, int role ) const;
-    QModelIndex index ( int row, int column, const QModelIndex & parent ) const;
-    QModelIndex parent ( const QModelIndex & index ) const;
-    int rowCount ( const QModelIndex & parent ) const;
-    bool hasChildren( const QModelIndex & parent ) const;
+    int columnCount( const QModelIndex &parent ) const;
+    int rowCount( const QModelIndex &parent ) const;
+    QVariant data( const QModelIndex &index, int role ) const;
+    QVariant headerData( int section, Qt::Orientation orientation,
+      int role ) const;
+    void sort( int column, Qt::SortOrder order );
+
+    /**
+      Return name of topic shown at the given index.
+    */
+    QString topic( const QModelIndex &index ) const;
+
+    /**
+      Return current filter.
+    */
+    QString filter() const { return mFilter; }
 
   public slots:
-    void slotClicked( const QModelIndex & index, Qt::MouseButton button, Qt::KeyboardModifiers modifiers );
-    void slotReturnPressed ( const QModelIndex & index );
+    /**
+      Show only topics whose name matches the given text. Matches are
+      sorted by relevance, when sort() is called with
+      TopicCatalog::Relevance.
+    */
+    void setFilter( const QString &filter );
 
-  signals:
-    void topicSelected( const QString & );
+  protected:
+    /**
+      Request sorting and filtering of the rows from the sorter.
+    */
+    void startSort();
+
+  protected slots:
+    void slotTopicAdded( int row );
+    void slotTopicRemoved( int row );
+    void slotTopicChanged( int row );
+    void slotTopicsReset();
+    void slotSorted( const QVector<int> &rows, int generation );
 
   private:
-    TopicManager *mTopicManager;
-};
+    TopicCatalog *mCatalog;
+    TopicSorter *mSorter;
 
-/**
-  This class implements a sorting proxy model for topics.
-*/
-class TopicProxyModel : public QProxyModel
-{
-  public:
-    TopicProxyModel( QObject *parent );
-  
-    bool isSortable() const;
-    
-    void sort( int column, const QModelIndex &parent, Qt::SortOrder order );
+    /** Rows of the catalog in the order they are shown */
+    QVector<int> mRows;
+
+    TopicCatalog::Column mSortColumn;
+    Qt::SortOrder mSortOrder;
+    QString mFilter;
+    /** Number of the latest sort request, older results are dropped */
+    int mGeneration;
+    /** Is a sort request waiting for its result */
+    bool mSortPending;
+
+    /** Sort order and filter the shown rows were computed with */
+    TopicCatalog::Column mAppliedColumn;
+    Qt::SortOrder mAppliedOrder;
+    QString mAppliedFilter;
 };
 
 /**
@@ -84,11 +205,19 @@ class TopicList : public QWidget
     TopicList( TopicManager *, QWidget *parent );
   
   protected slots:
-    void slotItemClicked( QListWidgetItem * );
-    void slotTopicSelected( const QString &topic );
+    void slotActivated( const QModelIndex &index );
+    void slotFilterChanged( const QString &filter );
+    /**
+      Open the topic ranked highest for the current filter.
+    */
+    void openFirst();
 
   private:
     TopicManager *mTopicManager;
+    TopicModel *mModel;
+
+    QLineEdit *mFilterEdit;
+    QTableView *mView;
 };
 
 #endif
@@ -0,0 +1,129 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topicloader.h"
+
+#include "format.h"
+#include "hypertextedit.h"
+#include "dbg.h"
+
+#include <QTimer>
+#include <QTime>
+#include <QTextDocument>
+
+// Maximum time in milliseconds spent loading before returning to the event
+// loop
+static const int chunkDuration = 20;
+
+TopicLoader::TopicLoader( const QString &topic, Format *format,
+  HyperTextEdit *editor, QObject *parent )
+  : QObject( parent ), mTopic( topic ), mFormat( format ), mEditor( editor ),
+    mFinished( false ), mInserting( false ), mUserEdited( false )
+{
+  mTimer = new QTimer( this );
+  connect( mTimer, SIGNAL( timeout() ), SLOT( loadChunk() ) );
+
+  connect( editor->document(), SIGNAL( contentsChange( int, int, int ) ),
+    SLOT( slotContentsChange( int, int, int ) ) );
+}
+
+TopicLoader::~TopicLoader()
+{
+  delete mFormat;
+}
+
+void TopicLoader::start()
+{
+  dbg() << "TopicLoader::start(): " << mTopic << endl;
+
+  mEditor->document()->setUndoRedoEnabled( false );
+
+  int lines = mEditor->viewport()->height() /
+    mEditor->fontMetrics().lineSpacing() + 1;
+
+  if ( loadNext( lines ) ) {
+    emit progress( mFormat->loadProgress() );
+    mTimer->start( 0 );
+  } else {
+    complete();
+  }
+}
+
+void TopicLoader::finish()
+{
+  if ( mFinished ) return;
+
+  while( loadNext( 256 ) ) ;
+
+  complete();
+}
+
+bool TopicLoader::hasFailed() const
+{
+  return mFormat->loadFailed();
+}
+
+void TopicLoader::loadChunk()
+{
+  QTime time;
+  time.start();
+
+  bool more;
+  do {
+    more = loadNext( 16 );
+  } while( more && time.elapsed() < chunkDuration );
+
+  if ( more ) emit progress( mFormat->loadProgress() );
+  else complete();
+}
+
+bool TopicLoader::loadNext( int count )
+{
+  if ( !mEditor ) return false;
+
+  mInserting = true;
+  bool more = mFormat->loadNext( count );
+  mInserting = false;
+
+  return more;
+}
+
+void TopicLoader::complete()
+{
+  if ( mFinished ) return;
+  mFinished = true;
+
+  mTimer->stop();
+
+  dbg() << "TopicLoader::complete(): " << mTopic << endl;
+
+  if ( mEditor ) {
+    disconnect( mEditor->document(), 0, this, 0 );
+    mEditor->document()->setUndoRedoEnabled( true );
+  }
+
+  emit progress( 100 );
+  emit finished( this );
+}
+
+void TopicLoader::slotContentsChange( int, int, int )
+{
+  if ( !mInserting ) mUserEdited = true;
+}
@@ -0,0 +1,120 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICLOADER_H
+#define TOPICLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QPointer>
+
+class Format;
+class HyperTextEdit;
+class QTimer;
+
+/**
+  This class loads the data of a topic into an editor incrementally. The first
+  screenful of data is loaded immediately, the rest is loaded in time-sliced
+  chunks from the event loop, so the window can be shown and used without
+  waiting for the complete topic to be loaded.
+
+  The editor can be edited while loading. Undo is disabled until loading is
+  finished.
+*/
+class TopicLoader : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      Create loader.
+      
+      \param topic name of topic
+      \param format format object loading the data, loading has to be started
+        by Format::beginLoad(). The loader takes ownership of the object.
+      \param editor editor the data is loaded into
+      \param parent parent object
+    */
+    TopicLoader( const QString &topic, Format *format, HyperTextEdit *editor,
+      QObject *parent = 0 );
+    ~TopicLoader();
+
+    /**
+      Return name of topic which is loaded.
+    */
+    QString topic() const { return mTopic; }
+    /**
+      Return editor the data is loaded into.
+    */
+    HyperTextEdit *editor() const { return mEditor; }
+
+    /**
+      Load first screenful of data and schedule loading the rest.
+    */
+    void start();
+    /**
+      Load all remaining data immediately.
+    */
+    void finish();
+
+    /**
+      Return, if all data was loaded.
+    */
+    bool isFinished() const { return mFinished; }
+    /**
+      Return, if loading stopped because of an error.
+    */
+    bool hasFailed() const;
+    /**
+      Return, if the user edited the document while it was loaded.
+    */
+    bool userEdited() const { return mUserEdited; }
+
+  signals:
+    /**
+      Emitted when a chunk of data was loaded.
+      
+      \param percent progress of loading in percent
+    */
+    void progress( int percent );
+    /**
+      Emitted when all data was loaded.
+    */
+    void finished( TopicLoader * );
+
+  protected slots:
+    void loadChunk();
+    void slotContentsChange( int position, int charsRemoved, int charsAdded );
+
+  protected:
+    bool loadNext( int count );
+    void complete();
+
+  private:
+    QString mTopic;
+    Format *mFormat;
+    QPointer<HyperTextEdit> mEditor;
+
+    QTimer *mTimer;
+
+    bool mFinished;
+    bool mInserting;
+    bool mUserEdited;
+};
+
+#endif
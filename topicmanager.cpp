@@ -22,6 +22,7 @@
 
 #include "todoodle.h"
 #include "format.h"
+#include "formatbinary.h"
 #include "dbg.h"
 #include "versioncontrol.h"
 #include "textformats.h"
@@ -30,6 +31,19 @@
 #include "hypertextedit.h"
 #include "prefs.h"
 #include "nextactionslist.h"
+#include "segmentindex.h"
+#include "savequeue.h"
+#include "journal.h"
+#include "topicloader.h"
+#include "topicindex.h"
+#include "topicwatcher.h"
+#include "topiclinker.h"
+#include "searchindex.h"
+#include "linkindex.h"
+#include "todoindex.h"
+#include "topiccatalog.h"
+#include "topicinfocache.h"
+#include "searchwindow.h"
 
 #include <QTextCursor>
 #include <QFile>
@@ -40,15 +54,31 @@
 #include <QFileInfo>
 #include <QResource>
 #include <QTextStream>
+#include <QTextDocument>
+#include <QMessageBox>
+
+// Topics larger than this number of bytes are loaded incrementally
+static const qint64 lazyLoadThreshold = 256 * 1024;
+// Number of topics added to the full text index between progress reports
+static const int indexChunkSize = 100;
 
 TopicManager::TopicManager( const QString &dirName, Mode mode,
   WindowMode windowMode )
   : mSingleEditor( 0 ), mTopicDir( dirName ), mTopicMap( 0 ),
-    mNextActionsList( 0 ),
+    mNextActionsList( 0 ), mTopicIndex( 0 ), mTopicWatcher( 0 ),
+    mTopicLinker( 0 ), mSearchIndex( 0 ), mLinkIndex( 0 ),
+    mTodoIndex( 0 ), mTopicCatalog( 0 ), mSearchWindow( 0 ),
+    mInfoCache( 0 ),
+    mLazyLoading( true ),
     mWindowMode( windowMode )
 {
   mPrefs = new Prefs( topicDir() );
 
+  mSaveQueue = new SaveQueue( this );
+  connect( mSaveQueue,
+    SIGNAL( saved( const QString &, bool, int, const QByteArray & ) ),
+    SLOT( slotSaved( const QString &, bool, int, const QByteArray & ) ) );
+
   if ( mode == Online && QFile::exists( topicDir() + "/.svn" ) ) {
     dbg() << "Activate Todoodle version control" << endl;
     
@@ -71,11 +101,29 @@ TopicManager::~TopicManager()
   }
 
   delete mTopicMap;
+  delete mNextActionsList;
+  delete mSearchWindow;
+
+  if ( mSearchIndex ) {
+    mSearchIndex->save();
+    delete mSearchIndex;
+  }
+  if ( mLinkIndex ) mLinkIndex->save();
+  if ( mTodoIndex ) mTodoIndex->save();
 
   foreach( Todoodle *t, mEditors ) delete t;
   foreach( TopicInfo *i, mInfos ) delete i;
 
+  delete mSaveQueue;
+
   delete mPrefs;
+
+  // The state of the topic directory is recorded after all other files in
+  // it are written
+  if ( mInfoCache ) {
+    saveInfoCache();
+    delete mInfoCache;
+  }
 }
 
 Todoodle *TopicManager::editor( const QString &topic )
@@ -98,8 +146,9 @@ Todoodle *TopicManager::editor( const QString &topic )
     editor = new Todoodle( this );
     editor->loadTopic( topic );
     mEditors.insert( topic, editor );
-    if ( mNextActionsList ) mNextActionsList->addEditor( editor->editor() );
   }
+
+  updateWatchedTopics();
   
   return editor;
 }
@@ -109,21 +158,88 @@ void TopicManager::removeEditor( const QString &topic )
   dbg() << "TopicManager::removeEditor(): " << topic << endl;
 
   mEditors.remove( topic );
+
+  updateWatchedTopics();
+}
+
+void TopicManager::updateWatchedTopics()
+{
+  if ( !mTopicWatcher ) return;
+
+  QStringList topics;
+  if ( mWindowMode == Single ) {
+    if ( !mCurrentTopic.isEmpty() ) topics.append( mCurrentTopic );
+  } else {
+    topics = mEditors.keys();
+  }
+  mTopicWatcher->watchTopics( topics );
 }
 
 bool TopicManager::load( const QString &topic, HyperTextEdit *editor )
 {
+  foreach( TopicLoader *l, mLoaders ) {
+    if ( l->editor() == editor ) l->finish();
+  }
+
+  // Stop recording changes for the topic previously shown in the editor
+  foreach( Journal *j, mJournals ) {
+    if ( j->document() == editor->document() ) j->detach();
+  }
+
   editor->setCurrentCharFormat( QTextCharFormat() );
   editor->clear();
   editor->init();
+  editor->segmentIndex()->clear();
+  editor->setReadOnly( false );
+  mFailedLoads.remove( topic );
+
+  // Make sure not to read data which is still about to be written
+  mSaveQueue->waitFor( topicFilename( topic ) );
 
   Format format( editor->document() );
   
   QFileInfo fi( topicFilename( topic ) );
+
+  bool binary = FormatBinary::isBinary( topicFilename( topic ) );
+
+  // Journals are replayed on the completely loaded data, so topics with
+  // pending changes are always loaded at once.
+  if ( mLazyLoading && fi.size() > lazyLoadThreshold &&
+       !QFile::exists( journalFilename( topic ) ) ) {
+    Format *f;
+    if ( binary ) f = new FormatBinary( editor->document() );
+    else f = new Format( editor->document() );
+    if ( f->beginLoad( topicFilename( topic ) ) ) {
+      if ( binary ) mBinaryTopics.insert( topic );
+      else mBinaryTopics.remove( topic );
+
+      TopicLoader *loader = new TopicLoader( topic, f, editor, this );
+      connect( loader, SIGNAL( finished( TopicLoader * ) ),
+        SLOT( slotLoadFinished( TopicLoader * ) ) );
+      mLoaders.insert( topic, loader );
+      loader->start();
+      return true;
+    }
+    delete f;
+    editor->clear();
+    editor->init();
+  }
+
+  bool loaded;
+  if ( binary ) {
+    mBinaryTopics.insert( topic );
+    FormatBinary binaryFormat( editor->document() );
+    loaded = binaryFormat.load( topicFilename( topic ) );
+  } else {
+    mBinaryTopics.remove( topic );
+    loaded = format.load( topicFilename( topic ) );
+  }
   
-  if ( !format.load( topicFilename( topic ) ) && !fi.exists() ) {
+  if ( !loaded && !fi.exists() ) {
     dbg() << "TopicManager::load() Creating new topic: " << topic << endl;
 
+    if ( mPrefs->binaryFormat() ) mBinaryTopics.insert( topic );
+
     if ( topic == "Start" || topic == "Manual" ) {    
       QString resourceName = QString(":/manual/%1.todoodle").arg( topic );
       dbg() << "RES: " << resourceName << endl;
@@ -149,18 +265,360 @@ bool TopicManager::load( const QString &topic, HyperTextEdit *editor )
 
     save( topic, editor );
     
-    if ( mVersionControl ) mVersionControl->addFile( topicFilename( topic ) );
+    mSaveQueue->waitFor( topicFilename( topic ) );
+    topicIndex()->add( topic );
+    mFileIdentities.insert( topic,
+      SaveQueue::fileIdentity( topicFilename( topic ) ) );
+    if ( mVersionControl ) {
+      mVersionControl->addFile( topicFilename( topic ) );
+    }
+
+    journal( topic )->attach( editor->document(),
+      SaveQueue::fileIdentity( topicFilename( topic ) ) );
     
     return false;
   }
 
+  // Recover changes which didn't make it into the topic file
+  QByteArray base = SaveQueue::fileIdentity( topicFilename( topic ) );
+  bool replayed = Journal::replay( journalFilename( topic ),
+    editor->document(), base );
+
+  // The data on disk is what was just loaded, so there is nothing to save
+  // until the user changes something.
+  editor->segmentIndex()->setDirty( replayed );
+
+  if ( mLinkIndex && !replayed && mLinkIndex->identity( topic ) != base ) {
+    mLinkIndex->update( topic, format.topicLinks(), base );
+  }
+  if ( mTodoIndex && !replayed && mTodoIndex->identity( topic ) != base ) {
+    mTodoIndex->update( topic, format.todos(), base );
+  }
+
+  journal( topic )->attach( editor->document(), base );
+  mFileIdentities.insert( topic, base );
+
+  // Link topics which were created after the topic was last saved
+  topicLinker()->linkDocument( editor->document(), topic );
+
   return true;
 }
 
+TopicLoader *TopicManager::loader( const QString &topic ) const
+{
+  return mLoaders.value( topic );
+}
+
+void TopicManager::slotLoadFinished( TopicLoader *loader )
+{
+  QString topic = loader->topic();
+  mLoaders.remove( topic );
+  loader->deleteLater();
+
+  HyperTextEdit *editor = loader->editor();
+
+  if ( loader->hasFailed() ) {
+    qWarning( "Error loading topic '%s'.", qPrintable( topic ) );
+
+    // Saving the partially loaded document would truncate the topic file,
+    // so changes made while loading are dropped and no journal is written
+    mFailedLoads.insert( topic );
+    if ( editor ) {
+      editor->segmentIndex()->setDirty( false );
+      editor->setReadOnly( true );
+      QMessageBox::warning( editor, "Error Loading Topic",
+        "Topic '" + topic + "' couldn't be loaded completely. It is shown "
+        "read-only, so the topic file isn't overwritten." );
+    }
+    return;
+  }
+
+  if ( !editor ) return;
+
+  // Changes made while loading aren't in the topic file yet
+  editor->segmentIndex()->setDirty( loader->userEdited() );
+
+  QByteArray base = SaveQueue::fileIdentity( topicFilename( topic ) );
+  if ( mLinkIndex && !loader->userEdited() &&
+       mLinkIndex->identity( topic ) != base ) {
+    mLinkIndex->update( topic,
+      Format( editor->document() ).topicLinks(), base );
+  }
+  if ( mTodoIndex && !loader->userEdited() &&
+       mTodoIndex->identity( topic ) != base ) {
+    mTodoIndex->update( topic, Format( editor->document() ).todos(), base );
+  }
+
+  Journal *j = journal( topic );
+  j->attach( editor->document(), base );
+  if ( loader->userEdited() ) j->recordCheckpoint();
+  mFileIdentities.insert( topic, base );
+
+  topicLinker()->linkDocument( editor->document(), topic );
+}
+
 bool TopicManager::save( const QString &topic, HyperTextEdit *editor )
 {
-  Format f( editor->document() );
-  return f.save( topicFilename( topic ) );
+  // Never save partially loaded data
+  TopicLoader *l = mLoaders.value( topic );
+  if ( l ) l->finish();
+
+  if ( mFailedLoads.contains( topic ) ) return false;
+
+  SegmentIndex *index = editor->segmentIndex();
+
+  QString filename = topicFilename( topic );
+
+  // Topics are only created with valid names
+  if ( !isValidTopicName( topic ) && !QFile::exists( filename ) ) {
+    dbg() << "TopicManager::save(): Invalid topic name " << topic << endl;
+    return false;
+  }
+
+  if ( !index->isDirty() && QFile::exists( filename ) ) return true;
+
+  QList<QByteArray> segments;
+  if ( mBinaryTopics.contains( topic ) ) {
+    FormatBinary f( editor->document() );
+    segments = f.toSegments();
+  } else {
+    Format f( editor->document() );
+    segments = f.toSegments();
+  }
+
+  if ( index->isUnchanged( segments ) && QFile::exists( filename ) ) {
+    index->setDirty( false );
+    return true;
+  }
+
+  if ( mTopicWatcher ) mTopicWatcher->beginWrite();
+  mSaveQueue->enqueue( filename, segments, journal( topic )->revision() );
+  index->setSegments( segments );
+
+  // The identity of the file is set, when it was written
+  if ( mSearchIndex ) {
+    mSearchIndex->update( topic, editor->document()->toPlainText() );
+  }
+  if ( mLinkIndex ) {
+    mLinkIndex->update( topic, Format( editor->document() ).topicLinks() );
+  }
+  if ( mTodoIndex ) {
+    mTodoIndex->update( topic, Format( editor->document() ).todos() );
+  }
+  if ( mInfoCache ) {
+    mPendingInfos.insert( topic,
+      TopicInfoCache::documentInfo( editor->document(), segments ) );
+  }
+
+  return true;
+}
+
+bool TopicManager::convertTopics( bool binary )
+{
+  bool success = true;
+
+  foreach( QString topic, topics() ) {
+    QString filename = topicFilename( topic );
+    if ( FormatBinary::isBinary( filename ) == binary ) continue;
+
+    dbg() << "Converting " << topic << endl;
+
+    QTextDocument document;
+    bool loaded;
+    if ( binary ) {
+      Format format( &document );
+      loaded = format.load( filename );
+    } else {
+      FormatBinary format( &document );
+      loaded = format.load( filename );
+    }
+    if ( !loaded ) {
+      qWarning( "Error converting '%s': unable to load.",
+        qPrintable( filename ) );
+      success = false;
+      continue;
+    }
+
+    Journal::replay( journalFilename( topic ), &document,
+      SaveQueue::fileIdentity( filename ) );
+
+    bool saved;
+    if ( binary ) {
+      FormatBinary format( &document );
+      saved = format.save( filename );
+    } else {
+      Format format( &document );
+      saved = format.save( filename );
+    }
+    if ( !saved ) {
+      qWarning( "Error converting '%s': unable to save.",
+        qPrintable( filename ) );
+      success = false;
+      continue;
+    }
+
+    QFile::remove( journalFilename( topic ) );
+  }
+
+  mPrefs->setBinaryFormat( binary );
+
+  return success;
+}
+
+int TopicManager::relinkTopics()
+{
+  int changed = 0;
+
+  QMap<QString, QString> files;
+  foreach( QString topic, topics() ) {
+    Todoodle *e = openEditor( topic );
+    if ( e ) {
+      TopicLoader *l = mLoaders.value( topic );
+      if ( l ) l->finish();
+
+      HyperTextEdit *editor = e->editor();
+      if ( topicLinker()->linkDocument( editor->document(), topic ) > 0 ) {
+        save( topic, editor );
+        ++changed;
+      }
+    } else {
+      // Make sure not to process data which is still about to be written
+      mSaveQueue->waitFor( topicFilename( topic ) );
+      files.insert( topicFilename( topic ), journalFilename( topic ) );
+    }
+  }
+
+  int relinked = topicLinker()->relinkFiles( files );
+  if ( relinked < 0 ) return -1;
+
+  return changed + relinked;
+}
+
+int TopicManager::listTodos()
+{
+  QTextStream out( stdout );
+
+  int count = 0;
+  TodoIndex *index = todoIndex();
+  foreach( QString topic, index->topics() ) {
+    foreach( Format::Todo todo, index->todos( topic ) ) {
+      if ( todo.done ) continue;
+      out << topic << ": " << todo.text << endl;
+      ++count;
+    }
+  }
+
+  index->save();
+
+  return count;
+}
+
+void TopicManager::slotSaved( const QString &filename, bool success,
+  int revision, const QByteArray &identity )
+{
+  QString topic = QFileInfo( filename ).completeBaseName();
+
+  if ( success ) {
+    Journal *j = mJournals.value( topic );
+    if ( j ) j->checkpoint( revision, identity );
+    // The journal is replaced by the checkpoint, so the watcher takes the
+    // state of the directory after it
+    if ( mTopicWatcher ) mTopicWatcher->endWrite( topic );
+    mFileIdentities.insert( topic, identity );
+    if ( mSearchIndex ) mSearchIndex->setIdentity( topic, identity );
+    if ( mLinkIndex ) mLinkIndex->setIdentity( topic, identity );
+    if ( mTodoIndex ) mTodoIndex->setIdentity( topic, identity );
+    if ( mInfoCache ) {
+      TopicInfo info;
+      if ( mPendingInfos.contains( topic ) ) {
+        info = mPendingInfos.take( topic );
+        info.setLastModified( QFileInfo( filename ).lastModified() );
+        updateInfo( topic, info );
+      } else {
+        readInfos( QStringList( topic ) );
+      }
+    }
+    return;
+  }
+
+  qWarning( "Error saving '%s'.", qPrintable( filename ) );
+
+  if ( mTopicWatcher ) mTopicWatcher->endWrite( topic );
+
+  // Make sure the data is written again on the next save
+  Todoodle *e = openEditor( topic );
+  if ( e ) {
+    e->editor()->segmentIndex()->clear();
+    e->editor()->segmentIndex()->setDirty( true );
+  }
+}
+
+Todoodle *TopicManager::openEditor( const QString &topic )
+{
+  if ( mWindowMode == Single ) {
+    if ( topic == mCurrentTopic ) return mSingleEditor;
+    return 0;
+  } else {
+    return mEditors.value( topic );
+  }
+}
+
+void TopicManager::slotTopicsChanged( const QStringList &added,
+  const QStringList &removed, const QStringList &modified )
+{
+  // Replacing the whole index is cheaper for big batches of changes, e.g.
+  // after checking out a directory
+  if ( added.count() + removed.count() > 100 ) {
+    mTopicIndex->setTopics( mTopicWatcher->topics() );
+  } else {
+    foreach( QString topic, added ) mTopicIndex->add( topic );
+    foreach( QString topic, removed ) mTopicIndex->remove( topic );
+  }
+
+  foreach( QString topic, removed ) {
+    removeInfo( topic );
+    mBinaryTopics.remove( topic );
+    mFailedLoads.remove( topic );
+    mFileIdentities.remove( topic );
+    if ( mSearchIndex ) mSearchIndex->remove( topic );
+    if ( mLinkIndex ) mLinkIndex->remove( topic );
+    if ( mTodoIndex ) mTodoIndex->remove( topic );
+  }
+
+  QStringList changed;
+
+  foreach( QString topic, modified ) {
+    QString filename = topicFilename( topic );
+
+    // Make sure notifications about files written by ourselves are processed
+    mSaveQueue->waitFor( filename );
+    QCoreApplication::sendPostedEvents( this, QEvent::MetaCall );
+
+    QByteArray identity = SaveQueue::fileIdentity( filename );
+    if ( identity == mFileIdentities.value( topic ) ) continue;
+
+    dbg() << "Topic modified on disk: " << topic << endl;
+
+    changed.append( topic );
+
+    Todoodle *e = openEditor( topic );
+    if ( e ) {
+      if ( e->editor()->segmentIndex()->isDirty() ) {
+        qWarning( "Topic '%s' was modified on disk and in the editor. "
+          "Keeping the version of the editor.", qPrintable( topic ) );
+      } else {
+        e->loadTopic( topic );
+      }
+    }
+
+    emit topicModified( topic );
+  }
+
+  if ( mInfoCache ) readInfos( added + changed );
+
+  if ( mSearchIndex || mLinkIndex || mTodoIndex ) {
+    updateIndexes( added + modified );
+  }
 }
 
 QString TopicManager::topicFilename( const QString &topic )
@@ -168,6 +626,133 @@ QString TopicManager::topicFilename( const QString &topic )
   return topicDir() + topic + ".todoodle";
 }
 
+QString TopicManager::journalFilename( const QString &topic )
+{
+  return topicDir() + topic + ".journal";
+}
+
+Journal *TopicManager::journal( const QString &topic )
+{
+  Journal *j = mJournals.value( topic );
+  if ( !j ) {
+    j = new Journal( journalFilename( topic ), this );
+    mJournals.insert( topic, j );
+  }
+  return j;
+}
+
+QString TopicManager::searchIndexFilename()
+{
+  return topicDir() + ".searchindex";
+}
+
+SearchIndex *TopicManager::searchIndex()
+{
+  if ( !mSearchIndex ) {
+    mSearchIndex = new SearchIndex( searchIndexFilename() );
+    mSearchIndex->load();
+
+    foreach( QString topic, mSearchIndex->topics() ) {
+      if ( !topicIndex()->contains( topic ) ) mSearchIndex->remove( topic );
+    }
+    updateIndexes( topics() );
+  }
+  return mSearchIndex;
+}
+
+QString TopicManager::linkIndexFilename()
+{
+  return topicDir() + ".linkindex";
+}
+
+LinkIndex *TopicManager::linkIndex()
+{
+  if ( !mLinkIndex ) {
+    mLinkIndex = new LinkIndex( linkIndexFilename(), this );
+    mLinkIndex->load();
+
+    foreach( QString topic, mLinkIndex->topics() ) {
+      if ( !topicIndex()->contains( topic ) ) mLinkIndex->remove( topic );
+    }
+    updateIndexes( topics() );
+  }
+  return mLinkIndex;
+}
+
+QString TopicManager::todoIndexFilename()
+{
+  return topicDir() + ".todoindex";
+}
+
+TodoIndex *TopicManager::todoIndex()
+{
+  if ( !mTodoIndex ) {
+    mTodoIndex = new TodoIndex( todoIndexFilename(), this );
+    mTodoIndex->load();
+
+    foreach( QString topic, mTodoIndex->topics() ) {
+      if ( !topicIndex()->contains( topic ) ) mTodoIndex->remove( topic );
+    }
+    updateIndexes( topics() );
+  }
+  return mTodoIndex;
+}
+
+TopicCatalog *TopicManager::topicCatalog()
+{
+  if ( !mTopicCatalog ) {
+    mTopicCatalog = new TopicCatalog( this, this );
+  }
+  return mTopicCatalog;
+}
+
+void TopicManager::updateIndexes( const QStringList &topics )
+{
+  QMap<QString, QString> searchFiles;
+  QMap<QString, QString> linkFiles;
+  QMap<QString, QString> todoFiles;
+  foreach( QString topic, topics ) {
+    QString filename = topicFilename( topic );
+
+    // Unsaved changes are indexed when they are saved
+    Todoodle *e = openEditor( topic );
+    if ( e && e->editor()->segmentIndex()->isDirty() ) continue;
+
+    mSaveQueue->waitFor( filename );
+    QByteArray identity = SaveQueue::fileIdentity( filename );
+    if ( identity.isEmpty() ) continue;
+
+    if ( mSearchIndex && identity != mSearchIndex->identity( topic ) ) {
+      searchFiles.insert( topic, filename );
+    }
+    if ( mLinkIndex && identity != mLinkIndex->identity( topic ) ) {
+      linkFiles.insert( topic, filename );
+    }
+    if ( mTodoIndex && identity != mTodoIndex->identity( topic ) ) {
+      todoFiles.insert( topic, filename );
+    }
+  }
+
+  if ( mSearchIndex ) {
+    // Index in chunks, so progress can be shown when indexing many topics
+    QMap<QString, QString> chunk;
+    int done = 0;
+    QMap<QString, QString>::const_iterator it;
+    for( it = searchFiles.constBegin(); it != searchFiles.constEnd(); ++it ) {
+      chunk.insert( it.key(), it.value() );
+      if ( chunk.count() == indexChunkSize ||
+           done + chunk.count() == searchFiles.count() ) {
+        mSearchIndex->indexFiles( chunk );
+        done += chunk.count();
+        chunk.clear();
+        emit indexProgress( done * 100 / searchFiles.count() );
+      }
+    }
+  }
+  if ( mLinkIndex ) mLinkIndex->indexFiles( linkFiles );
+  if ( mTodoIndex ) mTodoIndex->indexFiles( todoFiles );
+}
+
 QString TopicManager::scratchPadFilename( const QString &topic )
 {
   return topicDir() + topic + ".scratchpad";
@@ -175,6 +760,8 @@ QString TopicManager::scratchPadFilename( const QString &topic )
 
 QString TopicManager::topicText( const QString &topic )
 {
+  mSaveQueue->waitFor( topicFilename( topic ) );
+
   QFile file( topicFilename( topic ) );
   if ( !file.open( QIODevice::ReadOnly ) ) {
     dbg() << "topicText(): Unable to open file '" + topicFilename( topic ) +
@@ -215,22 +802,210 @@ QString TopicManager::topicDir()
 
 QStringList TopicManager::topics()
 {
-  if ( mTopics.isEmpty() ) {
-    QDir dir( topicDir() );
+  return topicIndex()->topics();
+}
 
-    QStringList entries = dir.entryList();  
-    foreach( QString entry, entries ) {
-      if ( entry.endsWith( ".todoodle" ) ) {
-        mTopics.append( entry.left( entry.length() - 9 ) );
-      }
-    }
+TopicIndex *TopicManager::topicIndex()
+{
+  if ( !mTopicIndex ) {
+    mTopicIndex = new TopicIndex( this );
+
+    // The watcher scans the directory on start, so the index can be filled
+    // from its state.
+    mTopicWatcher = new TopicWatcher( topicDir(), this );
+    connect( mTopicWatcher,
+      SIGNAL( topicsChanged( const QStringList &, const QStringList &,
+                             const QStringList & ) ),
+      SLOT( slotTopicsChanged( const QStringList &, const QStringList &,
+                               const QStringList & ) ) );
+    mTopicWatcher->start();
+    updateWatchedTopics();
+
+    mTopicIndex->setTopics( mTopicWatcher->topics() );
   }
   
-  return mTopics;
+  return mTopicIndex;
+}
+
+TopicLinker *TopicManager::topicLinker()
+{
+  if ( !mTopicLinker ) {
+    mTopicLinker = new TopicLinker( topicIndex(), this );
+  }
+  return mTopicLinker;
+}
+
+bool TopicManager::deleteTopic( const QString &topic )
+{
+  dbg() << "TopicManager::deleteTopic(): " << topic << endl;
+
+  TopicLoader *l = mLoaders.value( topic );
+  if ( l ) l->finish();
+
+  Journal *j = mJournals.value( topic );
+  if ( j ) j->detach();
+
+  QString filename = topicFilename( topic );
+
+  mSaveQueue->waitFor( filename );
+
+  bool success = QFile::remove( filename );
+  QFile::remove( journalFilename( topic ) );
+  QFile::remove( scratchPadFilename( topic ) );
+
+  if ( success && mVersionControl ) {
+    mVersionControl->removeFile( filename );
+  }
+
+  // The editor of the topic doesn't know its topic anymore, when it is closed
+  mEditors.remove( topic );
+  updateWatchedTopics();
+
+  removeInfo( topic );
+  mBinaryTopics.remove( topic );
+  mFailedLoads.remove( topic );
+  mPrefs->removeTopic( topic );
+
+  topicIndex()->remove( topic );
+  if ( mSearchIndex ) mSearchIndex->remove( topic );
+  if ( mLinkIndex ) mLinkIndex->remove( topic );
+  if ( mTodoIndex ) mTodoIndex->remove( topic );
+
+  return success;
+}
+
+bool TopicManager::renameTopic( const QString &from, const QString &to )
+{
+  dbg() << "TopicManager::renameTopic(): " << from << " -> " << to << endl;
+
+  if ( !isValidTopicName( to ) || from == to || topicExists( to ) ||
+       !topicExists( from ) ) {
+    return false;
+  }
+
+  // Find affected topics before anything changes on disk
+  QStringList affected = linkIndex()->backlinks( from );
+
+  TopicLoader *l = mLoaders.value( from );
+  if ( l ) l->finish();
+
+  Todoodle *renamed = openEditor( from );
+  if ( renamed ) {
+    save( from, renamed->editor() );
+  }
+  mSaveQueue->waitFor( topicFilename( from ) );
+  // Handle the notification about the written file now, so it isn't
+  // recorded for the old name after the rename
+  QCoreApplication::sendPostedEvents( this, QEvent::MetaCall );
+
+  Journal *j = mJournals.take( from );
+  if ( j ) {
+    j->detach();
+    delete j;
+  }
+
+  bool moved = false;
+  if ( mVersionControl ) {
+    moved = mVersionControl->moveFile( topicFilename( from ),
+      topicFilename( to ) );
+  }
+  if ( !moved &&
+       !QFile::rename( topicFilename( from ), topicFilename( to ) ) ) {
+    qWarning( "Unable to rename '%s'.", qPrintable( topicFilename( from ) ) );
+    return false;
+  }
+  QFile::rename( journalFilename( from ), journalFilename( to ) );
+  QFile::rename( scratchPadFilename( from ), scratchPadFilename( to ) );
+
+  mPrefs->renameTopic( from, to );
+
+  removeInfo( from );
+  if ( mBinaryTopics.remove( from ) ) mBinaryTopics.insert( to );
+  if ( mFailedLoads.remove( from ) ) mFailedLoads.insert( to );
+  mFileIdentities.insert( to, mFileIdentities.take( from ) );
+  if ( mSearchIndex ) mSearchIndex->remove( from );
+  if ( mLinkIndex ) mLinkIndex->remove( from );
+  if ( mTodoIndex ) mTodoIndex->remove( from );
+
+  topicIndex()->remove( from );
+  topicIndex()->add( to );
+
+  if ( renamed ) {
+    if ( mWindowMode == Single ) {
+      mCurrentTopic = to;
+    } else {
+      mEditors.remove( from );
+      mEditors.insert( to, renamed );
+    }
+    updateWatchedTopics();
+    renamed->setTopicName( to );
+
+    QByteArray base = SaveQueue::fileIdentity( topicFilename( to ) );
+    journal( to )->attach( renamed->editor()->document(), base );
+  }
+
+  // Change links in topics shown in editors in place and in all other
+  // affected topics on disk
+  QMap<QString, QString> files;
+  affected.removeAll( from );
+  affected.append( to );
+  foreach( QString topic, affected ) {
+    Todoodle *e = openEditor( topic );
+    if ( e ) continue;
+    mSaveQueue->waitFor( topicFilename( topic ) );
+    files.insert( topicFilename( topic ), journalFilename( topic ) );
+  }
+
+  QList<Todoodle *> editors;
+  if ( mWindowMode == Single ) {
+    if ( mSingleEditor ) editors.append( mSingleEditor );
+  } else {
+    editors = mEditors.values();
+  }
+  foreach( Todoodle *e, editors ) {
+    QTextDocument *document = e->editor()->document();
+    TopicLinker::renameLinks( document, from, to );
+    if ( e == renamed ) TopicLinker::renameTitle( document, from, to );
+  }
+
+  bool success = TopicLinker::renameInFiles( files, from, to ) >= 0;
+
+  if ( mInfoCache ) readInfos( affected );
+  if ( mSearchIndex || mLinkIndex || mTodoIndex ) updateIndexes( affected );
+
+  return success;
+}
+
+bool TopicManager::isValidTopicName( const QString &topic )
+{
+  if ( topic.isEmpty() || topic.startsWith( '.' ) ) return false;
+
+  for( int i = 0; i < topic.length(); ++i ) {
+    QChar c = topic.at( i );
+    if ( c.category() == QChar::Other_Control ||
+         c.category() == QChar::Separator_Line ||
+         c.category() == QChar::Separator_Paragraph ||
+         QString( "/\\:*?\"<>|" ).contains( c ) ) {
+      return false;
+    }
+  }
+
+  return true;
 }
 
 void TopicManager::finishSave()
 {
+  mSaveQueue->waitForDone();
+
+  // Process notifications about written files, so the journals are cleaned
+  // up before quitting.
+  QCoreApplication::sendPostedEvents( this, QEvent::MetaCall );
+
+  if ( mSearchIndex ) mSearchIndex->save();
+  if ( mLinkIndex ) mLinkIndex->save();
+  if ( mTodoIndex ) mTodoIndex->save();
+  if ( mInfoCache ) saveInfoCache();
+
   if ( mVersionControl ) {
     mVersionControl->commitDirectory( "Todoodle was here" );
   } else {
@@ -273,22 +1048,96 @@ void TopicManager::slotLoadStartFinished()
 TopicInfo *TopicManager::info( const QString &topic )
 {
   QMap<QString,TopicInfo *>::ConstIterator it = mInfos.find( topic );
-  if ( it == mInfos.end() ) {
-    if ( !topicExists( topic ) ) {
+  if ( it != mInfos.end() ) return it.value();
+
+  TopicInfo *info = new TopicInfo;
+  if ( !topicInfoCache()->lookup( topic, *info ) ) {
+    if ( !TopicInfoCache::readFile( topicFilename( topic ), *info ) ) {
+      delete info;
       return 0;
-    } else {
-      TopicInfo *info = new TopicInfo;
-      
-      QFileInfo fi( topicFilename( topic ) );
-      info->setLastModified( fi.lastModified() );
-      
-      mInfos.insert( topic, info );
-      
-      return info;
     }
-  } else {
-    return it.value();
+    mInfoCache->update( topic, *info );
+  }
+  mInfos.insert( topic, info );
+
+  return info;
+}
+
+QString TopicManager::topicInfoCacheFilename()
+{
+  return topicDir() + ".topiccache";
+}
+
+TopicInfoCache *TopicManager::topicInfoCache()
+{
+  if ( !mInfoCache ) {
+    mInfoCache = new TopicInfoCache( topicInfoCacheFilename() );
+    mInfoCache->open();
+
+    // Topic files are replaced by renaming them, so the cache is up to date
+    // as long as the directory wasn't modified since it was written
+    if ( !mInfoCache->hasDirIdentity(
+           SaveQueue::fileIdentity( topicDir() ) ) ) {
+      topicIndex();
+
+      foreach( QString topic, mInfoCache->topics() ) {
+        if ( !topicIndex()->contains( topic ) ) mInfoCache->remove( topic );
+      }
+
+      // The watcher already knows the modification times of all files
+      QMap<QString, QString> files;
+      foreach( QString topic, topics() ) {
+        TopicInfo info;
+        if ( !mInfoCache->lookup( topic, info ) ||
+             info.lastModified() != mTopicWatcher->lastModified( topic ) ) {
+          files.insert( topic, topicFilename( topic ) );
+        }
+      }
+      mInfoCache->readFiles( files );
+
+      saveInfoCache();
+    }
   }
+  return mInfoCache;
+}
+
+void TopicManager::saveInfoCache()
+{
+  mInfoCache->save();
+  mInfoCache->writeDirIdentity( SaveQueue::fileIdentity( topicDir() ) );
+}
+
+void TopicManager::readInfos( const QStringList &topics )
+{
+  QMap<QString, QString> files;
+  foreach( QString topic, topics ) {
+    QString filename = topicFilename( topic );
+    mSaveQueue->waitFor( filename );
+    files.insert( topic, filename );
+  }
+  mInfoCache->readFiles( files );
+
+  foreach( QString topic, topics ) {
+    TopicInfo info;
+    if ( mInfoCache->lookup( topic, info ) ) updateInfo( topic, info );
+  }
+}
+
+void TopicManager::updateInfo( const QString &topic, const TopicInfo &info )
+{
+  if ( mInfoCache ) mInfoCache->update( topic, info );
+
+  TopicInfo *i = mInfos.value( topic );
+  if ( i ) *i = info;
+
+  emit topicInfoChanged( topic );
+}
+
+void TopicManager::removeInfo( const QString &topic )
+{
+  delete mInfos.take( topic );
+  mPendingInfos.remove( topic );
+  if ( mInfoCache ) mInfoCache->remove( topic );
 }
 
 void TopicManager::showTopicMap()
@@ -300,14 +1149,19 @@ void TopicManager::showTopicMap()
   mTopicMap->raise();
 }
 
+void TopicManager::showSearch()
+{
+  if ( !mSearchWindow ) {
+    mSearchWindow = new SearchWindow( this );
+  }
+  mSearchWindow->show();
+  mSearchWindow->raise();
+}
+
 void TopicManager::showNextActionsList()
 {
   if ( !mNextActionsList ) {
-    mNextActionsList = new NextActionsList;
-    foreach( Todoodle *t, mEditors ) {
-      mNextActionsList->addEditor( t->editor() );
-    }
-    mNextActionsList->refreshList();
+    mNextActionsList = new NextActionsList( this );
   }
   mNextActionsList->show();
   mNextActionsList->raise();
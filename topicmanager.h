@@ -20,19 +20,35 @@
 #ifndef TOPICMANAGER_H
 #define TOPICMANAGER_H
 
+#include "topicinfo.h"
+
 #include <QMap>
 #include <QString>
 #include <QObject>
 #include <QStringList>
+#include <QSet>
+#include <QHash>
+#include <QByteArray>
 
 class Prefs;
 
 class HyperTextEdit;
 class Todoodle;
 class VersionControl;
-class TopicInfo;
 class TopicMap;
 class NextActionsList;
+class SaveQueue;
+class Journal;
+class TopicLoader;
+class TopicIndex;
+class TopicWatcher;
+class TopicLinker;
+class SearchIndex;
+class LinkIndex;
+class TodoIndex;
+class TopicCatalog;
+class TopicInfoCache;
+class SearchWindow;
 
 /**
   This class manages the data of all topics. It is the central class holding the
@@ -91,12 +107,18 @@ class TopicManager : public QObject
     Todoodle *editor( const QString &topic );
 
     /**
-      Return info about given topic.
+      Return info about given topic. The info is taken from the topic info
+      cache, the topic file is only read, if the topic isn't cached.
       
       \param topic name of topic
       \return pointer to topic info object
     */
     TopicInfo *info( const QString &topic );
+    /**
+      Return cache of the info about all topics. When the cache is accessed
+      for the first time, it is validated against the topic directory.
+    */
+    TopicInfoCache *topicInfoCache();
 
     /**
       Remove editor for topic from list of managed editors.
@@ -113,8 +135,24 @@ class TopicManager : public QObject
       \return \c true on success, \c false on error
     */
     bool load( const QString &topic, HyperTextEdit *editor );
+
+    /**
+      Set, if large topics are loaded incrementally. If enabled, load() only
+      loads the first screenful of data and the rest is loaded in the
+      background.
+    */
+    void setLazyLoading( bool lazy ) { mLazyLoading = lazy; }
     /**
-      Save data of topic from editor widget to disk.
+      Return loader for topic, if the topic is still being loaded.
+      
+      \param topic name of topic
+      \return loader or 0, if the topic isn't being loaded
+    */
+    TopicLoader *loader( const QString &topic ) const;
+    /**
+      Save data of topic from editor widget to disk. The data is written in
+      the background. Nothing is written if the data didn't change since it
+      was last loaded or saved.
       
       \param topic name of topic
       \param editor text editing widget
@@ -122,6 +160,18 @@ class TopicManager : public QObject
     */
     bool save( const QString &topic, HyperTextEdit * );
 
+    /**
+      Convert all topics to the binary or to the XML format. Topics which
+      already are in the requested format are left untouched. Pending changes
+      recorded in journals are included in the converted topics. New topics
+      are created in the requested format afterwards.
+      
+      \param binary \c true to convert to the binary format, \c false to
+        convert to the XML format
+      \return \c true on success, \c false if a topic couldn't be converted
+    */
+    bool convertTopics( bool binary );
+
     /**
       Return, if the topic exists.
       
@@ -142,6 +192,90 @@ class TopicManager : public QObject
       \return List of topic names
     */
     QStringList topics();
+    /**
+      Return index of the names of all existing topics. The index is updated,
+      when topics are created or deleted.
+    */
+    TopicIndex *topicIndex();
+    /**
+      Return linker converting names of topics into links. Topics are linked
+      when they are loaded.
+    */
+    TopicLinker *topicLinker();
+
+    /**
+      Convert all occurrences of names of topics in all topics into links.
+      Topics shown in an editor are changed in the editor, all other topics
+      are changed on disk.
+      
+      \return number of changed topics or -1 on error
+    */
+    int relinkTopics();
+
+    /**
+      Write the todo items of all topics, which aren't done yet, to standard
+      output. The items are taken from the todo index, topics whose files
+      changed are scanned without loading them into an editor.
+      
+      \return number of listed todo items
+    */
+    int listTodos();
+
+    /**
+      Return full text index of all topics. The index is brought up to date
+      with the topic files, when it is accessed for the first time, and then
+      updated whenever a topic is saved or changed on disk.
+    */
+    SearchIndex *searchIndex();
+    /**
+      Return, if the full text index was already created by searchIndex().
+    */
+    bool hasSearchIndex() const { return mSearchIndex != 0; }
+    /**
+      Return index of the links between topics. The index is brought up to
+      date with the topic files, when it is accessed for the first time, and
+      then updated whenever a topic is loaded, saved or changed on disk.
+    */
+    LinkIndex *linkIndex();
+    /**
+      Return index of the todo items of all topics. The index is brought up
+      to date with the topic files, when it is accessed for the first time,
+      and then updated whenever a topic is loaded, saved or changed on disk.
+    */
+    TodoIndex *todoIndex();
+    /**
+      Return catalog of the attributes of all topics shown in topic lists.
+      The catalog is created, when it is accessed for the first time.
+    */
+    TopicCatalog *topicCatalog();
+
+    /**
+      Delete topic. This removes the data of the topic from disk. An editor
+      showing the topic has to be closed before.
+      
+      \param topic name of topic
+      \return \c true on success, \c false on error
+    */
+    bool deleteTopic( const QString &topic );
+
+    /**
+      Rename topic. This renames the files and preferences of the topic and
+      changes all links to the topic. Only topics linking to the topic are
+      rewritten. Topics shown in an editor are changed in the editor, all
+      other topics are changed on disk in parallel.
+      
+      \param from old name of topic
+      \param to new name of topic
+      \return \c true on success, \c false on error
+    */
+    bool renameTopic( const QString &from, const QString &to );
+    /**
+      Return, if the given name can be used as name of a topic. Names must
+      not contain line breaks or characters which aren't allowed in file
+      names and must not start with a dot, which is used for the index
+      files. Topics with other names are never created.
+    */
+    static bool isValidTopicName( const QString &topic );
 
     /**
       Close all topic windows.
@@ -176,31 +310,126 @@ class TopicManager : public QObject
       Show list of "next actions"
     */
     void showNextActionsList();
+    /**
+      Show window for searching the text of all topics.
+    */
+    void showSearch();
+
+  signals:
+    /**
+      Emitted when the data of a topic was modified on disk by another
+      process.
+      
+      \param topic name of topic
+    */
+    void topicModified( const QString &topic );
+    /**
+      Emitted when the info about a topic changed.
+      
+      \param topic name of topic
+    */
+    void topicInfoChanged( const QString &topic );
+    /**
+      Emitted while topics are added to the full text index.
+      
+      \param percent progress of indexing in percent
+    */
+    void indexProgress( int percent );
 
   public slots:
     /**
-      Finish saving data and then quit application.
+      Finish saving data and then quit application. This waits until all data
+      queued for saving is written.
     */
     void finishSave();
 
   protected slots:
     void slotSaveFinished();
     void slotLoadStartFinished();
+    void slotSaved( const QString &filename, bool success, int revision,
+      const QByteArray &identity );
+    void slotLoadFinished( TopicLoader * );
+    void slotTopicsChanged( const QStringList &added,
+      const QStringList &removed, const QStringList &modified );
 
   protected:
     QString topicFilename( const QString &topic );
+    QString journalFilename( const QString &topic );
+    QString searchIndexFilename();
+    QString linkIndexFilename();
+    QString todoIndexFilename();
+    QString topicInfoCacheFilename();
+
+    /**
+      Update the search, link and todo indexes for the given topics, if they
+      changed since they were last indexed.
+    */
+    void updateIndexes( const QStringList &topics );
+
+    /**
+      Read info about the given topics from their files and update the
+      cache.
+    */
+    void readInfos( const QStringList &topics );
+    /**
+      Set info about topic and emit topicInfoChanged().
+    */
+    void updateInfo( const QString &topic, const TopicInfo &info );
+    /**
+      Remove info about topic.
+    */
+    void removeInfo( const QString &topic );
+    /**
+      Write topic info cache and record the state of the topic directory.
+    */
+    void saveInfoCache();
+
+    /**
+      Return editor currently showing the given topic or 0, if the topic isn't
+      shown.
+    */
+    Todoodle *openEditor( const QString &topic );
+    /**
+      Let the topic watcher watch the files of the topics open in editors.
+    */
+    void updateWatchedTopics();
+
+    /**
+      Return journal recording the changes of the given topic.
+    */
+    Journal *journal( const QString &topic );
     
   private:
     QMap<QString, Todoodle *> mEditors;
     QMap<QString, TopicInfo *> mInfos;
+    TopicInfoCache *mInfoCache;
+    /** Info about topics queued for saving, by topic */
+    QMap<QString, TopicInfo> mPendingInfos;
+    QMap<QString, Journal *> mJournals;
+    QSet<QString> mBinaryTopics;
+    QMap<QString, TopicLoader *> mLoaders;
+    /** Topics whose incremental loading failed, they must not be saved */
+    QSet<QString> mFailedLoads;
+    bool mLazyLoading;
     
     Todoodle *mSingleEditor;
     
     VersionControl *mVersionControl;
 
+    SaveQueue *mSaveQueue;
+
     QString mTopicDir;
 
-    QStringList mTopics;
+    TopicIndex *mTopicIndex;
+    TopicWatcher *mTopicWatcher;
+    TopicLinker *mTopicLinker;
+    SearchIndex *mSearchIndex;
+    LinkIndex *mLinkIndex;
+    TodoIndex *mTodoIndex;
+    TopicCatalog *mTopicCatalog;
+    SearchWindow *mSearchWindow;
+    /** Identities of topic files as last loaded or written by the manager */
+    QHash<QString, QByteArray> mFileIdentities;
     
     TopicMap *mTopicMap;
     NextActionsList *mNextActionsList;
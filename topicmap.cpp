@@ -25,6 +25,7 @@
 #include "dbg.h"
 
 #include <QPushButton>
+#include <QCheckBox>
 #include <QPainter>
 #include <QPen>
 #include <QSettings>
@@ -36,17 +37,37 @@ TopicMap::TopicMap( TopicManager *topicManager, QWidget *parent )
 {
   QBoxLayout *topLayout = new QVBoxLayout( this );
   
-  TopicMapWidget *map = new TopicMapWidget( this );
-  map->setupItems( topicManager );
-  topLayout->addWidget( map );
-  
-  QPushButton *button = new QPushButton( "Close", this );
-  connect( button, SIGNAL( clicked() ), SLOT( close() ) );
-  topLayout->addWidget( button );
-
   mSettings = new QSettings( "kde.org", "todoodle" );
   mSettings->beginGroup( topicManager->topicDir() );
 
+  mMap = new TopicMapWidget( this );
+  mMap->setPinMoved( mSettings->value( "/map/pinMoved", true ).toBool() );
+  mMap->setupItems( topicManager );
+  topLayout->addWidget( mMap );
+
+  QBoxLayout *buttonLayout = new QHBoxLayout;
+  topLayout->addLayout( buttonLayout );
+
+  QCheckBox *pinCheck = new QCheckBox( "Keep moved topics in place", this );
+  pinCheck->setChecked( mMap->pinMoved() );
+  connect( pinCheck, SIGNAL( toggled( bool ) ),
+    mMap, SLOT( setPinMoved( bool ) ) );
+  buttonLayout->addWidget( pinCheck );
+
+  buttonLayout->addStretch( 1 );
+
+  QPushButton *button = new QPushButton( "Fit", this );
+  connect( button, SIGNAL( clicked() ), mMap, SLOT( zoomToFit() ) );
+  buttonLayout->addWidget( button );
+
+  button = new QPushButton( "Layout", this );
+  connect( button, SIGNAL( clicked() ), mMap, SLOT( startLayout() ) );
+  buttonLayout->addWidget( button );
+
+  button = new QPushButton( "Close", this );
+  connect( button, SIGNAL( clicked() ), SLOT( close() ) );
+  buttonLayout->addWidget( button );
+
   if ( mSettings->contains( "/map/pos" ) ) {
     QPoint pos = mSettings->value( "/map/pos" ).toPoint();
     move( pos );
@@ -61,6 +82,7 @@ TopicMap::~TopicMap()
 {
   mSettings->setValue( "/map/pos", pos() );
   mSettings->setValue( "/map/size", size() );
+  mSettings->setValue( "/map/pinMoved", mMap->pinMoved() );
 
   delete mSettings;
 }
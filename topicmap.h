@@ -25,6 +25,7 @@
 class QSettings;
 
 class TopicManager;
+class TopicMapWidget;
 
 /**
   This class represents a map view on all topics.
@@ -37,6 +38,7 @@ class TopicMap : public QWidget
 
   private:
     QSettings *mSettings;
+    TopicMapWidget *mMap;
 };
 
 #endif
@@ -0,0 +1,319 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topicmaplayout.h"
+
+#include "dbg.h"
+
+#include <QMetaType>
+#include <QTime>
+#include <QVarLengthArray>
+
+#include <math.h>
+
+// Preferred distance of linked topics in pixels
+static const qreal idealLength = 80;
+// Pull towards the center, which keeps unlinked topics together
+static const qreal gravity = 0.5;
+// Ratio of node size and distance below which a node is taken as a whole
+static const qreal theta = 0.9;
+static const qreal cooling = 0.97;
+static const qreal minTemperature = 0.5;
+static const int maxIterations = 500;
+// Interval in ms in which intermediate positions are reported
+static const int frameInterval = 40;
+// Bodies closer than this are kept in one leaf
+static const qreal minNodeSize = 0.01;
+
+TopicMapLayout::TopicMapLayout( QObject *parent )
+  : QThread( parent ), mGeneration( 0 ), mPending( false ),
+    mCancelled( false ), mStop( false )
+{
+  qRegisterMetaType<QVector<QPointF> >( "QVector<QPointF>" );
+
+  start();
+}
+
+TopicMapLayout::~TopicMapLayout()
+{
+  mMutex.lock();
+  mStop = true;
+  mRequestAvailable.wakeAll();
+  mMutex.unlock();
+
+  wait();
+}
+
+void TopicMapLayout::layout( const Graph &graph, int generation )
+{
+  QMutexLocker locker( &mMutex );
+
+  mRequest = graph;
+  mGeneration = generation;
+  mPending = true;
+
+  mRequestAvailable.wakeOne();
+}
+
+void TopicMapLayout::cancel()
+{
+  QMutexLocker locker( &mMutex );
+
+  mPending = false;
+  mCancelled = true;
+}
+
+bool TopicMapLayout::isAborted()
+{
+  QMutexLocker locker( &mMutex );
+
+  return mPending || mCancelled || mStop;
+}
+
+void TopicMapLayout::run()
+{
+  mMutex.lock();
+
+  forever {
+    while( !mPending && !mStop ) {
+      mRequestAvailable.wait( &mMutex );
+    }
+    if ( mStop ) break;
+
+    Graph graph = mRequest;
+    int generation = mGeneration;
+    mPending = false;
+    mCancelled = false;
+
+    mMutex.unlock();
+
+    computeLayout( graph, generation );
+
+    mMutex.lock();
+  }
+
+  mMutex.unlock();
+}
+
+bool TopicMapLayout::computeLayout( Graph &graph, int generation )
+{
+  QVector<QPointF> &positions = graph.positions;
+  int count = positions.count();
+  if ( count == 0 ) {
+    emit positionsChanged( positions, generation, true );
+    return true;
+  }
+
+  QTime time;
+  time.start();
+  QTime frameTime;
+  frameTime.start();
+
+  qreal temperature = 4 * idealLength;
+
+  QVector<QPointF> displacements( count );
+
+  int iteration;
+  for( iteration = 0; iteration < maxIterations &&
+       temperature > minTemperature; ++iteration ) {
+    if ( isAborted() ) return false;
+
+    buildTree( positions );
+
+    QPointF center( mNodes.at( 0 ).sumX / count, mNodes.at( 0 ).sumY / count );
+
+    for( int i = 0; i < count; ++i ) {
+      displacements[ i ] = repulsion( positions, i ) +
+        ( center - positions.at( i ) ) * gravity;
+    }
+
+    for( int e = 0; e < graph.edges.count(); ++e ) {
+      int from = graph.edges.at( e ).first;
+      int to = graph.edges.at( e ).second;
+      if ( from == to ) continue;
+
+      QPointF delta = positions.at( to ) - positions.at( from );
+      qreal distance = sqrt( delta.x() * delta.x() + delta.y() * delta.y() );
+      QPointF force = delta * ( distance / idealLength );
+      displacements[ from ] += force;
+      displacements[ to ] -= force;
+    }
+
+    for( int i = 0; i < count; ++i ) {
+      if ( graph.fixed.at( i ) ) continue;
+
+      QPointF d = displacements.at( i );
+      qreal length = sqrt( d.x() * d.x() + d.y() * d.y() );
+      if ( length > temperature ) d *= temperature / length;
+      positions[ i ] += d;
+    }
+
+    temperature *= cooling;
+
+    if ( frameTime.elapsed() >= frameInterval ) {
+      emit positionsChanged( positions, generation, false );
+      frameTime.restart();
+    }
+  }
+
+  dbg() << "TopicMapLayout: " << count << " topics, " << iteration
+        << " iterations, " << time.elapsed() << " ms" << endl;
+
+  emit positionsChanged( positions, generation, true );
+
+  return true;
+}
+
+void TopicMapLayout::buildTree( const QVector<QPointF> &positions )
+{
+  qreal left = positions.at( 0 ).x();
+  qreal right = left;
+  qreal top = positions.at( 0 ).y();
+  qreal bottom = top;
+  foreach( QPointF p, positions ) {
+    if ( p.x() < left ) left = p.x();
+    else if ( p.x() > right ) right = p.x();
+    if ( p.y() < top ) top = p.y();
+    else if ( p.y() > bottom ) bottom = p.y();
+  }
+
+  Node root;
+  root.x = left;
+  root.y = top;
+  root.size = qMax( qMax( right - left, bottom - top ), qreal( 1 ) );
+  root.sumX = 0;
+  root.sumY = 0;
+  root.mass = 0;
+  root.body = -1;
+  root.children[ 0 ] = root.children[ 1 ] = root.children[ 2 ] =
+    root.children[ 3 ] = -1;
+
+  mNodes.clear();
+  mNodes.reserve( 2 * positions.count() );
+  mNodes.append( root );
+
+  for( int i = 0; i < positions.count(); ++i ) {
+    QPointF p = positions.at( i );
+    int node = 0;
+    forever {
+      if ( mNodes.at( node ).body == -1 ) {
+        Node &n = mNodes[ node ];
+        n.body = i;
+        n.sumX = p.x();
+        n.sumY = p.y();
+        n.mass = 1;
+        break;
+      }
+      if ( mNodes.at( node ).body >= 0 ) {
+        if ( mNodes.at( node ).size < minNodeSize ) {
+          Node &n = mNodes[ node ];
+          n.sumX += p.x();
+          n.sumY += p.y();
+          n.mass++;
+          break;
+        }
+        // Push body of leaf down one level
+        int body = mNodes.at( node ).body;
+        QPointF b = positions.at( body );
+        int c = child( node, b );
+        Node &n = mNodes[ c ];
+        n.body = body;
+        n.sumX = b.x();
+        n.sumY = b.y();
+        n.mass = 1;
+        mNodes[ node ].body = -2;
+      }
+      Node &n = mNodes[ node ];
+      n.sumX += p.x();
+      n.sumY += p.y();
+      n.mass++;
+      node = child( node, p );
+    }
+  }
+}
+
+int TopicMapLayout::child( int node, const QPointF &position )
+{
+  const Node &n = mNodes.at( node );
+  qreal half = n.size / 2;
+  int quadrant = 0;
+  if ( position.x() >= n.x + half ) quadrant |= 1;
+  if ( position.y() >= n.y + half ) quadrant |= 2;
+
+  int c = n.children[ quadrant ];
+  if ( c >= 0 ) return c;
+
+  Node childNode;
+  childNode.x = ( quadrant & 1 ) ? n.x + half : n.x;
+  childNode.y = ( quadrant & 2 ) ? n.y + half : n.y;
+  childNode.size = half;
+  childNode.sumX = 0;
+  childNode.sumY = 0;
+  childNode.mass = 0;
+  childNode.body = -1;
+  childNode.children[ 0 ] = childNode.children[ 1 ] =
+    childNode.children[ 2 ] = childNode.children[ 3 ] = -1;
+
+  c = mNodes.count();
+  mNodes.append( childNode );
+  mNodes[ node ].children[ quadrant ] = c;
+
+  return c;
+}
+
+QPointF TopicMapLayout::repulsion( const QVector<QPointF> &positions,
+  int body ) const
+{
+  QPointF p = positions.at( body );
+  qreal k2 = idealLength * idealLength;
+  qreal theta2 = theta * theta;
+
+  QPointF force;
+
+  QVarLengthArray<int, 64> stack;
+  stack.append( 0 );
+  while( !stack.isEmpty() ) {
+    const Node &n = mNodes.at( stack[ stack.count() - 1 ] );
+    stack.resize( stack.count() - 1 );
+
+    if ( n.mass == 0 || n.body == body ) continue;
+
+    qreal dx = p.x() - n.sumX / n.mass;
+    qreal dy = p.y() - n.sumY / n.mass;
+    qreal d2 = dx * dx + dy * dy;
+
+    if ( n.body >= 0 || n.size * n.size < theta2 * d2 ) {
+      if ( d2 < 0.01 ) {
+        // Separate bodies at the same position in a stable direction
+        dx = ( body % 2 ) ? 0.1 : -0.1;
+        dy = ( body % 3 ) ? 0.1 : -0.1;
+        d2 = 0.02;
+      }
+      qreal f = k2 * n.mass / d2;
+      force += QPointF( dx * f, dy * f );
+    } else {
+      for( int i = 0; i < 4; ++i ) {
+        if ( n.children[ i ] >= 0 ) stack.append( n.children[ i ] );
+      }
+    }
+  }
+
+  return force;
+}
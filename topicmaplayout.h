@@ -0,0 +1,133 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICMAPLAYOUT_H
+#define TOPICMAPLAYOUT_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QPointF>
+#include <QPair>
+
+/**
+  This class computes a force-directed layout of the topic map in a
+  background thread. Linked topics attract each other, all topics repel
+  each other. Repulsion is approximated with a Barnes-Hut quadtree, so an
+  iteration takes O(n log n) time. The temperature, which limits how far a
+  topic moves in one iteration, is lowered after each iteration, until the
+  layout has settled.
+
+  Intermediate positions are reported a few times per second, so the map
+  can show the layout while it evolves. Only the latest request is
+  processed, a new request aborts the running one.
+*/
+class TopicMapLayout : public QThread
+{
+    Q_OBJECT
+  public:
+    /**
+      Snapshot of the topic map to be laid out.
+    */
+    struct Graph
+    {
+      /** Start positions of the nodes. */
+      QVector<QPointF> positions;
+      /** Nodes which keep their position. */
+      QVector<bool> fixed;
+      /** Links as pairs of node indexes. */
+      QVector<QPair<int, int> > edges;
+    };
+
+    /**
+      Create layout engine. The worker thread is started immediately.
+    */
+    TopicMapLayout( QObject *parent = 0 );
+    /**
+      Stop the worker thread.
+    */
+    ~TopicMapLayout();
+
+    /**
+      Request layout of the given graph.
+      
+      \param graph nodes and links to be laid out
+      \param generation number reported back by positionsChanged()
+    */
+    void layout( const Graph &graph, int generation );
+    /**
+      Abort running layout.
+    */
+    void cancel();
+
+  signals:
+    /**
+      Emitted from the worker thread with intermediate and final positions.
+      
+      \param positions positions of the nodes in the order of the request
+      \param generation number given to layout()
+      \param finished \c true, if the layout has settled
+    */
+    void positionsChanged( const QVector<QPointF> &positions,
+      int generation, bool finished );
+
+  protected:
+    void run();
+
+    /**
+      Run layout. Returns \c false, if it was aborted by a new request.
+    */
+    bool computeLayout( Graph &graph, int generation );
+
+    void buildTree( const QVector<QPointF> &positions );
+    QPointF repulsion( const QVector<QPointF> &positions, int body ) const;
+
+    bool isAborted();
+
+  private:
+    struct Node
+    {
+      qreal x;
+      qreal y;
+      qreal size;
+      // Sum of positions of the contained bodies and their number
+      qreal sumX;
+      qreal sumY;
+      int mass;
+      // Index of the body of a leaf, -1 for an empty leaf and -2 for
+      // inner nodes
+      int body;
+      int children[ 4 ];
+    };
+
+    int child( int node, const QPointF &position );
+
+    QVector<Node> mNodes;
+
+    QMutex mMutex;
+    QWaitCondition mRequestAvailable;
+    Graph mRequest;
+    int mGeneration;
+    bool mPending;
+    bool mCancelled;
+    bool mStop;
+};
+
+#endif
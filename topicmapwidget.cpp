@@ -21,17 +21,46 @@
 #include "topicmapwidget.h"
 
 #include "topicmanager.h"
+#include "topicindex.h"
+#include "linkindex.h"
+#include "topicmaplayout.h"
+#include "prefs.h"
 #include "dbg.h"
 
 #include <QPainter>
 #include <QPen>
 #include <QMouseEvent>
-#include <QSettings>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QSet>
+
+#include <math.h>
+
+// Below this zoom factor topics are shown as dots instead of labels
+static const qreal labelScale = 0.6;
+// Below this zoom factor topics are aggregated to clusters
+static const qreal clusterScale = 0.25;
+// Maximum number of topics shown individually, more are shown as clusters
+static const int maxDetailItems = 2000;
+// Minimum size of a cluster cell on the screen in pixels
+static const int clusterPixels = 24;
+// Size of the dot representing a topic on the screen in pixels
+static const int dotPixels = 5;
+// Size of the cells links are recorded in, in map coordinates
+static const int linkCellSize = 256;
+static const qreal minScale = 1.0 / 256;
+static const qreal maxScale = 4;
 
 TopicMapWidget::TopicMapWidget( QWidget *parent )
-  : QFrame( parent ), mMoveItem( 0 )
+  : QFrame( parent ), mTopZ( 0 ), mLinksDirty( false ), mMoveItem( 0 ),
+    mMoved( false ), mLayoutGeneration( 0 ), mLayoutRunning( false ),
+    mScale( 1 ), mPanning( false ), mShowsClusters( false ), mPinMoved( true ),
+    mFitOnLayout( false ), mTopicManager( 0 )
 {
-  mSettings = new QSettings( "kde.org", "todoodle" );
+  mLayout = new TopicMapLayout( this );
+  connect( mLayout,
+    SIGNAL( positionsChanged( const QVector<QPointF> &, int, bool ) ),
+    SLOT( slotLayoutChanged( const QVector<QPointF> &, int, bool ) ) );
 
   setBackgroundRole( QPalette::Midlight );
   setLineWidth( 2 );
@@ -41,60 +70,473 @@ TopicMapWidget::TopicMapWidget( QWidget *parent )
 
 TopicMapWidget::~TopicMapWidget()
 {
-  writeSettings();
+  // Stop the layout thread before the items go away
+  delete mLayout;
 
-  delete mSettings;
+  writeSettings();
 
-  qDeleteAll( mItems.begin(), mItems.end() );
-  mItems.clear();
+  clearItems();
 }
 
 void TopicMapWidget::writeSettings()
 {
+  if ( !mTopicManager ) return;
+
+  // The prefs only write the states which changed
+  Prefs *prefs = mTopicManager->prefs();
   foreach( TopicItem *item, mItems ) {
-    mSettings->setValue( item->topic + "/map/pos", item->pos );
+    TopicStateStore::State state = prefs->topicState( item->topic );
+    state.hasMapPos = true;
+    state.mapPos = item->pos;
+    state.mapPinned = item->pinned;
+    prefs->setTopicState( item->topic, state );
   }
 }
 
-void TopicMapWidget::readSettings()
+bool TopicMapWidget::readPosition( TopicItem *item )
 {
-  foreach( TopicItem *item, mItems ) {
-    if ( mSettings->contains( item->topic + "/map/pos" ) ) {
-      item->pos = mSettings->value( item->topic + "/map/pos" ).toPoint();
-    }
-  }
+  TopicStateStore::State state =
+    mTopicManager->prefs()->topicState( item->topic );
+  if ( !state.hasMapPos ) return false;
+
+  item->pos = state.mapPos;
+  item->pinned = state.mapPinned;
+
+  return true;
 }
 
 void TopicMapWidget::setupItems( TopicManager *topicManager )
 {
   dbg() << "TopicMapWidget::setupItems()" << endl;
 
-  mSettings->beginGroup( topicManager->topicDir() );
+  if ( !mTopicManager ) {
+    TopicIndex *index = topicManager->topicIndex();
+    connect( index, SIGNAL( topicAdded( const QString & ) ),
+      SLOT( slotTopicAdded( const QString & ) ) );
+    connect( index, SIGNAL( topicRemoved( const QString & ) ),
+      SLOT( slotTopicRemoved( const QString & ) ) );
+    connect( index, SIGNAL( topicsReset() ), SLOT( slotTopicsReset() ) );
 
-  static int x = 20;
-  static int y = 20;
+    connect( topicManager->linkIndex(),
+      SIGNAL( linksChanged( const QString & ) ), SLOT( slotLinksChanged() ) );
+  }
+  mTopicManager = topicManager;
 
-  qDeleteAll( mItems.begin(), mItems.end() );
-  mItems.clear();
+  bool running = mLayoutRunning;
+  clearItems();
+
+  bool unplaced = false;
 
   QStringList topics = topicManager->topics();
   foreach( QString t, topics ) {
+    TopicItem *item = createItem( t );
+    if ( !readPosition( item ) ) unplaced = true;
+    addItem( item );
+  }
+
+  if ( unplaced ) mFitOnLayout = true;
+  if ( unplaced || running ) startLayout();
+}
+
+TopicItem *TopicMapWidget::createItem( const QString &topic )
+{
+  TopicItem *item = new TopicItem;
+  item->topic = topic;
+  item->text = topic;
+  item->z = 0;
+  item->pinned = false;
+
+  // Place new items on a spiral, so they don't overlap before they are laid
+  // out
+  int index = mItems.count();
+  qreal radius = 40 * sqrt( qreal( index ) );
+  qreal angle = index * 2.4;
+  item->pos = QPoint( 200 + int( radius * cos( angle ) ),
+                      100 + int( radius * sin( angle ) ) );
+
+  return item;
+}
+
+void TopicMapWidget::addItem( TopicItem *item )
+{
+  item->z = ++mTopZ;
+  renderLabel( item );
+
+  mItems.append( item );
+  mItemsByTopic.insert( item->topic, item );
+  mGrid.insert( item, item->rect );
+  mClusterLevels.clear();
+
+  mLinksDirty = true;
+}
+
+void TopicMapWidget::clearItems()
+{
+  // Positions of a running layout refer to the old items
+  mLayout->cancel();
+  ++mLayoutGeneration;
+  mLayoutItems.clear();
+  mLayoutRunning = false;
+
+  mMoveItem = 0;
+  mGrid.clear();
+  mLinkCells.clear();
+  mItemsByTopic.clear();
+  mClusterLevels.clear();
+
+  qDeleteAll( mItems.begin(), mItems.end() );
+  mItems.clear();
+}
+
+void TopicMapWidget::renderLabel( TopicItem *item )
+{
+  QFontMetrics fm( font() );
+  QRect r = fm.boundingRect( item->text );
   
-    TopicItem *item = new TopicItem;
-    item->topic = t;
-    item->text = t;
-    item->pos = QPoint( x, y );
-  
-    x += 70;
-    if ( x > 400 ) {
-      x = 20;
-      y += 30;
+  int margin = 6;
+  r.adjust( -margin, -margin, margin, margin );
+
+  // The pen is two pixels wide, so it extends one pixel beyond the box
+  QRect outer = r.adjusted( -1, -1, 1, 1 );
+
+  QPixmap pixmap( outer.size() );
+  pixmap.fill( Qt::transparent );
+
+  QPainter p( &pixmap );
+  p.translate( -outer.topLeft() );
+  p.setFont( font() );
+  p.setPen( QPen( Qt::black, 2 ) );
+  p.setBrush( Qt::cyan );
+  p.drawRoundRect( r );
+  p.drawText( QPoint( 0, 0 ), item->text );
+  p.end();
+
+  item->label = pixmap;
+  item->labelOffset = outer.topLeft();
+  item->rect = QRect( item->pos + item->labelOffset, outer.size() );
+}
+
+void TopicMapWidget::moveItem( TopicItem *item, const QPoint &pos )
+{
+  QPoint oldPos = item->pos;
+
+  // Cells of links are rebuilt with the links, when those are dirty
+  if ( !mLinksDirty ) updateLinkCells( item, false );
+
+  mGrid.remove( item, item->rect );
+  item->pos = pos;
+  item->rect.moveTopLeft( pos + item->labelOffset );
+  mGrid.insert( item, item->rect );
+
+  if ( mLinksDirty ) {
+    mClusterLevels.clear();
+  } else {
+    updateLinkCells( item, true );
+    moveInClusters( item, oldPos );
+  }
+}
+
+static QList<quint64> segmentCells( const QPointF &p1, const QPointF &p2,
+  int cellSize )
+{
+  QPointF from = p1;
+  QPointF to = p2;
+  if ( from.x() > to.x() ) qSwap( from, to );
+
+  qreal dx = to.x() - from.x();
+  qreal dy = to.y() - from.y();
+
+  // Walk through the columns and take the rows the segment covers in each
+  QList<quint64> cells;
+  int left = int( floor( from.x() / cellSize ) );
+  int right = int( floor( to.x() / cellSize ) );
+  for( int column = left; column <= right; ++column ) {
+    qreal y1 = from.y();
+    qreal y2 = to.y();
+    if ( dx > 0 ) {
+      qreal x1 = qMax( from.x(), qreal( column * cellSize ) );
+      qreal x2 = qMin( to.x(), qreal( ( column + 1 ) * cellSize ) );
+      y1 = from.y() + ( x1 - from.x() ) * dy / dx;
+      y2 = from.y() + ( x2 - from.x() ) * dy / dx;
+    }
+    int top = int( floor( qMin( y1, y2 ) / cellSize ) );
+    int bottom = int( floor( qMax( y1, y2 ) / cellSize ) );
+    for( int row = top; row <= bottom; ++row ) {
+      cells.append( quint64( quint32( column ) ) << 32 | quint32( row ) );
+    }
+  }
+  return cells;
+}
+
+void TopicMapWidget::updateLinkCells( TopicItem *item, bool insert )
+{
+  foreach( TopicItem *target, item->links ) {
+    updateLinkCells( item, target, insert );
+  }
+  foreach( TopicItem *source, item->backlinks ) {
+    // Links to the item itself are already handled as outgoing links
+    if ( source != item ) updateLinkCells( source, item, insert );
+  }
+}
+
+void TopicMapWidget::updateLinkCells( TopicItem *from, TopicItem *to,
+  bool insert )
+{
+  Link link( from, to );
+  foreach( quint64 key, segmentCells( from->pos, to->pos, linkCellSize ) ) {
+    if ( insert ) {
+      mLinkCells[ key ].append( link );
+    } else {
+      QHash<quint64, QList<Link> >::iterator it = mLinkCells.find( key );
+      if ( it == mLinkCells.end() ) continue;
+      int index = it.value().indexOf( link );
+      if ( index >= 0 ) it.value().removeAt( index );
+      if ( it.value().isEmpty() ) mLinkCells.erase( it );
+    }
+  }
+}
+
+void TopicMapWidget::moveInClusters( TopicItem *item, const QPoint &oldPos )
+{
+  QMap<int, ClusterLevel>::iterator it;
+  for( it = mClusterLevels.begin(); it != mClusterLevels.end(); ++it ) {
+    int cellSize = it.key();
+    ClusterLevel &level = it.value();
+
+    quint64 oldKey = cellKey( oldPos, cellSize );
+    quint64 newKey = cellKey( item->pos, cellSize );
+
+    Cluster &oldCluster = level.clusters[ oldKey ];
+    oldCluster.sumX -= oldPos.x();
+    oldCluster.sumY -= oldPos.y();
+    if ( oldKey != newKey && --oldCluster.count == 0 ) {
+      level.clusters.remove( oldKey );
+    }
+
+    QHash<quint64, Cluster>::iterator c = level.clusters.find( newKey );
+    if ( c == level.clusters.end() ) {
+      Cluster cluster;
+      cluster.sumX = 0;
+      cluster.sumY = 0;
+      cluster.count = 1;
+      c = level.clusters.insert( newKey, cluster );
+    } else if ( oldKey != newKey ) {
+      c.value().count++;
+    }
+    c.value().sumX += item->pos.x();
+    c.value().sumY += item->pos.y();
+
+    if ( oldKey == newKey ) continue;
+
+    // Each link of the item moves from the bundle of the old cell to the
+    // bundle of the new cell
+    foreach( TopicItem *other, item->links + item->backlinks ) {
+      if ( other == item ) continue;
+      quint64 otherKey = cellKey( other->pos, cellSize );
+      addToBundle( level, oldKey, otherKey, -1 );
+      addToBundle( level, newKey, otherKey, 1 );
+    }
+  }
+}
+
+void TopicMapWidget::addToBundle( ClusterLevel &level, quint64 from,
+  quint64 to, int count )
+{
+  if ( from == to ) return;
+
+  for( int i = 0; i < 2; ++i ) {
+    QHash<quint64, int> &bundles = level.bundles[ from ];
+    bundles[ to ] += count;
+    if ( bundles[ to ] <= 0 ) {
+      bundles.remove( to );
+      if ( bundles.isEmpty() ) level.bundles.remove( from );
+    }
+    qSwap( from, to );
+  }
+}
+
+static QRect lineBounds( const QPoint &from, const QPoint &to )
+{
+  return QRect( from, to ).normalized().adjusted( -1, -1, 1, 1 );
+}
+
+// Return, if the line segment intersects the rectangle (Liang-Barsky)
+static bool lineIntersects( const QPointF &from, const QPointF &to,
+  const QRectF &rect )
+{
+  qreal dx = to.x() - from.x();
+  qreal dy = to.y() - from.y();
+  qreal p[ 4 ] = { -dx, dx, -dy, dy };
+  qreal q[ 4 ] = { from.x() - rect.left(), rect.right() - from.x(),
+                   from.y() - rect.top(), rect.bottom() - from.y() };
+
+  qreal t1 = 0;
+  qreal t2 = 1;
+  for( int i = 0; i < 4; ++i ) {
+    if ( p[ i ] == 0 ) {
+      if ( q[ i ] < 0 ) return false;
+    } else {
+      qreal t = q[ i ] / p[ i ];
+      if ( p[ i ] < 0 ) t1 = qMax( t1, t );
+      else t2 = qMin( t2, t );
+      if ( t1 > t2 ) return false;
+    }
+  }
+  return true;
+}
+
+QRegion TopicMapWidget::itemRegion( TopicItem *item ) const
+{
+  QRegion region( item->rect );
+  region += dotRect( item );
+  foreach( TopicItem *target, item->links ) {
+    region += lineBounds( item->pos, target->pos );
+  }
+  foreach( TopicItem *source, item->backlinks ) {
+    region += lineBounds( source->pos, item->pos );
+  }
+  return region;
+}
+
+void TopicMapWidget::updateLinks()
+{
+  foreach( TopicItem *item, mItems ) {
+    item->links.clear();
+    item->backlinks.clear();
+  }
+
+  if ( mTopicManager ) {
+    LinkIndex *links = mTopicManager->linkIndex();
+    foreach( TopicItem *item, mItems ) {
+      foreach( QString link, links->links( item->topic ) ) {
+        TopicItem *target = mItemsByTopic.value( link );
+        if ( target ) {
+          item->links.append( target );
+          target->backlinks.append( item );
+        }
+      }
+    }
+  }
+
+  mLinkCells.clear();
+  foreach( TopicItem *item, mItems ) {
+    foreach( TopicItem *target, item->links ) {
+      updateLinkCells( item, target, true );
+    }
+  }
+
+  mLinksDirty = false;
+  mClusterLevels.clear();
+}
+
+void TopicMapWidget::slotLinksChanged()
+{
+  mLinksDirty = true;
+  update();
+}
+
+void TopicMapWidget::slotTopicAdded( const QString &topic )
+{
+  TopicItem *item = createItem( topic );
+  readPosition( item );
+  addItem( item );
+
+  if ( mLayoutRunning ) startLayout();
+
+  update();
+}
+
+void TopicMapWidget::slotTopicRemoved( const QString &topic )
+{
+  TopicItem *item = mItemsByTopic.value( topic );
+  if ( !item ) return;
+
+  if ( mLinksDirty ) updateLinks();
+  QRegion dirty = itemRegion( item );
+
+  if ( item == mMoveItem ) mMoveItem = 0;
+  mGrid.remove( item, item->rect );
+  mClusterLevels.clear();
+  mItemsByTopic.remove( topic );
+  mItems.removeAll( item );
+  mLayoutItems.removeAll( item );
+  delete item;
+
+  // Other items still point to the removed one in their link lists
+  mLinksDirty = true;
+
+  if ( mLayoutRunning ) startLayout();
+
+  update( toWidget( dirty ) );
+}
+
+void TopicMapWidget::slotTopicsReset()
+{
+  writeSettings();
+  setupItems( mTopicManager );
+  update();
+}
+
+bool TopicMapWidget::pinMoved() const
+{
+  return mPinMoved;
+}
+
+void TopicMapWidget::setPinMoved( bool pin )
+{
+  mPinMoved = pin;
+}
+
+void TopicMapWidget::startLayout()
+{
+  if ( mLinksDirty ) updateLinks();
+
+  TopicMapLayout::Graph graph;
+  QHash<TopicItem *, int> indexes;
+
+  mLayoutItems = mItems;
+  for( int i = 0; i < mLayoutItems.count(); ++i ) {
+    TopicItem *item = mLayoutItems.at( i );
+    if ( !mPinMoved ) item->pinned = false;
+    graph.positions.append( QPointF( item->pos ) );
+    graph.fixed.append( item->pinned );
+    indexes.insert( item, i );
+  }
+  for( int i = 0; i < mLayoutItems.count(); ++i ) {
+    foreach( TopicItem *target, mLayoutItems.at( i )->links ) {
+      graph.edges.append( qMakePair( i, indexes.value( target ) ) );
     }
+  }
 
-    mItems.append( item );
+  mLayoutRunning = true;
+  mLayout->layout( graph, ++mLayoutGeneration );
+}
+
+void TopicMapWidget::slotLayoutChanged( const QVector<QPointF> &positions,
+  int generation, bool finished )
+{
+  if ( generation != mLayoutGeneration ) return;
+
+  // All topics move, rebuilding the clusters once when they are needed is
+  // cheaper than updating them for each topic
+  mClusterLevels.clear();
+
+  for( int i = 0; i < mLayoutItems.count(); ++i ) {
+    TopicItem *item = mLayoutItems.at( i );
+    // Don't take the item away from the user while it is dragged
+    if ( item == mMoveItem ) continue;
+    moveItem( item, positions.at( i ).toPoint() );
+  }
+
+  if ( finished ) {
+    mLayoutRunning = false;
+    if ( mFitOnLayout ) {
+      mFitOnLayout = false;
+      zoomToFit();
+    }
   }
 
-  readSettings();
+  update();
 }
 
 QSize TopicMapWidget::sizeHint()
@@ -107,71 +549,310 @@ QSize TopicMapWidget::minimumSizeHint()
   return QSize( 200, 100 );
 }
 
+void TopicMapWidget::setView( qreal scale, const QPointF &offset )
+{
+  mScale = qBound( minScale, scale, maxScale );
+  mOffset = offset;
+
+  mTransform.reset();
+  mTransform.translate( mOffset.x(), mOffset.y() );
+  mTransform.scale( mScale, mScale );
+}
+
+void TopicMapWidget::zoomToFit()
+{
+  if ( mItems.isEmpty() ) return;
+
+  QRect bounds;
+  foreach( TopicItem *item, mItems ) bounds |= item->rect;
+
+  QRect view = contentsRect().adjusted( 10, 10, -10, -10 );
+  qreal scale = qMin( qreal( view.width() ) / bounds.width(),
+                      qreal( view.height() ) / bounds.height() );
+  scale = qBound( minScale, scale, maxScale );
+
+  QPointF center = QRectF( bounds ).center();
+  setView( scale, QPointF( view.center() ) - center * scale );
+
+  update();
+}
+
+QPointF TopicMapWidget::toMap( const QPoint &widgetPos ) const
+{
+  return ( QPointF( widgetPos ) - mOffset ) / mScale;
+}
+
+QRect TopicMapWidget::toMap( const QRect &widgetRect ) const
+{
+  return mTransform.inverted().mapRect( QRectF( widgetRect ) )
+    .toAlignedRect();
+}
+
+QRegion TopicMapWidget::toWidget( const QRegion &mapRegion ) const
+{
+  QRegion result;
+  foreach( QRect r, mapRegion.rects() ) {
+    result += mTransform.mapRect( QRectF( r ) ).toAlignedRect()
+      .adjusted( -1, -1, 1, 1 );
+  }
+  return result;
+}
+
+QRect TopicMapWidget::dotRect( TopicItem *item ) const
+{
+  qreal size = dotPixels / qMax( mScale, clusterScale );
+  return QRectF( item->pos.x() - size / 2, item->pos.y() - size / 2,
+                 size, size ).toAlignedRect();
+}
+
+quint64 TopicMapWidget::cellKey( const QPointF &pos, int cellSize )
+{
+  qint32 column = qint32( floor( pos.x() / cellSize ) );
+  qint32 row = qint32( floor( pos.y() / cellSize ) );
+  return quint64( quint32( column ) ) << 32 | quint32( row );
+}
+
+const TopicMapWidget::ClusterLevel &TopicMapWidget::clusterLevel(
+  int cellSize )
+{
+  QMap<int, ClusterLevel>::iterator it = mClusterLevels.find( cellSize );
+  if ( it != mClusterLevels.end() ) return it.value();
+
+  if ( mLinksDirty ) updateLinks();
+
+  ClusterLevel &level = mClusterLevels[ cellSize ];
+
+  foreach( TopicItem *item, mItems ) {
+    quint64 key = cellKey( item->pos, cellSize );
+    QHash<quint64, Cluster>::iterator c = level.clusters.find( key );
+    if ( c == level.clusters.end() ) {
+      Cluster cluster;
+      cluster.sumX = 0;
+      cluster.sumY = 0;
+      cluster.count = 0;
+      c = level.clusters.insert( key, cluster );
+    }
+    c.value().sumX += item->pos.x();
+    c.value().sumY += item->pos.y();
+    c.value().count++;
+
+    foreach( TopicItem *target, item->links ) {
+      quint64 targetKey = cellKey( target->pos, cellSize );
+      if ( targetKey == key ) continue;
+      level.bundles[ key ][ targetKey ]++;
+      level.bundles[ targetKey ][ key ]++;
+    }
+  }
+
+  return level;
+}
+
+static bool zLessThan( TopicItem *i1, TopicItem *i2 )
+{
+  return i1->z < i2->z;
+}
+
 void TopicMapWidget::paintEvent( QPaintEvent *e )
 {
   QFrame::paintEvent( e );
 
+  if ( mLinksDirty ) updateLinks();
+
   QPainter p( this );
-  
-  p.setPen( QPen( Qt::black, 2 ) );
-  p.setBrush( Qt::cyan );
+  p.setClipRect( contentsRect() );
+  p.setTransform( mTransform );
 
-  foreach( TopicItem *item, mItems ) {
-    drawTopic( &p, item );
+  QRect view = toMap( contentsRect() );
+
+  bool clusters = showClusters();
+  if ( clusters != mShowsClusters ) {
+    mShowsClusters = clusters;
+    // Don't mix levels of detail, when only a part is painted
+    if ( !e->rect().contains( contentsRect() ) ) update();
+  }
+
+  if ( clusters ) {
+    paintClusters( &p, view );
+  } else {
+    paintItems( &p, toMap( e->rect() ) );
   }
 }
 
-void TopicMapWidget::drawTopic( QPainter *p, TopicItem *item )
+bool TopicMapWidget::showClusters() const
 {
-  QFontMetrics fm( font() );
-  QRect r = fm.boundingRect( item->text );
-  
-  int margin = 6;
+  if ( mScale < clusterScale ) return true;
 
-  r.translate( item->pos );
+  QRect view = toMap( contentsRect() );
+  return mGrid.count( view, maxDetailItems ) >= maxDetailItems;
+}
+
+void TopicMapWidget::paintItems( QPainter *p, const QRect &area )
+{
+  // Lines are looked up in the cells they cross, so lines between items
+  // outside of the area are drawn as well, when they cross it
+  QRectF bounds = QRectF( area ).adjusted( -1, -1, 1, 1 );
+  QSet<Link> links;
+  int left = int( floor( qreal( area.left() ) / linkCellSize ) );
+  int right = int( floor( qreal( area.right() ) / linkCellSize ) );
+  int top = int( floor( qreal( area.top() ) / linkCellSize ) );
+  int bottom = int( floor( qreal( area.bottom() ) / linkCellSize ) );
+  for( int column = left; column <= right; ++column ) {
+    for( int row = top; row <= bottom; ++row ) {
+      quint64 key = quint64( quint32( column ) ) << 32 | quint32( row );
+      QHash<quint64, QList<Link> >::const_iterator it =
+        mLinkCells.constFind( key );
+      if ( it == mLinkCells.constEnd() ) continue;
+      foreach( const Link &link, it.value() ) links.insert( link );
+    }
+  }
+
+  p->setPen( QPen( Qt::darkGray, 0 ) );
+  foreach( const Link &link, links ) {
+    QPointF from = link.first->pos;
+    QPointF to = link.second->pos;
+    if ( lineIntersects( from, to, bounds ) ) p->drawLine( from, to );
+  }
 
-  r.setX( r.x() - margin );
-  r.setY( r.y() - margin );
-  r.setWidth( r.width() + 2 * margin );
-  r.setHeight( r.height() + 2 * margin );
+  // Only items in the area to be painted are drawn
+  QList<TopicItem *> visible;
+  foreach( TopicItem *item, mGrid.items( area ) ) {
+    if ( item->rect.intersects( area ) ) visible.append( item );
+  }
 
-  p->drawRoundRect( r );
-  p->drawText( item->pos, item->text );
+  if ( mScale >= labelScale ) {
+    qSort( visible.begin(), visible.end(), zLessThan );
+    foreach( TopicItem *item, visible ) {
+      p->drawPixmap( item->rect.topLeft(), item->label );
+    }
+  } else {
+    p->setPen( Qt::NoPen );
+    p->setBrush( Qt::darkCyan );
+    foreach( TopicItem *item, visible ) {
+      p->drawRect( dotRect( item ) );
+    }
+  }
 }
 
-struct SortHelper
+void TopicMapWidget::paintClusters( QPainter *p, const QRect &view )
 {
-  SortHelper( TopicItem *i, float dist ) : item( i ), distance( dist ) {}
-  SortHelper() {}
+  // Use power of two cell sizes, so clusters are reused while zooming
+  int cellSize = 1;
+  while( cellSize * mScale < clusterPixels ) cellSize *= 2;
+
+  const ClusterLevel &level = clusterLevel( cellSize );
+
+  int left = int( floor( qreal( view.left() ) / cellSize ) );
+  int right = int( floor( qreal( view.right() ) / cellSize ) );
+  int top = int( floor( qreal( view.top() ) / cellSize ) );
+  int bottom = int( floor( qreal( view.bottom() ) / cellSize ) );
+
+  QList<quint64> visible;
+  for( int column = left; column <= right; ++column ) {
+    for( int row = top; row <= bottom; ++row ) {
+      quint64 key = quint64( quint32( column ) ) << 32 | quint32( row );
+      if ( level.clusters.contains( key ) ) visible.append( key );
+    }
+  }
 
-  TopicItem *item;
-  float distance;
+  // Bundles are recorded for both cells and drawn once from the cell with
+  // the smaller key. All of them are tested against the view, because a
+  // bundle between two cells out of view might cross it.
+  qreal pixel = 1 / mScale;
+  QHash<quint64, QHash<quint64, int> >::const_iterator b;
+  for( b = level.bundles.constBegin(); b != level.bundles.constEnd(); ++b ) {
+    quint64 key = b.key();
+    const Cluster &cluster = level.clusters[ key ];
+    QPointF from( cluster.sumX / cluster.count, cluster.sumY / cluster.count );
+
+    QHash<quint64, int>::const_iterator it;
+    for( it = b.value().constBegin(); it != b.value().constEnd(); ++it ) {
+      quint64 otherKey = it.key();
+      if ( otherKey < key ) continue;
+
+      const Cluster &other = level.clusters[ otherKey ];
+      QPointF to( other.sumX / other.count, other.sumY / other.count );
+      qreal width = ( 1 + log( qreal( it.value() ) ) ) * pixel;
+      QRectF bounds = QRectF( view ).adjusted( -width, -width, width, width );
+      if ( !lineIntersects( from, to, bounds ) ) continue;
+
+      p->setPen( QPen( Qt::darkGray, width ) );
+      p->drawLine( from, to );
+    }
+  }
 
-  bool operator<( const SortHelper &other ) const
-  {
-    return distance < other.distance;
+  p->setPen( QPen( Qt::black, 0 ) );
+  p->setBrush( Qt::cyan );
+  foreach( quint64 key, visible ) {
+    const Cluster &cluster = level.clusters[ key ];
+    QPointF center( cluster.sumX / cluster.count,
+                    cluster.sumY / cluster.count );
+    qreal radius = ( 2 + sqrt( qreal( cluster.count ) ) ) * pixel;
+    p->drawEllipse( QRectF( center.x() - radius, center.y() - radius,
+                            2 * radius, 2 * radius ) );
   }
-};
+}
 
 void TopicMapWidget::mousePressEvent( QMouseEvent *e )
 {
   QFrame::mousePressEvent( e );
 
-  QList<SortHelper> l;
-  foreach( TopicItem *item, mItems ) {
-    l << SortHelper( item, QLineF( e->pos(), item->pos ).length() );
+  mMoveItem = 0;
+  mMoved = false;
+
+  // Topics can only be moved when they are shown individually
+  if ( e->button() == Qt::LeftButton && !showClusters() ) {
+    mMoveItem = itemAt( e->pos() );
+    if ( mMoveItem ) {
+      mMoveItem->z = ++mTopZ;
+      mClickOffset = toMap( e->pos() ) - QPointF( mMoveItem->pos );
+      update( toWidget( mMoveItem->rect ) );
+      return;
+    }
   }
-  qSort( l );
-  mMoveItem = l.at( 0 ).item;
-  
-  mClickOffset = e->pos() - mMoveItem->pos;
+
+  mPanning = true;
+  mPanPos = e->pos();
 }
 
 void TopicMapWidget::mouseReleaseEvent( QMouseEvent *e )
 {
   QFrame::mouseReleaseEvent( e );
 
+  if ( mMoveItem && mMoved ) {
+    mMoveItem->pinned = mPinMoved;
+    // Continue the layout from the new position
+    if ( mLayoutRunning ) startLayout();
+  }
+
   mMoveItem = 0;
+  mPanning = false;
+}
+
+void TopicMapWidget::mouseDoubleClickEvent( QMouseEvent *e )
+{
+  QFrame::mouseDoubleClickEvent( e );
+
+  if ( e->button() != Qt::LeftButton || showClusters() ) return;
+
+  TopicItem *item = itemAt( e->pos() );
+  if ( item && item->pinned ) {
+    item->pinned = false;
+    // Let the running layout move the released topic
+    if ( mLayoutRunning ) startLayout();
+  }
+}
+
+TopicItem *TopicMapWidget::itemAt( const QPoint &pos ) const
+{
+  QPoint mapPos = toMap( pos ).toPoint();
+
+  TopicItem *result = 0;
+  foreach( TopicItem *item, mGrid.items( QRect( mapPos, QSize( 1, 1 ) ) ) ) {
+    if ( item->rect.contains( mapPos ) && ( !result || item->z > result->z ) ) {
+      result = item;
+    }
+  }
+  return result;
 }
 
 void TopicMapWidget::mouseMoveEvent( QMouseEvent *e )
@@ -179,8 +860,42 @@ void TopicMapWidget::mouseMoveEvent( QMouseEvent *e )
   QFrame::mouseMoveEvent( e );
 
   if ( mMoveItem ) {
-    QPoint p = e->pos();
-    mMoveItem->pos = p - mClickOffset;
+    if ( mLinksDirty ) updateLinks();
+
+    QRegion dirty = itemRegion( mMoveItem );
+    moveItem( mMoveItem, ( toMap( e->pos() ) - mClickOffset ).toPoint() );
+    mMoved = true;
+    update( toWidget( dirty + itemRegion( mMoveItem ) ) );
+  } else if ( mPanning ) {
+    QPoint delta = e->pos() - mPanPos;
+    mPanPos = e->pos();
+    setView( mScale, mOffset + delta );
+    // Only the part of the map which scrolled into view is painted
+    scroll( delta.x(), delta.y(), contentsRect() );
+  }
+}
+
+void TopicMapWidget::wheelEvent( QWheelEvent *e )
+{
+  // Keep the point under the mouse in place
+  QPointF pos = toMap( e->pos() );
+  qreal scale = mScale * pow( 1.25, e->delta() / 120.0 );
+  scale = qBound( minScale, scale, maxScale );
+  setView( scale, QPointF( e->pos() ) - pos * scale );
+
+  update();
+}
+
+void TopicMapWidget::changeEvent( QEvent *e )
+{
+  QFrame::changeEvent( e );
+
+  if ( e->type() == QEvent::FontChange ) {
+    foreach( TopicItem *item, mItems ) {
+      mGrid.remove( item, item->rect );
+      renderLabel( item );
+      mGrid.insert( item, item->rect );
+    }
     update();
   }
 }
@@ -20,12 +20,22 @@
 #ifndef TOPICMAPWIDGET_H
 #define TOPICMAPWIDGET_H
 
+#include "topicgrid.h"
+
 #include <QFrame>
 #include <QPoint>
-
-class QSettings;
+#include <QPixmap>
+#include <QRegion>
+#include <QHash>
+#include <QVector>
+#include <QPointF>
+#include <QTransform>
+#include <QMap>
+#include <QPair>
+#include <QList>
 
 class TopicManager;
+class TopicMapLayout;
 
 /**
   This class represents a topic as an item of the topic map widget.
@@ -36,13 +46,41 @@ class TopicItem
     QPoint pos;
     QString text;
     QString topic;
+
+    /** Rendered box with the text, drawn at pos + labelOffset. */
+    QPixmap label;
+    QPoint labelOffset;
+    /** Area covered by the label in map coordinates. */
+    QRect rect;
+    /** Stacking order, items with higher values are drawn on top. */
+    int z;
+    /** Set, if the user has positioned the item by hand. */
+    bool pinned;
+
+    /** Items this item links to and items linking to this item. */
+    QList<TopicItem *> links;
+    QList<TopicItem *> backlinks;
 };
 
 /**
-  This class is a widget showing a map of topics.
+  This class is a widget showing a map of topics. The map can be zoomed with
+  the mouse wheel and panned by dragging the background. Topics moved by hand
+  are pinned, so the automatic layout keeps them in place. Double-clicking a
+  topic releases it again.
+
+  Positions of topics are kept in map coordinates, which are transformed to
+  widget coordinates for display. Depending on the zoom level topics are
+  shown with their labels, as dots or, when zoomed out far, aggregated to
+  clusters of topics, which are connected by one line for all links between
+  them. Views containing too many topics to be shown individually are shown
+  as clusters as well. Only the part of the map in view is painted, so the
+  time to paint a frame depends on the size of the widget and not on the
+  number of topics. Links are recorded in the cells of the map they cross,
+  so lines crossing the view are found without looking at all links.
 */
 class TopicMapWidget : public QFrame
 {
+    Q_OBJECT
   public:
     TopicMapWidget( QWidget *parent );
     ~TopicMapWidget();
@@ -57,24 +95,158 @@ class TopicMapWidget : public QFrame
     */
     void setupItems( TopicManager *tm );
 
+    /**
+      Return, if topics positioned by hand keep their position on layout.
+    */
+    bool pinMoved() const;
+
+  public slots:
+    /**
+      Start automatic layout of the map in the background.
+    */
+    void startLayout();
+    /**
+      Set, if topics positioned by hand keep their position on layout. If
+      not, topics pinned before are released when the layout is started.
+    */
+    void setPinMoved( bool );
+    /**
+      Zoom and pan the map, so that all topics are in view.
+    */
+    void zoomToFit();
+
+  protected slots:
+    void slotTopicAdded( const QString &topic );
+    void slotTopicRemoved( const QString &topic );
+    void slotTopicsReset();
+    void slotLinksChanged();
+    void slotLayoutChanged( const QVector<QPointF> &positions,
+      int generation, bool finished );
+
   protected:
+    TopicItem *createItem( const QString &topic );
+    /**
+      Read position of item from settings. Returns \c false, if no position
+      was stored.
+    */
+    bool readPosition( TopicItem * );
+    void addItem( TopicItem * );
+    void clearItems();
+
+    /**
+      Render label pixmap of item and update its rectangle.
+    */
+    void renderLabel( TopicItem * );
+    /**
+      Move item to new position keeping the spatial index up to date.
+    */
+    void moveItem( TopicItem *, const QPoint &pos );
+    /**
+      Return region covered by the item and the lines to its linked items.
+    */
+    QRegion itemRegion( TopicItem * ) const;
+    /**
+      Add the links of the item to the cells they cross, or remove them.
+    */
+    void updateLinkCells( TopicItem *, bool insert );
+    void updateLinkCells( TopicItem *from, TopicItem *to, bool insert );
+    void updateLinks();
+
+    /**
+      Set zoom factor and offset of the view.
+    */
+    void setView( qreal scale, const QPointF &offset );
+    QPointF toMap( const QPoint &widgetPos ) const;
+    QRect toMap( const QRect &widgetRect ) const;
+    QRegion toWidget( const QRegion &mapRegion ) const;
+    /**
+      Return area of dot representing the item at medium zoom levels.
+    */
+    QRect dotRect( TopicItem * ) const;
+
+    void paintItems( QPainter *p, const QRect &area );
+    void paintClusters( QPainter *p, const QRect &view );
+
     void writeSettings();
-    void readSettings();
   
     void paintEvent( QPaintEvent * );
     void mousePressEvent( QMouseEvent * );
     void mouseReleaseEvent( QMouseEvent * );
     void mouseMoveEvent( QMouseEvent * );
-
-    void drawTopic( QPainter *p, TopicItem * );
+    void mouseDoubleClickEvent( QMouseEvent * );
+    void wheelEvent( QWheelEvent * );
+    void changeEvent( QEvent * );
 
   private:
+    struct Cluster
+    {
+      qreal sumX;
+      qreal sumY;
+      int count;
+    };
+    /**
+      Topics and links aggregated to square cells of the map.
+    */
+    struct ClusterLevel
+    {
+      QHash<quint64, Cluster> clusters;
+      /** Number of links between two cells, recorded for both cells. */
+      QHash<quint64, QHash<quint64, int> > bundles;
+    };
+
+    /**
+      Return clusters for cells of the given size. They are computed on
+      demand and kept until items move or links change.
+    */
+    const ClusterLevel &clusterLevel( int cellSize );
+    static quint64 cellKey( const QPointF &pos, int cellSize );
+    /**
+      Update cached clusters for item which moved from the given position.
+    */
+    void moveInClusters( TopicItem *item, const QPoint &oldPos );
+    static void addToBundle( ClusterLevel &level, quint64 from, quint64 to,
+      int count );
+    /**
+      Return, if the view shows clusters instead of single topics, because
+      it's zoomed out too far or there are too many topics in view.
+    */
+    bool showClusters() const;
+    /**
+      Return topmost item at the given position in widget coordinates.
+    */
+    TopicItem *itemAt( const QPoint &pos ) const;
+
+
     QList<TopicItem *> mItems;
+    QHash<QString, TopicItem *> mItemsByTopic;
+    TopicGrid mGrid;
+    /** Link from one item to another. */
+    typedef QPair<TopicItem *, TopicItem *> Link;
+    /** Links recorded in all cells they cross, valid if links aren't dirty. */
+    QHash<quint64, QList<Link> > mLinkCells;
+    int mTopZ;
+    bool mLinksDirty;
 
     TopicItem *mMoveItem;
-    QPoint mClickOffset;
-    
-    QSettings *mSettings;
+    QPointF mClickOffset;
+    bool mMoved;
+
+    qreal mScale;
+    QPointF mOffset;
+    QTransform mTransform;
+    bool mPanning;
+    QPoint mPanPos;
+    QMap<int, ClusterLevel> mClusterLevels;
+    bool mShowsClusters;
+
+    TopicMapLayout *mLayout;
+    QList<TopicItem *> mLayoutItems;
+    int mLayoutGeneration;
+    bool mLayoutRunning;
+    bool mPinMoved;
+    bool mFitOnLayout;
+
+    TopicManager *mTopicManager;
 };
 
 #endif
@@ -0,0 +1,291 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topicstatestore.h"
+
+#include "dbg.h"
+
+#include <QSettings>
+#include <QTimer>
+#include <QtEndian>
+#include <QtAlgorithms>
+
+static const quint32 topicStateStoreMagic = 0x54445353;
+static const quint32 topicStateStoreVersion = 1;
+
+// Layout of a record: offset and length of name, flags, map position,
+// window position, window size, splitter sizes, cursor position
+static const int recordSize = 48;
+
+// Delay in ms after the last change before the store is written
+static const int saveDelay = 3000;
+
+enum StateFlags
+{
+  HasMapPos = 1,
+  MapPinned = 2,
+  HasWindowGeometry = 4,
+  ScratchPad = 8,
+  HasSplitter = 16,
+  HasCursor = 32
+};
+
+
+TopicStateStore::State::State()
+  : hasMapPos( false ), mapPinned( false ), hasWindowGeometry( false ),
+    scratchPad( false ), hasSplitter( false ), splitterLeft( 0 ),
+    splitterRight( 0 ), hasCursor( false ), cursorPosition( 0 )
+{
+}
+
+bool TopicStateStore::State::operator==( const State &other ) const
+{
+  return hasMapPos == other.hasMapPos && mapPos == other.mapPos &&
+    mapPinned == other.mapPinned &&
+    hasWindowGeometry == other.hasWindowGeometry &&
+    windowPos == other.windowPos && windowSize == other.windowSize &&
+    scratchPad == other.scratchPad && hasSplitter == other.hasSplitter &&
+    splitterLeft == other.splitterLeft &&
+    splitterRight == other.splitterRight && hasCursor == other.hasCursor &&
+    cursorPosition == other.cursorPosition;
+}
+
+bool TopicStateStore::State::isEmpty() const
+{
+  return !hasMapPos && !mapPinned && !hasWindowGeometry && !scratchPad &&
+    !hasSplitter && !hasCursor;
+}
+
+
+TopicStateStore::TopicStateStore( const QString &filename, QObject *parent )
+  : QObject( parent ),
+    mTable( filename, topicStateStoreMagic, topicStateStoreVersion, 0,
+      recordSize ),
+    mModified( false )
+{
+  mSaveTimer = new QTimer( this );
+  mSaveTimer->setSingleShot( true );
+  connect( mSaveTimer, SIGNAL( timeout() ), SLOT( save() ) );
+}
+
+TopicStateStore::~TopicStateStore()
+{
+  save();
+}
+
+bool TopicStateStore::open()
+{
+  return mTable.open();
+}
+
+TopicStateStore::State TopicStateStore::readRecord( int record ) const
+{
+  const uchar *r = mTable.record( record );
+
+  State state;
+
+  quint32 flags = qFromLittleEndian<quint32>( r + 8 );
+  state.hasMapPos = flags & HasMapPos;
+  state.mapPinned = flags & MapPinned;
+  state.hasWindowGeometry = flags & HasWindowGeometry;
+  state.scratchPad = flags & ScratchPad;
+  state.hasSplitter = flags & HasSplitter;
+  state.hasCursor = flags & HasCursor;
+
+  state.mapPos = QPoint( qFromLittleEndian<qint32>( r + 12 ),
+                         qFromLittleEndian<qint32>( r + 16 ) );
+  state.windowPos = QPoint( qFromLittleEndian<qint32>( r + 20 ),
+                            qFromLittleEndian<qint32>( r + 24 ) );
+  state.windowSize = QSize( qFromLittleEndian<qint32>( r + 28 ),
+                            qFromLittleEndian<qint32>( r + 32 ) );
+  state.splitterLeft = qFromLittleEndian<qint32>( r + 36 );
+  state.splitterRight = qFromLittleEndian<qint32>( r + 40 );
+  state.cursorPosition = qFromLittleEndian<qint32>( r + 44 );
+
+  return state;
+}
+
+TopicStateStore::State TopicStateStore::state( const QString &topic ) const
+{
+  QMap<QString, State>::ConstIterator it = mChanged.find( topic );
+  if ( it != mChanged.end() ) return it.value();
+  if ( mRemoved.contains( topic ) ) return State();
+
+  int record = mTable.find( topic );
+  if ( record < 0 ) return State();
+
+  return readRecord( record );
+}
+
+void TopicStateStore::setState( const QString &topic, const State &state )
+{
+  if ( state == this->state( topic ) ) return;
+
+  if ( state.isEmpty() ) {
+    remove( topic );
+    return;
+  }
+
+  mChanged.insert( topic, state );
+  mRemoved.remove( topic );
+  scheduleSave();
+}
+
+void TopicStateStore::remove( const QString &topic )
+{
+  mChanged.remove( topic );
+  mRemoved.insert( topic );
+  scheduleSave();
+}
+
+void TopicStateStore::rename( const QString &from, const QString &to )
+{
+  State s = state( from );
+  remove( from );
+  setState( to, s );
+}
+
+void TopicStateStore::scheduleSave()
+{
+  mModified = true;
+  if ( !mSaveTimer->isActive() ) mSaveTimer->start( saveDelay );
+}
+
+QStringList TopicStateStore::topics() const
+{
+  QStringList result;
+  foreach( QString topic, mTable.names() ) {
+    if ( !mRemoved.contains( topic ) && !mChanged.contains( topic ) ) {
+      result.append( topic );
+    }
+  }
+  result += mChanged.keys();
+  qSort( result );
+  return result;
+}
+
+bool TopicStateStore::save()
+{
+  mSaveTimer->stop();
+
+  if ( !mModified ) return true;
+
+  QMap<QString, State> states;
+  for( int record = 0; record < mTable.count(); ++record ) {
+    QString topic = mTable.name( record );
+    if ( mRemoved.contains( topic ) || mChanged.contains( topic ) ) continue;
+    states.insert( topic, readRecord( record ) );
+  }
+  QMap<QString, State>::ConstIterator it;
+  for( it = mChanged.begin(); it != mChanged.end(); ++it ) {
+    states.insert( it.key(), it.value() );
+  }
+
+  mTable.beginWrite( states.count(), QByteArray() );
+  for( it = states.begin(); it != states.end(); ++it ) {
+    const State &state = it.value();
+
+    mTable.appendString( it.key() );
+
+    quint32 flags = 0;
+    if ( state.hasMapPos ) flags |= HasMapPos;
+    if ( state.mapPinned ) flags |= MapPinned;
+    if ( state.hasWindowGeometry ) flags |= HasWindowGeometry;
+    if ( state.scratchPad ) flags |= ScratchPad;
+    if ( state.hasSplitter ) flags |= HasSplitter;
+    if ( state.hasCursor ) flags |= HasCursor;
+    mTable.appendUInt32( flags );
+
+    mTable.appendUInt32( state.mapPos.x() );
+    mTable.appendUInt32( state.mapPos.y() );
+    mTable.appendUInt32( state.windowPos.x() );
+    mTable.appendUInt32( state.windowPos.y() );
+    mTable.appendUInt32( state.windowSize.width() );
+    mTable.appendUInt32( state.windowSize.height() );
+    mTable.appendUInt32( state.splitterLeft );
+    mTable.appendUInt32( state.splitterRight );
+    mTable.appendUInt32( state.cursorPosition );
+  }
+
+  // On error the changes stay pending
+  if ( !mTable.commit() ) return false;
+
+  mChanged.clear();
+  mRemoved.clear();
+  mModified = false;
+
+  return true;
+}
+
+void TopicStateStore::migrate( QSettings *settings )
+{
+  int count = 0;
+
+  foreach( QString topic, settings->childGroups() ) {
+    // Groups used for settings of the whole topic directory
+    if ( topic == "map" || topic == "singlewindowmode" ) continue;
+
+    settings->beginGroup( topic );
+
+    State s = state( topic );
+
+    if ( settings->contains( "map/pos" ) ) {
+      s.hasMapPos = true;
+      s.mapPos = settings->value( "map/pos" ).toPoint();
+      s.mapPinned = settings->value( "map/pinned", false ).toBool();
+    }
+    if ( settings->contains( "pos" ) && settings->contains( "size" ) ) {
+      s.hasWindowGeometry = true;
+      s.windowPos = settings->value( "pos" ).toPoint();
+      s.windowSize = settings->value( "size" ).toSize();
+    }
+    s.scratchPad = settings->value( "scratchpad", s.scratchPad ).toBool();
+    if ( settings->contains( "splitter/left" ) ) {
+      s.hasSplitter = true;
+      s.splitterLeft = settings->value( "splitter/left" ).toInt();
+      s.splitterRight = settings->value( "splitter/right" ).toInt();
+    }
+    if ( settings->contains( "cursor/position" ) ) {
+      s.hasCursor = true;
+      s.cursorPosition = settings->value( "cursor/position" ).toInt();
+    }
+
+    setState( topic, s );
+
+    settings->remove( "map/pos" );
+    settings->remove( "map/pinned" );
+    settings->remove( "pos" );
+    settings->remove( "size" );
+    settings->remove( "scratchpad" );
+    settings->remove( "splitter/left" );
+    settings->remove( "splitter/right" );
+    settings->remove( "cursor/position" );
+
+    settings->endGroup();
+
+    ++count;
+  }
+
+  if ( count > 0 ) {
+    dbg() << "Migrated UI state of " << count << " topics from settings"
+          << endl;
+    save();
+  }
+}
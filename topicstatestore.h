@@ -0,0 +1,156 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICSTATESTORE_H
+#define TOPICSTATESTORE_H
+
+#include "mappedtable.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QSet>
+#include <QPoint>
+#include <QSize>
+
+class QSettings;
+class QTimer;
+
+/**
+  This class stores the state of the user interface for each topic, like
+  the geometry of its window and its position on the topic map, in a file
+  in the topic directory.
+
+  The file is a MappedTable with a record for each topic. Changes are kept
+  in memory and written in one batch a few seconds after the last change or
+  when the store is destroyed.
+*/
+class TopicStateStore : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      State of the user interface for a topic.
+    */
+    struct State
+    {
+      State();
+
+      bool operator==( const State &other ) const;
+      bool operator!=( const State &other ) const
+        { return !( *this == other ); }
+
+      /**
+        Return, if nothing is recorded in the state.
+      */
+      bool isEmpty() const;
+
+      bool hasMapPos;
+      QPoint mapPos;
+      bool mapPinned;
+
+      bool hasWindowGeometry;
+      QPoint windowPos;
+      QSize windowSize;
+
+      bool scratchPad;
+
+      bool hasSplitter;
+      int splitterLeft;
+      int splitterRight;
+
+      bool hasCursor;
+      int cursorPosition;
+    };
+
+    /**
+      Create empty store kept in the given file.
+    */
+    TopicStateStore( const QString &filename, QObject *parent = 0 );
+    /**
+      Write pending changes and close the file.
+    */
+    ~TopicStateStore();
+
+    /**
+      Map store file.
+      
+      \return \c true on success, \c false if the file doesn't exist or isn't
+        valid
+    */
+    bool open();
+
+    /**
+      Return state of topic. If nothing is stored for the topic an empty
+      state is returned.
+    */
+    State state( const QString &topic ) const;
+    /**
+      Set state of topic. The change is written to the file later. An empty
+      state removes the topic from the store.
+    */
+    void setState( const QString &topic, const State &state );
+    /**
+      Remove topic from store.
+    */
+    void remove( const QString &topic );
+    /**
+      Move state stored for a topic to a new name of the topic.
+    */
+    void rename( const QString &from, const QString &to );
+    /**
+      Return names of all topics with stored state.
+    */
+    QStringList topics() const;
+
+    /**
+      Move the per-topic keys for window geometry, splitter, cursor,
+      scratch pad and map position from the given settings into the store.
+      The keys are removed from the settings.
+      
+      \param settings settings with the group of the topic directory
+        selected
+    */
+    void migrate( QSettings *settings );
+
+  public slots:
+    /**
+      Write store to file, if it was modified, and map the new file.
+      
+      \return \c true on success, \c false on error
+    */
+    bool save();
+
+  protected:
+    State readRecord( int record ) const;
+
+    void scheduleSave();
+
+  private:
+    MappedTable mTable;
+
+    QMap<QString, State> mChanged;
+    QSet<QString> mRemoved;
+    bool mModified;
+
+    QTimer *mSaveTimer;
+};
+
+#endif
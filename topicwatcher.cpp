@@ -0,0 +1,179 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "topicwatcher.h"
+
+#include "dbg.h"
+
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+// Time in milliseconds without further changes after which a batch of
+// changes is reported
+static const int batchDelay = 500;
+// Maximum time in milliseconds a batch of changes is delayed
+static const int maxBatchDelay = 3000;
+
+TopicWatcher::TopicWatcher( const QString &dirName, QObject *parent )
+  : QObject( parent ), mDirName( dirName ), mPendingWrites( 0 )
+{
+  mWatcher = new QFileSystemWatcher( this );
+  connect( mWatcher, SIGNAL( directoryChanged( const QString & ) ),
+    SLOT( slotDirectoryChanged() ) );
+  connect( mWatcher, SIGNAL( fileChanged( const QString & ) ),
+    SLOT( slotFileChanged( const QString & ) ) );
+
+  mTimer = new QTimer( this );
+  mTimer->setSingleShot( true );
+  connect( mTimer, SIGNAL( timeout() ), SLOT( refresh() ) );
+}
+
+void TopicWatcher::start()
+{
+  mModified = scan();
+
+  mWatcher->addPath( mDirName );
+}
+
+QString TopicWatcher::topicFilename( const QString &topic ) const
+{
+  return QDir( mDirName ).filePath( topic + ".todoodle" );
+}
+
+void TopicWatcher::watchTopics( const QStringList &topics )
+{
+  foreach( QString topic, mWatchedTopics ) {
+    if ( !topics.contains( topic ) ) {
+      mWatcher->removePath( topicFilename( topic ) );
+    }
+  }
+
+  mWatchedTopics = topics;
+
+  // Files which don't exist yet are added on refresh, when they were created
+  QStringList files = mWatcher->files();
+  foreach( QString topic, mWatchedTopics ) {
+    QString filename = topicFilename( topic );
+    if ( !files.contains( filename ) && QFile::exists( filename ) ) {
+      mWatcher->addPath( filename );
+    }
+  }
+}
+
+void TopicWatcher::slotDirectoryChanged()
+{
+  if ( !mTimer->isActive() ) {
+    mBatchStart.start();
+  } else if ( mBatchStart.elapsed() > maxBatchDelay ) {
+    // Don't postpone the refresh forever while changes keep coming in
+    return;
+  }
+
+  mTimer->start( batchDelay );
+}
+
+void TopicWatcher::slotFileChanged( const QString &path )
+{
+  mChangedTopics.insert( QFileInfo( path ).completeBaseName() );
+
+  slotDirectoryChanged();
+}
+
+void TopicWatcher::beginWrite()
+{
+  ++mPendingWrites;
+}
+
+void TopicWatcher::endWrite( const QString &topic )
+{
+  // The watcher might have been created while the write was pending
+  if ( mPendingWrites == 0 ) return;
+  --mPendingWrites;
+
+  // Only the own write is recorded, other files are still compared on the
+  // next refresh
+  QFileInfo fi( topicFilename( topic ) );
+  if ( fi.exists() ) mModified.insert( topic, fi.lastModified() );
+}
+
+QHash<QString, QDateTime> TopicWatcher::scan() const
+{
+  QHash<QString, QDateTime> result;
+
+  QDir dir( mDirName );
+  QFileInfoList entries = dir.entryInfoList( QStringList( "*.todoodle" ),
+    QDir::Files );
+  foreach( QFileInfo fi, entries ) {
+    result.insert( fi.completeBaseName(), fi.lastModified() );
+  }
+
+  return result;
+}
+
+void TopicWatcher::refresh()
+{
+  // Wait for own writes to finish, so they aren't reported as changes
+  if ( mPendingWrites > 0 ) {
+    mTimer->start( batchDelay );
+    return;
+  }
+
+  QHash<QString, QDateTime> current = scan();
+
+  QStringList added;
+  QStringList modified;
+  QHash<QString, QDateTime>::ConstIterator it;
+  for( it = current.begin(); it != current.end(); ++it ) {
+    QHash<QString, QDateTime>::ConstIterator old = mModified.find( it.key() );
+    if ( old == mModified.end() ) added.append( it.key() );
+    else if ( old.value() != it.value() ) modified.append( it.key() );
+  }
+
+  // Watched files might have been modified without changing their
+  // modification time as recorded in seconds. Own writes are reported as
+  // well, the receiver has to tell them apart.
+  foreach( QString topic, mChangedTopics ) {
+    if ( current.contains( topic ) && mModified.contains( topic ) &&
+         !modified.contains( topic ) ) {
+      modified.append( topic );
+    }
+  }
+  mChangedTopics.clear();
+
+  QStringList removed;
+  for( it = mModified.begin(); it != mModified.end(); ++it ) {
+    if ( !current.contains( it.key() ) ) removed.append( it.key() );
+  }
+
+  mModified = current;
+
+  // Files replaced by renaming aren't watched anymore
+  watchTopics( mWatchedTopics );
+
+  if ( added.isEmpty() && removed.isEmpty() && modified.isEmpty() ) return;
+
+  dbg() << "TopicWatcher: " << added.count() << " added, " << removed.count()
+    << " removed, " << modified.count() << " modified" << endl;
+
+  emit topicsChanged( added, removed, modified );
+}
@@ -0,0 +1,133 @@
+/*
+    This file is part of Todoodle.
+
+    Copyright (c) 2004 Cornelius Schumacher <schumacher@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+#ifndef TOPICWATCHER_H
+#define TOPICWATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QDateTime>
+#include <QTime>
+
+class QFileSystemWatcher;
+class QTimer;
+
+/**
+  This class watches the topic directory for topics which are added, removed
+  or modified by other processes, e.g. a version control update or another
+  instance of Todoodle.
+
+  Change notifications are collected for a short time and then reported in
+  one batch, so that a burst of changes results in a single refresh. Topics
+  are compared by the modification times of their files. Files which are
+  modified in place only change the directory when their size changes, so
+  the files of open topics are watched as well. In-place modifications of
+  other topics within a second might be missed.
+*/
+class TopicWatcher : public QObject
+{
+    Q_OBJECT
+  public:
+    /**
+      Create watcher for given directory.
+      
+      \param dirName name of topic directory
+      \param parent parent object
+    */
+    TopicWatcher( const QString &dirName, QObject *parent = 0 );
+
+    /**
+      Read the current state of the directory and start watching it.
+    */
+    void start();
+
+    /**
+      Watch the files of the given topics for modifications in place in
+      addition to the directory. Files of other topics aren't watched
+      anymore.
+      
+      \param topics names of topics, usually the ones open in editors
+    */
+    void watchTopics( const QStringList &topics );
+
+    /**
+      Record that a topic file is about to be written by this process.
+      Refreshing is postponed until all own writes finished, so they aren't
+      reported as changes.
+    */
+    void beginWrite();
+    /**
+      Record that writing a topic file announced by beginWrite() finished.
+      
+      \param topic name of the written topic
+    */
+    void endWrite( const QString &topic );
+
+    /**
+      Return names of all topics found in the directory by the last scan.
+    */
+    QStringList topics() const { return mModified.keys(); }
+    /**
+      Return time of last modification of the file of the given topic found
+      by the last scan.
+    */
+    QDateTime lastModified( const QString &topic ) const
+    {
+      return mModified.value( topic );
+    }
+
+  signals:
+    /**
+      Emitted when the content of the topic directory changed.
+      
+      \param added names of added topics
+      \param removed names of removed topics
+      \param modified names of topics whose files were replaced or modified
+    */
+    void topicsChanged( const QStringList &added, const QStringList &removed,
+      const QStringList &modified );
+
+  protected slots:
+    void slotDirectoryChanged();
+    void slotFileChanged( const QString &path );
+    void refresh();
+
+  protected:
+    QHash<QString, QDateTime> scan() const;
+    QString topicFilename( const QString &topic ) const;
+
+  private:
+    QString mDirName;
+
+    QFileSystemWatcher *mWatcher;
+    QTimer *mTimer;
+    QTime mBatchStart;
+
+    QHash<QString, QDateTime> mModified;
+
+    QStringList mWatchedTopics;
+    /** Watched topics whose files changed since the last refresh */
+    QSet<QString> mChangedTopics;
+    int mPendingWrites;
+};
+
+#endif
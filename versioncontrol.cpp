@@ -55,6 +55,34 @@ bool VersionControl::addFile( const QString &filename )
   return startProcess();
 }
 
+bool VersionControl::removeFile( const QString &filename )
+{
+  createProcess();
+
+  mCommand = Remove;
+
+  mArguments << "rm" << "--force" << filename;
+
+  return startProcess();
+}
+
+bool VersionControl::moveFile( const QString &from, const QString &to )
+{
+  createProcess();
+
+  mCommand = Move;
+
+  mArguments << "mv" << from << to;
+
+  startProcess();
+
+  // The caller relies on the file being renamed
+  if ( !mProcess->waitForFinished() ) return false;
+
+  return mProcess->exitStatus() == QProcess::NormalExit &&
+    mProcess->exitCode() == 0;
+}
+
 bool VersionControl::commitDirectory( const QString &log )
 {
   createProcess();
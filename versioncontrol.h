@@ -34,7 +34,7 @@ class VersionControl : public QObject
 {
     Q_OBJECT
   public:
-    enum Cmd { Undefined, Add, Update, Commit };
+    enum Cmd { Undefined, Add, Remove, Move, Update, Commit };
 
     /**
       Setup version control for directory.
@@ -51,6 +51,22 @@ class VersionControl : public QObject
       \return \c true on success, otherwise \c false
     */
     bool addFile( const QString &filename );
+    /**
+      Remove file from version control.
+      
+      \param filename Name of file
+      \return \c true on success, otherwise \c false
+    */
+    bool removeFile( const QString &filename );
+    /**
+      Rename file under version control. This waits until the file is
+      renamed.
+      
+      \param from old name of file
+      \param to new name of file
+      \return \c true on success, otherwise \c false
+    */
+    bool moveFile( const QString &from, const QString &to );
     /**
       Commit changes to version control system.
       